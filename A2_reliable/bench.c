@@ -0,0 +1,418 @@
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "clock.h"
+#include "netif.h"
+#include "protocol.h"
+
+// Microbenchmarks for the per-packet paths: CRC32, building and parsing
+// DATA packets, and netif over loopback. Every case is warmed up, sized so
+// one repetition takes about --rep_ms, and repeated --reps times; the
+// median is reported along with the fastest run and the spread. Output is
+// one KEY=VAL line per case, and a saved output file can be passed back
+// with --baseline to flag cases that got slower.
+
+#define BENCH_MAX_CASES 64
+#define BENCH_MAX_REPS 101
+// Packets in flight per round of the netif throughput cases; below the
+// default socket buffer so that loopback does not drop.
+#define BENCH_NETIF_BURST 32
+#define BENCH_NETIF_SOCKS 8
+#define BENCH_NETIF_LEN 1000
+
+static const size_t payload_sizes[] = {64, 256, 1000, 1472, 8192, 65000};
+
+// Runs iters operations and returns how many completed (fewer only when
+// loopback dropped packets).
+typedef uint64_t (*bench_fn)(void *ctx, uint64_t iters);
+
+typedef struct {
+    const char *name;
+    size_t size;                // payload bytes per operation, 0 if not a byte count
+    bool pps;                   // report packets/s instead of GB/s
+    bench_fn fn;
+    void *ctx;
+} bench_case_t;
+
+typedef struct {
+    char name[32];
+    size_t size;
+    double ns_op;
+} bench_base_t;
+
+static volatile uint64_t sink;
+
+typedef struct {
+    uint8_t *buf;
+    uint8_t *pkt;
+    size_t len;
+    size_t pkt_len;
+} mem_ctx_t;
+
+static uint64_t run_crc(void *arg, uint64_t iters) {
+    mem_ctx_t *c = arg;
+    uint32_t acc = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        acc += crc32_ieee(c->buf, c->len);
+    }
+    sink += acc;
+    return iters;
+}
+
+static uint64_t run_build(void *arg, uint64_t iters) {
+    mem_ctx_t *c = arg;
+    size_t acc = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        // In place, as the senders build them.
+        acc += pkt_build_data(c->pkt, PKT_HDR_LEN + c->len, (uint32_t)i, c->pkt + PKT_HDR_LEN,
+                              (uint16_t)c->len);
+    }
+    sink += acc;
+    return iters;
+}
+
+static uint64_t run_parse(void *arg, uint64_t iters) {
+    mem_ctx_t *c = arg;
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        pkt_hdr_t hdr;
+        const uint8_t *payload;
+        uint16_t plen;
+        if (pkt_parse(c->pkt, c->pkt_len, &hdr, &payload, &plen) == 0) {
+            acc += plen;
+        }
+    }
+    sink += acc;
+    return iters;
+}
+
+typedef struct {
+    int rx;                     // receiver; netif_send goes here (RELIABLE_EMU_PORT)
+    int rx_port;
+    int tx[BENCH_NETIF_SOCKS];
+    int tx_port;                // port of tx[0]
+    int ntx;
+    uint8_t pkt[PKT_HDR_LEN + BENCH_NETIF_LEN];
+    size_t pkt_len;
+    uint8_t rbuf[PKT_HDR_LEN + BENCH_NETIF_LEN];
+} net_ctx_t;
+
+static int bound_port(int sock) {
+    struct sockaddr_in a;
+    socklen_t alen = sizeof(a);
+    if (getsockname(sock, (struct sockaddr *)&a, &alen) != 0) {
+        return -1;
+    }
+    return ntohs(a.sin_port);
+}
+
+static int open_bound(int *port) {
+    int sock = netif_socket();
+    if (sock < 0) {
+        return -1;
+    }
+    if (netif_bind(sock, 0) != 0 || (*port = bound_port(sock)) <= 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static int net_open(net_ctx_t *c, int ntx) {
+    memset(c, 0, sizeof(*c));
+    c->rx = open_bound(&c->rx_port);
+    if (c->rx < 0) {
+        return -1;
+    }
+    for (c->ntx = 0; c->ntx < ntx; c->ntx++) {
+        int port;
+        c->tx[c->ntx] = open_bound(&port);
+        if (c->tx[c->ntx] < 0) {
+            return -1;
+        }
+        if (c->ntx == 0) {
+            c->tx_port = port;
+        }
+    }
+    c->pkt_len = pkt_build_data(c->pkt, sizeof(c->pkt), 0, c->pkt + PKT_HDR_LEN, BENCH_NETIF_LEN);
+    return c->pkt_len > 0 ? 0 : -1;
+}
+
+static void net_close(net_ctx_t *c) {
+    if (c->rx > 0) {
+        close(c->rx);
+    }
+    for (int i = 0; i < c->ntx; i++) {
+        close(c->tx[i]);
+    }
+}
+
+static void point_netif_at(int port) {
+    char val[16];
+    snprintf(val, sizeof(val), "%d", port);
+    setenv("RELIABLE_EMU_PORT", val, 1);
+    setenv("RELIABLE_EMU_IP", "127.0.0.1", 1);
+}
+
+// One DATA packet there and back: netif_send, netif_recvfrom, netif_sendto
+// back, netif_recv.
+static uint64_t run_pingpong(void *arg, uint64_t iters) {
+    net_ctx_t *c = arg;
+    point_netif_at(c->rx_port);
+    uint64_t done = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        if (netif_send(c->tx[0], c->pkt, c->pkt_len) < 0 ||
+            netif_recvfrom(c->rx, c->rbuf, sizeof(c->rbuf), 100, NULL, NULL) <= 0 ||
+            netif_sendto(c->rx, "127.0.0.1", c->tx_port, c->pkt, c->pkt_len) < 0 ||
+            netif_recv(c->tx[0], c->rbuf, sizeof(c->rbuf), 100) <= 0) {
+            continue;
+        }
+        done++;
+    }
+    return done;
+}
+
+// Bursts through netif_batch from ntx sockets in turn into one receiver,
+// drained with netif_recv: the senders' path into the emulator.
+static uint64_t run_stream(void *arg, uint64_t iters) {
+    net_ctx_t *c = arg;
+    point_netif_at(c->rx_port);
+    uint64_t got = 0;
+    uint64_t sent = 0;
+    int next_tx = 0;
+    while (sent < iters) {
+        int burst = BENCH_NETIF_BURST;
+        if ((uint64_t)burst > iters - sent) {
+            burst = (int)(iters - sent);
+        }
+        int per = (burst + c->ntx - 1) / c->ntx;
+        for (int left = burst; left > 0;) {
+            int n = left < per ? left : per;
+            netif_batch_t b;
+            netif_batch_init(&b, c->tx[next_tx]);
+            for (int k = 0; k < n; k++) {
+                netif_batch_add(&b, c->pkt, c->pkt_len, NULL, 0);
+            }
+            netif_batch_flush(&b);
+            next_tx = (next_tx + 1) % c->ntx;
+            left -= n;
+        }
+        sent += (uint64_t)burst;
+        for (int k = 0; k < burst; k++) {
+            if (netif_recv(c->rx, c->rbuf, sizeof(c->rbuf), 20) <= 0) {
+                break;
+            }
+            got++;
+        }
+    }
+    return got;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static const bench_base_t *find_base(const bench_base_t *base, size_t nbase, const char *name, size_t size) {
+    for (size_t i = 0; i < nbase; i++) {
+        if (base[i].size == size && strcmp(base[i].name, name) == 0) {
+            return &base[i];
+        }
+    }
+    return NULL;
+}
+
+// Read the BENCH/SIZE/NS_OP fields of a previous run's output.
+static int load_baseline(const char *path, bench_base_t *base, size_t cap, size_t *n) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[512];
+    *n = 0;
+    while (fgets(line, sizeof(line), f) && *n < cap) {
+        bench_base_t b;
+        memset(&b, 0, sizeof(b));
+        unsigned long size;
+        if (sscanf(line, "BENCH=%31s SIZE=%lu NS_OP=%lf", b.name, &size, &b.ns_op) == 3) {
+            b.size = size;
+            base[(*n)++] = b;
+        }
+    }
+    fclose(f);
+    if (*n == 0) {
+        fprintf(stderr, "%s: no BENCH lines\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--reps N] [--rep_ms MS] [--filter TEXT] [--no_net]\n"
+            "          [--baseline FILE [--threshold PCT]]\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    int reps = 7;
+    int rep_ms = 50;
+    const char *filter = NULL;
+    const char *baseline = NULL;
+    double threshold = 10.0;
+    bool net = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rep_ms") == 0 && i + 1 < argc) {
+            rep_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--no_net") == 0) {
+            net = false;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (reps < 1 || reps > BENCH_MAX_REPS || rep_ms <= 0 || threshold <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    static bench_base_t base[256];
+    size_t nbase = 0;
+    if (baseline && load_baseline(baseline, base, 256, &nbase) != 0) {
+        return 1;
+    }
+
+    bench_case_t cases[BENCH_MAX_CASES];
+    size_t ncases = 0;
+    size_t nsizes = sizeof(payload_sizes) / sizeof(payload_sizes[0]);
+    mem_ctx_t mem[sizeof(payload_sizes) / sizeof(payload_sizes[0])];
+    for (size_t i = 0; i < nsizes; i++) {
+        size_t len = payload_sizes[i];
+        mem[i].len = len;
+        mem[i].buf = malloc(len);
+        mem[i].pkt = malloc(PKT_HDR_LEN + len);
+        if (!mem[i].buf || !mem[i].pkt) {
+            perror("malloc");
+            return 1;
+        }
+        for (size_t k = 0; k < len; k++) {
+            mem[i].buf[k] = (uint8_t)(k * 131 + 7);
+        }
+        memcpy(mem[i].pkt + PKT_HDR_LEN, mem[i].buf, len);
+        mem[i].pkt_len = pkt_build_data(mem[i].pkt, PKT_HDR_LEN + len, 1, mem[i].pkt + PKT_HDR_LEN,
+                                        (uint16_t)len);
+        cases[ncases++] = (bench_case_t){"crc32_ieee", len, false, run_crc, &mem[i]};
+        cases[ncases++] = (bench_case_t){"pkt_build_data", len, false, run_build, &mem[i]};
+        cases[ncases++] = (bench_case_t){"pkt_parse", len, false, run_parse, &mem[i]};
+    }
+    net_ctx_t nets[3];
+    if (net) {
+        if (net_open(&nets[0], 1) != 0 || net_open(&nets[1], 1) != 0 ||
+            net_open(&nets[2], BENCH_NETIF_SOCKS) != 0) {
+            fprintf(stderr, "loopback sockets unavailable, use --no_net\n");
+            return 1;
+        }
+        cases[ncases++] = (bench_case_t){"netif_pingpong", BENCH_NETIF_LEN, true, run_pingpong, &nets[0]};
+        cases[ncases++] = (bench_case_t){"netif_stream_1sock", BENCH_NETIF_LEN, true, run_stream, &nets[1]};
+        cases[ncases++] = (bench_case_t){"netif_stream_8sock", BENCH_NETIF_LEN, true, run_stream, &nets[2]};
+    }
+
+    int regressions = 0;
+    for (size_t ci = 0; ci < ncases; ci++) {
+        bench_case_t *bc = &cases[ci];
+        if (filter && !strstr(bc->name, filter)) {
+            continue;
+        }
+        // Warm up caches, branch predictors and the CPU clock, and find an
+        // iteration count that fills a repetition.
+        uint64_t iters = 1;
+        uint64_t spent = 0;
+        for (;;) {
+            uint64_t t0 = clock_now_ns();
+            bc->fn(bc->ctx, iters);
+            spent = clock_now_ns() - t0;
+            if (spent >= (uint64_t)rep_ms * 1000000ULL / 4 || iters >= (1ULL << 40)) {
+                break;
+            }
+            iters *= 2;
+        }
+        iters = (uint64_t)((double)iters * (double)rep_ms * 1e6 / (double)(spent ? spent : 1));
+        if (iters == 0) {
+            iters = 1;
+        }
+
+        double ns[BENCH_MAX_REPS];
+        uint64_t lost = 0;
+        for (int r = 0; r < reps; r++) {
+            uint64_t t0 = clock_now_ns();
+            uint64_t done = bc->fn(bc->ctx, iters);
+            uint64_t dt = clock_now_ns() - t0;
+            lost += iters - done;
+            ns[r] = (double)dt / (double)(done ? done : 1);
+        }
+        qsort(ns, (size_t)reps, sizeof(ns[0]), cmp_double);
+        double median = (reps % 2) ? ns[reps / 2] : (ns[reps / 2 - 1] + ns[reps / 2]) / 2.0;
+        double mean = 0.0;
+        for (int r = 0; r < reps; r++) {
+            mean += ns[r];
+        }
+        mean /= reps;
+        double var = 0.0;
+        for (int r = 0; r < reps; r++) {
+            var += (ns[r] - mean) * (ns[r] - mean);
+        }
+        double rsd = reps > 1 ? 100.0 * sqrt(var / (reps - 1)) / mean : 0.0;
+
+        printf("BENCH=%s SIZE=%zu NS_OP=%.2f MIN_NS=%.2f RSD_PCT=%.1f", bc->name, bc->size, median,
+               ns[0], rsd);
+        if (bc->pps) {
+            printf(" PPS=%.0f LOST=%llu", 1e9 / median, (unsigned long long)lost);
+        } else {
+            printf(" GBPS=%.3f", (double)bc->size / median);
+        }
+        const bench_base_t *b = baseline ? find_base(base, nbase, bc->name, bc->size) : NULL;
+        if (b) {
+            double delta = 100.0 * (median - b->ns_op) / b->ns_op;
+            printf(" BASE_NS=%.2f DELTA_PCT=%+.1f", b->ns_op, delta);
+            if (delta > threshold) {
+                printf(" REGRESSION=1");
+                regressions++;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (net) {
+        for (int i = 0; i < 3; i++) {
+            net_close(&nets[i]);
+        }
+    }
+    for (size_t i = 0; i < nsizes; i++) {
+        free(mem[i].buf);
+        free(mem[i].pkt);
+    }
+    if (baseline) {
+        fprintf(stderr, "%d case(s) slower than the baseline by more than %.0f%%\n", regressions, threshold);
+    }
+    return regressions ? 2 : 0;
+}
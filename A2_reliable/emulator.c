@@ -0,0 +1,906 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "linkmodel.h"
+#include "protocol.h"
+
+// C version of emulator.py: same CLI, same HELLO pairing and the same
+// loss/delay/reorder/rate rules, fast enough that the emulator is never
+// the bottleneck of a benchmark. On top of those it can replay
+// bandwidth and delay traces, drop in Gilbert-Elliott bursts and add
+// jitter (lib/linkmodel.c). With --bottleneck, the DATA of all pairs
+// shares one rate-limited queue under drop-tail, RED or CoDel, and
+// per-flow goodput is reported with Jain's fairness index. An endpoint
+// that says "HELLO 0" is a listener (receiverd): each sender naming its
+// port is paired with a proxy socket of its own, so the listener sees one
+// source address per sender and its answers reach only that sender.
+
+#define EMU_BATCH 64
+#define EMU_MAX_DGRAM 65535
+#define EMU_MAX_ENDPOINTS 8192
+// Address index over the endpoints; a power of two, at most half full.
+#define EMU_ADDR_SLOTS (2 * EMU_MAX_ENDPOINTS)
+// Receive batches per loop pass before due packets get a turn.
+#define EMU_RECV_ROUNDS 4
+// Goodput counts each seq once up to this seq; later ones always count.
+#define FLOW_MAX_SEQ (1u << 27)
+
+// Timing wheel: 2^16 slots of 2^16 ns cover about 4.3 s; later packets
+// wrap around and wait in their slot for the right revolution.
+#define WHEEL_TICK_SHIFT 16
+#define WHEEL_SLOTS (1u << 16)
+#define WHEEL_WORDS (WHEEL_SLOTS / 64)
+
+typedef struct emu_pkt {
+    struct emu_pkt *next;
+    uint64_t deliver_ns;
+    int dst;
+    int src;
+    bool data_pkt;                // DATA: counted for the source's flow
+    uint32_t seq;
+    uint32_t len;
+    uint8_t data[];
+} emu_pkt_t;
+
+typedef struct {
+    emu_pkt_t *head;
+    emu_pkt_t *tail;
+} wheel_slot_t;
+
+typedef struct {
+    wheel_slot_t slots[WHEEL_SLOTS];
+    uint64_t busy[WHEEL_WORDS];   // bit per non-empty slot
+    uint64_t cursor;              // first tick not yet fully released
+    size_t queued;
+} wheel_t;
+
+// The DATA an endpoint sends, as delivered to its peer.
+typedef struct {
+    uint64_t first_ns;
+    uint64_t last_ns;
+    uint64_t delivered_bytes;     // payload bytes, duplicates included
+    uint64_t goodput_bytes;       // payload bytes, first delivery of a seq
+    uint64_t loss_drops;
+    uint64_t queue_drops;
+    uint64_t ce_marks;
+    uint8_t *seen;                // bit per delivered seq
+    size_t seen_bytes;
+} flow_stats_t;
+
+typedef struct {
+    struct sockaddr_in addr;
+    int peer_port;                // 0: a listener
+    int forward;                  // paired endpoint, or -1
+    int sock;                     // packets to this endpoint leave from it
+    bool proxy;                   // a listener as one sender sees it; sock is its own
+    uint64_t next_free_ns;        // --rate_kbps: when the link is idle again
+    lm_trace_pos_t trace_pos;     // --trace: this direction's place in it
+    bool ge_bad;                  // --ge_p: this direction's loss state
+    flow_stats_t flow;
+} endpoint_t;
+
+// --bottleneck: one FIFO link for the DATA of every pair. Departure times
+// are fixed on admission, so the queue only tracks what is still waiting.
+typedef struct {
+    uint64_t depart_ns;
+    uint32_t len;
+} bn_entry_t;
+
+typedef struct {
+    bool on;
+    lm_aqm_t aqm;
+    uint64_t last_depart_ns;
+    lm_trace_pos_t trace_pos;
+    bn_entry_t *fifo;
+    size_t cap;
+    size_t head;
+    size_t count;
+    size_t backlog;               // bytes not yet on the wire
+} bottleneck_t;
+
+typedef struct {
+    double loss;
+    double delay_ms;
+    double reorder;
+    double rate_kbps;
+    bool gilbert;
+    lm_gilbert_t ge;
+    lm_jitter_t jitter;
+    bool use_trace;
+    lm_trace_t trace;
+    bool use_delay_trace;
+    lm_delay_trace_t delay_trace;
+    uint64_t origin_ns;           // trace time 0
+    uint64_t ecn_ns;              // --ecn_ms: CE-mark past this queue delay
+} emu_cfg_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Loss, reorder and jitter draws; the same --seed gives the same run.
+static lm_rng_t rng;
+
+static void wheel_insert(wheel_t *w, emu_pkt_t *p) {
+    uint64_t tick = p->deliver_ns >> WHEEL_TICK_SHIFT;
+    if (tick < w->cursor) {
+        tick = w->cursor;
+    }
+    uint32_t s = (uint32_t)(tick & (WHEEL_SLOTS - 1));
+    wheel_slot_t *slot = &w->slots[s];
+    p->next = NULL;
+    if (slot->tail) {
+        slot->tail->next = p;
+    } else {
+        slot->head = p;
+    }
+    slot->tail = p;
+    w->busy[s / 64] |= 1ULL << (s % 64);
+    w->queued++;
+}
+
+// First non-empty slot at or after tick, as an absolute tick.
+static uint64_t wheel_next_busy(const wheel_t *w, uint64_t tick) {
+    uint32_t s = (uint32_t)(tick & (WHEEL_SLOTS - 1));
+    uint32_t word = s / 64;
+    uint64_t bits = w->busy[word] & (~0ULL << (s % 64));
+    for (uint32_t i = 0; i <= WHEEL_WORDS; i++) {
+        if (bits) {
+            uint32_t found = word * 64 + (uint32_t)__builtin_ctzll(bits);
+            return tick + ((found - s) & (WHEEL_SLOTS - 1));
+        }
+        word = (word + 1) % WHEEL_WORDS;
+        bits = w->busy[word];
+    }
+    return tick;
+}
+
+// Absolute time at which the wheel next needs attention.
+static uint64_t wheel_deadline(const wheel_t *w) {
+    uint64_t tick = wheel_next_busy(w, w->cursor);
+    const wheel_slot_t *slot = &w->slots[tick & (WHEEL_SLOTS - 1)];
+    // A slot may also hold packets of a later revolution, so never sleep
+    // past the end of its tick.
+    uint64_t deadline = (tick + 1) << WHEEL_TICK_SHIFT;
+    for (const emu_pkt_t *p = slot->head; p; p = p->next) {
+        if (p->deliver_ns < deadline) {
+            deadline = p->deliver_ns;
+        }
+    }
+    return deadline;
+}
+
+typedef struct {
+    int sock;
+    int n;
+    struct mmsghdr msgs[EMU_BATCH];
+    struct iovec iov[EMU_BATCH];
+    emu_pkt_t *pkts[EMU_BATCH];
+} send_batch_t;
+
+static void batch_flush(send_batch_t *b) {
+    int off = 0;
+    while (off < b->n) {
+        int sent = sendmmsg(b->sock, b->msgs + off, (unsigned)(b->n - off), 0);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Drop the packet the kernel refused, like a lossy link would.
+            sent = 1;
+        }
+        off += sent;
+    }
+    for (int i = 0; i < b->n; i++) {
+        free(b->pkts[i]);
+    }
+    b->n = 0;
+}
+
+static void flow_delivered(flow_stats_t *f, const emu_pkt_t *p, uint64_t now) {
+    uint32_t payload = p->len - (uint32_t)PKT_HDR_LEN;
+    if (f->first_ns == 0) {
+        f->first_ns = now;
+    }
+    f->last_ns = now;
+    f->delivered_bytes += payload;
+    if (p->seq >= FLOW_MAX_SEQ) {
+        f->goodput_bytes += payload;
+        return;
+    }
+    size_t byte = p->seq / 8;
+    if (byte >= f->seen_bytes) {
+        size_t cap = f->seen_bytes ? f->seen_bytes : 4096;
+        while (cap <= byte) {
+            cap *= 2;
+        }
+        uint8_t *seen = realloc(f->seen, cap);
+        if (!seen) {
+            return;
+        }
+        memset(seen + f->seen_bytes, 0, cap - f->seen_bytes);
+        f->seen = seen;
+        f->seen_bytes = cap;
+    }
+    uint8_t bit = (uint8_t)(1u << (p->seq % 8));
+    if (!(f->seen[byte] & bit)) {
+        f->seen[byte] |= bit;
+        f->goodput_bytes += payload;
+    }
+}
+
+static void batch_add(send_batch_t *b, emu_pkt_t *p, const endpoint_t *eps) {
+    // A batch leaves from one socket: the main one, or a listener's proxy.
+    if (eps[p->dst].sock != b->sock) {
+        batch_flush(b);
+        b->sock = eps[p->dst].sock;
+    }
+    b->iov[b->n].iov_base = p->data;
+    b->iov[b->n].iov_len = p->len;
+    memset(&b->msgs[b->n].msg_hdr, 0, sizeof(b->msgs[b->n].msg_hdr));
+    b->msgs[b->n].msg_hdr.msg_name = (void *)&eps[p->dst].addr;
+    b->msgs[b->n].msg_hdr.msg_namelen = sizeof(eps[p->dst].addr);
+    b->msgs[b->n].msg_hdr.msg_iov = &b->iov[b->n];
+    b->msgs[b->n].msg_hdr.msg_iovlen = 1;
+    b->pkts[b->n] = p;
+    if (++b->n == EMU_BATCH) {
+        batch_flush(b);
+    }
+}
+
+// Send every packet due by now, oldest tick first.
+static void wheel_release(wheel_t *w, uint64_t now, send_batch_t *b, endpoint_t *eps) {
+    uint64_t now_tick = now >> WHEEL_TICK_SHIFT;
+    while (w->queued > 0) {
+        uint64_t tick = wheel_next_busy(w, w->cursor);
+        if (tick > now_tick) {
+            break;
+        }
+        uint32_t s = (uint32_t)(tick & (WHEEL_SLOTS - 1));
+        wheel_slot_t *slot = &w->slots[s];
+        emu_pkt_t *keep_head = NULL;
+        emu_pkt_t *keep_tail = NULL;
+        emu_pkt_t *p = slot->head;
+        while (p) {
+            emu_pkt_t *next = p->next;
+            if (p->deliver_ns <= now) {
+                w->queued--;
+                if (p->data_pkt) {
+                    flow_delivered(&eps[p->src].flow, p, now);
+                }
+                batch_add(b, p, eps);
+            } else {
+                p->next = NULL;
+                if (keep_tail) {
+                    keep_tail->next = p;
+                } else {
+                    keep_head = p;
+                }
+                keep_tail = p;
+            }
+            p = next;
+        }
+        slot->head = keep_head;
+        slot->tail = keep_tail;
+        if (!keep_head) {
+            w->busy[s / 64] &= ~(1ULL << (s % 64));
+        }
+        if (tick == now_tick) {
+            break;
+        }
+        w->cursor = tick + 1;
+    }
+    if (w->cursor < now_tick) {
+        w->cursor = now_tick;
+    }
+}
+
+// Endpoint index + 1 by address, 0 when empty. Proxies share their
+// listener's address and are not in it; endpoints are never removed.
+static int addr_slots[EMU_ADDR_SLOTS];
+
+static uint32_t addr_hash(const struct sockaddr_in *addr) {
+    uint32_t h = addr->sin_addr.s_addr * 2654435761u ^ addr->sin_port * 40503u;
+    return (h ^ h >> 16) & (EMU_ADDR_SLOTS - 1);
+}
+
+static bool same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr;
+}
+
+static int endpoint_find(const endpoint_t *eps, const struct sockaddr_in *addr) {
+    for (uint32_t i = addr_hash(addr); addr_slots[i]; i = (i + 1) & (EMU_ADDR_SLOTS - 1)) {
+        if (same_addr(&eps[addr_slots[i] - 1].addr, addr)) {
+            return addr_slots[i] - 1;
+        }
+    }
+    return -1;
+}
+
+static int endpoint_add(endpoint_t *eps, int *n, const struct sockaddr_in *addr, int sock,
+                        bool proxy) {
+    if (*n == EMU_MAX_ENDPOINTS) {
+        fprintf(stderr, "too many endpoints\n");
+        return -1;
+    }
+    int idx = (*n)++;
+    memset(&eps[idx], 0, sizeof(eps[idx]));
+    eps[idx].addr = *addr;
+    eps[idx].forward = -1;
+    eps[idx].sock = sock;
+    eps[idx].proxy = proxy;
+    if (!proxy) {
+        uint32_t i = addr_hash(addr);
+        while (addr_slots[i]) {
+            i = (i + 1) & (EMU_ADDR_SLOTS - 1);
+        }
+        addr_slots[i] = idx + 1;
+    }
+    return idx;
+}
+
+static void unpair(endpoint_t *eps, int a) {
+    if (eps[a].forward >= 0) {
+        eps[eps[a].forward].forward = -1;
+        eps[a].forward = -1;
+    }
+}
+
+// Stand in for listener l towards sender a: a proxy socket on a port of
+// its own, waited on with the main one. Returns false if none is left.
+static bool pair_proxy(endpoint_t *eps, int *n, int a, int l, int epfd) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return false;
+    }
+    struct sockaddr_in any;
+    memset(&any, 0, sizeof(any));
+    any.sin_family = AF_INET;
+    any.sin_addr.s_addr = htonl(INADDR_ANY);
+    int p = bind(fd, (struct sockaddr *)&any, sizeof(any)) == 0
+                ? endpoint_add(eps, n, &eps[l].addr, fd, true)
+                : -1;
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = (uint64_t)p + 1};
+    if (p < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        if (p >= 0) {
+            (*n)--;
+        }
+        close(fd);
+        return false;
+    }
+    eps[p].peer_port = ntohs(eps[a].addr.sin_port);
+    eps[p].forward = a;
+    eps[a].forward = p;
+    return true;
+}
+
+// Pair a with the endpoint that names a's port while a names its port, as
+// emulator.py does, or else with a listener on the port a names. A new
+// listener takes every sender still waiting for it.
+static void pair_endpoint(endpoint_t *eps, int *n, int a, int epfd) {
+    int port = ntohs(eps[a].addr.sin_port);
+    int f = eps[a].forward;
+    if (f >= 0 && eps[f].proxy && ntohs(eps[f].addr.sin_port) == eps[a].peer_port) {
+        return;
+    }
+    unpair(eps, a);
+    if (eps[a].peer_port == 0) {
+        for (int b = 0; b < *n; b++) {
+            if (!eps[b].proxy && eps[b].forward < 0 && eps[b].peer_port == port && b != a) {
+                pair_proxy(eps, n, b, a, epfd);
+            }
+        }
+        return;
+    }
+    int listener = -1;
+    for (int b = 0; b < *n; b++) {
+        if (b == a || eps[b].proxy || ntohs(eps[b].addr.sin_port) != eps[a].peer_port) {
+            continue;
+        }
+        if (eps[b].peer_port == port) {
+            unpair(eps, b);
+            eps[a].forward = b;
+            eps[b].forward = a;
+            return;
+        }
+        if (eps[b].peer_port == 0) {
+            listener = b;
+        }
+    }
+    if (listener >= 0) {
+        pair_proxy(eps, n, a, listener, epfd);
+    }
+}
+
+// "HELLO <peer_port>" registers the sender. Returns false for other packets.
+static bool handle_hello(endpoint_t *eps, int *n, const struct sockaddr_in *src,
+                         const uint8_t *data, size_t len, int sock, int epfd) {
+    if (len < 6 || memcmp(data, "HELLO ", 6) != 0) {
+        return false;
+    }
+    char text[16];
+    size_t tlen = len - 6 < sizeof(text) - 1 ? len - 6 : sizeof(text) - 1;
+    memcpy(text, data + 6, tlen);
+    text[tlen] = '\0';
+    char *end = NULL;
+    long port = strtol(text, &end, 10);
+    while (end && (*end == ' ' || *end == '\n' || *end == '\r' || *end == '\t')) {
+        end++;
+    }
+    if (end == text || !end || *end != '\0' || port < 0 || port > 65535) {
+        return true;
+    }
+
+    int idx = endpoint_find(eps, src);
+    if (idx < 0 && (idx = endpoint_add(eps, n, src, sock, false)) < 0) {
+        return true;
+    }
+    eps[idx].peer_port = (int)port;
+    pair_endpoint(eps, n, idx, epfd);
+    return true;
+}
+
+// DATA and PARITY travel the forward path of a transfer; everything else
+// (ACKs, handshake, FIN) the reverse or control path.
+static bool is_forward(const uint8_t *data, size_t len, pkt_hdr_t *hdr) {
+    if (len < PKT_HDR_LEN) {
+        return false;
+    }
+    memcpy(hdr, data, PKT_HDR_LEN);
+    return ntohs(hdr->magic) == MAGIC_CONST &&
+           (hdr->type == PKT_TYPE_DATA || hdr->type == PKT_TYPE_PARITY);
+}
+
+// Queue a len-byte packet arriving at now on the bottleneck. Returns false
+// if the queue discipline drops it, else sets *depart to when it has left
+// and *wait to how long it queued before reaching the link.
+static bool bottleneck_admit(bottleneck_t *bn, const emu_cfg_t *cfg, uint64_t now, size_t len,
+                             uint64_t *depart, uint64_t *wait) {
+    while (bn->count > 0 && bn->fifo[bn->head].depart_ns <= now) {
+        bn->backlog -= bn->fifo[bn->head].len;
+        bn->head = (bn->head + 1) % bn->cap;
+        bn->count--;
+    }
+    if (lm_aqm_enqueue_drop(&bn->aqm, bn->backlog, len, &rng)) {
+        return false;
+    }
+
+    // FIFO service: the packet reaches the link when the one before it
+    // has left. A packet CoDel drops there never uses the link.
+    uint64_t start = bn->last_depart_ns > now ? bn->last_depart_ns : now;
+    lm_trace_pos_t saved = bn->trace_pos;
+    uint64_t done = cfg->use_trace
+                        ? lm_trace_send(&cfg->trace, &bn->trace_pos, cfg->origin_ns, start, len)
+                        : start + (uint64_t)((double)len * 8.0 * 1e6 / cfg->rate_kbps);
+    if (lm_aqm_dequeue_drop(&bn->aqm, start - now, start, bn->backlog)) {
+        bn->trace_pos = saved;
+        return false;
+    }
+
+    if (bn->count == bn->cap) {
+        size_t cap = bn->cap ? 2 * bn->cap : 1024;
+        bn_entry_t *fifo = malloc(cap * sizeof(*fifo));
+        if (!fifo) {
+            return false;
+        }
+        for (size_t i = 0; i < bn->count; i++) {
+            fifo[i] = bn->fifo[(bn->head + i) % bn->cap];
+        }
+        free(bn->fifo);
+        bn->fifo = fifo;
+        bn->cap = cap;
+        bn->head = 0;
+    }
+    bn->fifo[(bn->head + bn->count) % bn->cap] = (bn_entry_t){done, (uint32_t)len};
+    bn->count++;
+    bn->backlog += len;
+    bn->last_depart_ns = done;
+    *depart = done;
+    *wait = start - now;
+    return true;
+}
+
+// Decide the fate of one packet from src. Without the link model options
+// these are the rules of emulator.py.
+static void schedule(wheel_t *w, const emu_cfg_t *cfg, bottleneck_t *bn, endpoint_t *eps,
+                     int src, const uint8_t *data, size_t len, uint64_t now) {
+    endpoint_t *e = &eps[src];
+    pkt_hdr_t hdr;
+    bool forward = is_forward(data, len, &hdr);
+    bool data_pkt = forward && hdr.type == PKT_TYPE_DATA;
+    // --loss is the good-state loss rate under Gilbert-Elliott.
+    bool drop = cfg->gilbert ? lm_gilbert_drop(&cfg->ge, &e->ge_bad, &rng)
+                             : lm_rng_uniform(&rng) < cfg->loss;
+    if (drop) {
+        if (data_pkt) {
+            e->flow.loss_drops++;
+        }
+        return;
+    }
+    double base_ms = cfg->use_delay_trace
+                         ? lm_delay_at(&cfg->delay_trace, (now - cfg->origin_ns) / 1000000ULL)
+                         : cfg->delay_ms;
+    double delay_ms = base_ms;
+    if (lm_rng_uniform(&rng) < cfg->reorder) {
+        delay_ms += 2 * base_ms;
+    }
+    if (cfg->jitter.kind != LM_JITTER_NONE) {
+        delay_ms += lm_jitter_sample(&cfg->jitter, &rng);
+    }
+    if (delay_ms < 0) {
+        delay_ms = 0;
+    }
+
+    // A link model only decides when the packet leaves; the propagation
+    // delay, reorder bonus included, is added after that, as emulator.py
+    // does on its rate path. So --reorder still reorders on a rate,
+    // trace or bottleneck link.
+    uint64_t deliver = now + (uint64_t)(delay_ms * 1e6);
+    uint64_t wait = 0;
+    if (bn->on && forward) {
+        uint64_t depart;
+        if (!bottleneck_admit(bn, cfg, now, len, &depart, &wait)) {
+            if (data_pkt) {
+                e->flow.queue_drops++;
+            }
+            return;
+        }
+        deliver = depart + (uint64_t)(delay_ms * 1e6);
+    } else if (cfg->use_trace) {
+        uint64_t depart = lm_trace_send(&cfg->trace, &e->trace_pos, cfg->origin_ns, now, len);
+        wait = depart - now;
+        deliver = depart + (uint64_t)(delay_ms * 1e6);
+    } else if (cfg->rate_kbps > 0) {
+        // Rate limiting serialises the packets of each direction.
+        uint64_t start = e->next_free_ns > now ? e->next_free_ns : now;
+        wait = start - now;
+        uint64_t finish = start + (uint64_t)((double)len * 8.0 * 1e6 / cfg->rate_kbps);
+        e->next_free_ns = finish;
+        deliver = finish + (uint64_t)(delay_ms * 1e6);
+    }
+
+    emu_pkt_t *p = malloc(sizeof(*p) + len);
+    if (!p) {
+        return;
+    }
+    p->deliver_ns = deliver;
+    p->dst = eps[src].forward;
+    p->src = src;
+    p->data_pkt = data_pkt;
+    p->seq = data_pkt ? ntohl(hdr.seq) : 0;
+    p->len = (uint32_t)len;
+    memcpy(p->data, data, len);
+    // Threshold marking as in DCTCP: a DATA or PARITY packet that queued
+    // longer than --ecn_ms carries CE to the receiver, which echoes it.
+    if (cfg->ecn_ns && forward && wait > cfg->ecn_ns &&
+        pkt_mark(p->data, len, PKT_FLAG_CE) == 0 && data_pkt) {
+        e->flow.ce_marks++;
+    }
+    wheel_insert(w, p);
+}
+
+// Per-flow goodput over each flow's own active time, and how evenly the
+// flows shared the path.
+static void print_report(const endpoint_t *eps, int n, const bottleneck_t *bn) {
+    double rates[EMU_MAX_ENDPOINTS];
+    size_t nflows = 0;
+    uint64_t queue_drops = 0;
+    for (int i = 0; i < n; i++) {
+        const flow_stats_t *f = &eps[i].flow;
+        if (f->first_ns == 0) {
+            continue;
+        }
+        double ms = (double)(f->last_ns - f->first_ns) / 1e6;
+        double kbps = ms > 0 ? (double)f->goodput_bytes * 8.0 / ms : 0.0;
+        rates[nflows++] = kbps;
+        queue_drops += f->queue_drops;
+
+        char src[INET_ADDRSTRLEN];
+        char dst[INET_ADDRSTRLEN] = "?";
+        inet_ntop(AF_INET, &eps[i].addr.sin_addr, src, sizeof(src));
+        int peer = eps[i].forward;
+        if (peer >= 0) {
+            inet_ntop(AF_INET, &eps[peer].addr.sin_addr, dst, sizeof(dst));
+        }
+        printf("FLOW %s:%u -> %s:%d GOODPUT_KBPS=%.2f GOODPUT_BYTES=%llu DELIVERED_BYTES=%llu "
+               "LOSS_DROPS=%llu QUEUE_DROPS=%llu CE_MARKS=%llu\n",
+               src, (unsigned)ntohs(eps[i].addr.sin_port), dst, eps[i].peer_port, kbps,
+               (unsigned long long)f->goodput_bytes, (unsigned long long)f->delivered_bytes,
+               (unsigned long long)f->loss_drops, (unsigned long long)f->queue_drops,
+               (unsigned long long)f->ce_marks);
+    }
+    printf("FLOWS=%zu\n", nflows);
+    if (nflows > 0) {
+        printf("JAIN_INDEX=%.4f\n", lm_jain_index(rates, nflows));
+    }
+    if (bn->on) {
+        printf("QUEUE_DROPS=%llu\n", (unsigned long long)queue_drops);
+        printf("QUEUE_BYTES=%zu\n", bn->backlog);
+    }
+    fflush(stdout);
+}
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--port PORT] [--loss P] [--delay_ms MS] [--reorder P] [--rate_kbps KBPS] [--seed N]\n"
+            "          [--trace FILE] [--delay_trace FILE] [--ge_p P --ge_r R [--ge_loss_bad P]]\n"
+            "          [--jitter normal|pareto --jitter_ms MS [--jitter_alpha A]]\n"
+            "          [--bottleneck [--aqm droptail|red|codel] [--queue_bytes N]\n"
+            "           [--codel_target_ms MS] [--codel_interval_ms MS]] [--ecn_ms MS] [--report_ms MS]\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    int port = 11000;
+    long seed = 1;
+    emu_cfg_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.ge.loss_bad = 1.0;
+    cfg.jitter.alpha = 1.5;
+    const char *trace_path = NULL;
+    const char *delay_trace_path = NULL;
+    static bottleneck_t bn;
+    lm_aqm_kind_t aqm = LM_AQM_DROPTAIL;
+    long queue_bytes = 150000;
+    double codel_target_ms = 5.0;
+    double codel_interval_ms = 100.0;
+    int report_ms = 0;
+    double ecn_ms = 0.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+            cfg.loss = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--delay_ms") == 0 && i + 1 < argc) {
+            cfg.delay_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--reorder") == 0 && i + 1 < argc) {
+            cfg.reorder = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--rate_kbps") == 0 && i + 1 < argc) {
+            cfg.rate_kbps = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--delay_trace") == 0 && i + 1 < argc) {
+            delay_trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--ge_p") == 0 && i + 1 < argc) {
+            cfg.ge.p = atof(argv[++i]);
+            cfg.gilbert = true;
+        } else if (strcmp(argv[i], "--ge_r") == 0 && i + 1 < argc) {
+            cfg.ge.r = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--ge_loss_bad") == 0 && i + 1 < argc) {
+            cfg.ge.loss_bad = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) {
+            if (lm_jitter_parse(argv[++i], &cfg.jitter.kind) != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--jitter_ms") == 0 && i + 1 < argc) {
+            cfg.jitter.ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--jitter_alpha") == 0 && i + 1 < argc) {
+            cfg.jitter.alpha = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--bottleneck") == 0) {
+            bn.on = true;
+        } else if (strcmp(argv[i], "--aqm") == 0 && i + 1 < argc) {
+            if (lm_aqm_parse(argv[++i], &aqm) != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--queue_bytes") == 0 && i + 1 < argc) {
+            queue_bytes = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--codel_target_ms") == 0 && i + 1 < argc) {
+            codel_target_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--codel_interval_ms") == 0 && i + 1 < argc) {
+            codel_interval_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--ecn_ms") == 0 && i + 1 < argc) {
+            ecn_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--report_ms") == 0 && i + 1 < argc) {
+            report_ms = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (port <= 0 || port > 65535 || cfg.delay_ms < 0 || cfg.jitter.ms < 0 ||
+        cfg.jitter.alpha <= 1.0 || (cfg.gilbert && (cfg.ge.p <= 0 || cfg.ge.r <= 0)) ||
+        queue_bytes <= 0 || codel_target_ms <= 0 || codel_interval_ms <= 0 || report_ms < 0 ||
+        ecn_ms < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (bn.on && cfg.rate_kbps <= 0 && !trace_path) {
+        fprintf(stderr, "--bottleneck needs --rate_kbps or --trace\n");
+        return 1;
+    }
+    lm_aqm_init(&bn.aqm, aqm, (size_t)queue_bytes);
+    bn.aqm.codel_target_ns = (uint64_t)(codel_target_ms * 1e6);
+    bn.aqm.codel_interval_ns = (uint64_t)(codel_interval_ms * 1e6);
+    cfg.ge.loss_good = cfg.loss;
+    cfg.ecn_ns = (uint64_t)(ecn_ms * 1e6);
+    if (trace_path) {
+        if (lm_trace_load(&cfg.trace, trace_path) != 0) {
+            return 1;
+        }
+        cfg.use_trace = true;
+    }
+    if (delay_trace_path) {
+        if (lm_delay_trace_load(&cfg.delay_trace, delay_trace_path) != 0) {
+            return 1;
+        }
+        cfg.use_delay_trace = true;
+    }
+    lm_rng_seed(&rng, (uint64_t)seed);
+    cfg.origin_ns = now_ns();
+    // Every sender paired with a listener holds a proxy socket.
+    struct rlimit nofile;
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur < nofile.rlim_max) {
+        nofile.rlim_cur = nofile.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &nofile);
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    // Bursts of a whole window arrive at once; do not drop them here.
+    int bufsz = 8 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufsz, sizeof(bufsz));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufsz, sizeof(bufsz));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("bind");
+        close(sock);
+        return 1;
+    }
+    // The main socket and the proxies; an event's data is 0 for the main
+    // socket and p + 1 for proxy endpoint p.
+    int epfd = epoll_create1(0);
+    struct epoll_event main_ev = {.events = EPOLLIN, .data.u64 = 0};
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &main_ev) != 0) {
+        perror("epoll");
+        close(sock);
+        return 1;
+    }
+
+    static wheel_t wheel;
+    static endpoint_t eps[EMU_MAX_ENDPOINTS];
+    int neps = 0;
+    wheel.cursor = now_ns() >> WHEEL_TICK_SHIFT;
+
+    static uint8_t bufs[EMU_BATCH][EMU_MAX_DGRAM];
+    static struct sockaddr_in srcs[EMU_BATCH];
+    static struct iovec iov[EMU_BATCH];
+    static struct mmsghdr msgs[EMU_BATCH];
+    static send_batch_t out;
+    out.sock = sock;
+
+    // The report is printed on SIGINT/SIGTERM and every --report_ms.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    // Only ppoll may take the signals, so none slips in before it sleeps.
+    sigset_t stop_set;
+    sigset_t wait_mask;
+    sigemptyset(&stop_set);
+    sigaddset(&stop_set, SIGINT);
+    sigaddset(&stop_set, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_set, &wait_mask);
+    uint64_t next_report = report_ms ? now_ns() + (uint64_t)report_ms * 1000000ULL : 0;
+
+    while (!stop_requested) {
+        struct timespec ts;
+        struct timespec *tsp = NULL;
+        uint64_t deadline = wheel.queued > 0 ? wheel_deadline(&wheel) : UINT64_MAX;
+        if (next_report && next_report < deadline) {
+            deadline = next_report;
+        }
+        if (deadline != UINT64_MAX) {
+            uint64_t now = now_ns();
+            uint64_t wait = deadline > now ? deadline - now : 0;
+            ts.tv_sec = (time_t)(wait / 1000000000ULL);
+            ts.tv_nsec = (long)(wait % 1000000000ULL);
+            tsp = &ts;
+        }
+        struct pollfd pfd = {epfd, POLLIN, 0};
+        int ready = ppoll(&pfd, 1, tsp, &wait_mask);
+        if (ready < 0 && errno != EINTR) {
+            perror("ppoll");
+            break;
+        }
+        if (wheel.queued == 0) {
+            // Idle: restart the wheel at the present.
+            wheel.cursor = now_ns() >> WHEEL_TICK_SHIFT;
+        }
+
+        struct epoll_event evs[EMU_BATCH];
+        int nev = ready > 0 ? epoll_wait(epfd, evs, EMU_BATCH, 0) : 0;
+        for (int e = 0; e < nev; e++) {
+            // A proxy only takes what its listener sends.
+            int proxy = (int)evs[e].data.u64 - 1;
+            int fd = proxy < 0 ? sock : eps[proxy].sock;
+            for (int round = 0; round < EMU_RECV_ROUNDS; round++) {
+                for (int i = 0; i < EMU_BATCH; i++) {
+                    iov[i].iov_base = bufs[i];
+                    iov[i].iov_len = EMU_MAX_DGRAM;
+                    memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+                    msgs[i].msg_hdr.msg_name = &srcs[i];
+                    msgs[i].msg_hdr.msg_namelen = sizeof(srcs[i]);
+                    msgs[i].msg_hdr.msg_iov = &iov[i];
+                    msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                int n = recvmmsg(fd, msgs, EMU_BATCH, MSG_DONTWAIT, NULL);
+                if (n <= 0) {
+                    break;
+                }
+                uint64_t now = now_ns();
+                for (int i = 0; i < n; i++) {
+                    size_t len = msgs[i].msg_len;
+                    int src;
+                    if (proxy >= 0) {
+                        src = same_addr(&srcs[i], &eps[proxy].addr) ? proxy : -1;
+                    } else if (handle_hello(eps, &neps, &srcs[i], bufs[i], len, sock, epfd)) {
+                        continue;
+                    } else {
+                        src = endpoint_find(eps, &srcs[i]);
+                    }
+                    if (src >= 0 && eps[src].forward >= 0) {
+                        schedule(&wheel, &cfg, &bn, eps, src, bufs[i], len, now);
+                    }
+                }
+                if (n < EMU_BATCH) {
+                    break;
+                }
+            }
+        }
+
+        wheel_release(&wheel, now_ns(), &out, eps);
+        batch_flush(&out);
+        if (next_report && now_ns() >= next_report) {
+            print_report(eps, neps, &bn);
+            next_report += (uint64_t)report_ms * 1000000ULL;
+        }
+    }
+    print_report(eps, neps, &bn);
+    for (int i = 0; i < neps; i++) {
+        if (eps[i].proxy) {
+            close(eps[i].sock);
+        }
+    }
+    close(epfd);
+    close(sock);
+    return stop_requested ? 0 : 1;
+}
@@ -77,7 +77,7 @@ def main():
 
         rlist, _, _ = select.select([sock], [], [], timeout)
         for sock in rlist:
-            data, src = sock.recvfrom(2048)
+            data, src = sock.recvfrom(65535)
             if data.startswith(b"HELLO "):
                 text = data[6:].strip().decode("ascii", errors="ignore")
                 try:
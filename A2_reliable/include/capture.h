@@ -0,0 +1,41 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// pcap capture of every datagram netif sends or receives over UDP. With
+// RDT_PCAP=<prefix> in the environment, the first socket a process binds
+// opens <prefix>.<port>.pcap, and all of the process's sockets go into it.
+// Records are LINKTYPE_LINUX_SLL, as `tcpdump -i any` writes them: the
+// cooked header gives the direction, then come IPv4 and UDP headers
+// rebuilt from the socket addresses and the datagram as it crossed the
+// socket. Timestamps are wall-clock microseconds. The records go through
+// a writer thread (writer.h); when the disk falls behind they are dropped
+// and counted, never waited for. scripts/rdt.lua dissects pkt_hdr_t in
+// Wireshark. A custom transport (netif_set_ops) is not captured.
+
+#define CAPTURE_SNAPLEN 262144
+#define CAPTURE_LINKTYPE_SLL 113
+
+enum {
+    CAPTURE_IN = 0,     // SLL packet type "to us"
+    CAPTURE_OUT = 4,    // SLL packet type "outgoing"
+};
+
+// Nonzero once a capture is open.
+extern int capture_on;
+
+// Start capturing to path (created or truncated). Returns 0, or -1 if it
+// cannot be opened or a capture is already running. The file is closed
+// at exit.
+int capture_open(const char *path);
+// One datagram of iovcnt pieces between local and remote.
+void capture_dgram(int dir, const struct sockaddr_in *local, const struct sockaddr_in *remote,
+                   const struct iovec *iov, int iovcnt);
+// Write out what is queued and close the file; prints the number of
+// dropped records, if any, to stderr.
+void capture_close(void);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+// Receiver checkpoint for resumable transfers (--resume). <out>.ckpt
+// records how many whole packets of the output file are written, so a
+// restarted transfer can start right after them (PKT_FEAT_RESUME in the
+// SYN exchange). Receivers write payloads in seq order, so the count of
+// in-order packets is all there is to record. The file is replaced by a
+// rename, so a crash leaves either the old or the new checkpoint.
+
+#define CHECKPOINT_SUFFIX ".ckpt"
+// How often a receiver rewrites its checkpoint while data arrives.
+#define CHECKPOINT_INTERVAL_MS 500
+
+typedef struct {
+    uint16_t payload;         // bytes per packet (the agreed payload)
+    uint32_t start_seq;       // seq of the file's first byte
+    uint32_t done;            // packets from start_seq on that are in the file
+} checkpoint_t;
+
+// Read the checkpoint of out_path. done is capped to the whole packets the
+// output file really holds. Returns 0, or -1 if there is no usable one.
+int checkpoint_load(const char *out_path, checkpoint_t *c);
+// Replace the checkpoint of out_path. Returns 0, or -1 on error.
+int checkpoint_save(const char *out_path, const checkpoint_t *c);
+// Remove it once the transfer is complete.
+void checkpoint_remove(const char *out_path);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+// Monotonic time for the transfer binaries and the session code. It is
+// CLOCK_MONOTONIC unless a different clock is installed; the simulator
+// (sim.c) installs its virtual clock so timers follow simulated time.
+typedef struct {
+    uint64_t (*now_ns)(void *ctx);
+    void *ctx;
+} clock_ops_t;
+
+// Install ops (copied), or restore the system clock with NULL.
+void clock_set_ops(const clock_ops_t *ops);
+uint64_t clock_now_ns(void);
+uint64_t clock_now_ms(void);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+// CPU placement and cost of the transfer binaries (--cpu, CPU_MS).
+
+// Pin the calling thread to CPU cpu. Threads started later inherit the
+// pin, so endpoints start their reader or writer thread first. Returns 0,
+// or -1 if the CPU does not exist or is not allowed.
+int cpu_pin(int cpu);
+// CPU time the process has used so far, user plus system, in ms.
+uint64_t cpu_time_ms(void);
+
+#endif
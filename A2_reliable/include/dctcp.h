@@ -0,0 +1,29 @@
+#ifndef DCTCP_H
+#define DCTCP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// DCTCP-style reaction to PKT_FLAG_CE echoes. The sender keeps a
+// congestion window of at most --win packets. Once per window of ACKs,
+// the marked fraction updates alpha, and a window that saw marks shrinks
+// cwnd by alpha/2. Unmarked ACKs grow it by one packet per window. Without
+// marks cwnd stays at --win, so senders behave exactly as before.
+typedef struct {
+    double cwnd;
+    int max;
+    double alpha;
+    uint32_t acked;           // ACKs in the current observation window
+    uint32_t marked;          // ... of which echoed CE
+    uint32_t span;            // ACKs that close the observation window
+    uint64_t marks;           // total CE echoes seen
+    double min_cwnd;          // smallest cwnd reached
+} dctcp_t;
+
+void dctcp_init(dctcp_t *cc, int max);
+// One ACK covering acked new packets (at least 1), with or without CE.
+void dctcp_on_ack(dctcp_t *cc, uint32_t acked, bool ce);
+// Packets that may be in flight now, 1..max.
+int dctcp_window(const dctcp_t *cc);
+
+#endif
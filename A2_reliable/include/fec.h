@@ -0,0 +1,87 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "protocol.h"
+
+// XOR forward error correction for SR (see pkt_fec_t in protocol.h).
+#define FEC_MAX_N 64
+#define FEC_MAX_K 16
+// Parity packets the receiver keeps while their group misses 2+ members.
+#define FEC_PENDING 64
+
+// dst ^= src, a machine word at a time.
+void fec_xor(uint8_t *dst, const uint8_t *src, size_t len);
+
+// Sender side: XORs each new DATA payload into the parity of its group.
+// The number of groups per block follows the observed loss rate.
+typedef struct {
+    size_t chunk;
+    int n;                    // block length (--fec)
+    int k;                    // parity packets in the current block
+    int count;                // members added so far
+    uint32_t base;
+    double loss;              // EWMA of per-packet loss
+    uint8_t *parity;          // FEC_MAX_K buffers laid out as PARITY packets
+    uint16_t max_len[FEC_MAX_K];
+    uint16_t len_xor[FEC_MAX_K];
+    uint8_t flags_xor[FEC_MAX_K];
+} fec_enc_t;
+
+int fec_enc_init(fec_enc_t *e, int n, size_t chunk);
+void fec_enc_free(fec_enc_t *e);
+// One packet outcome: lost (timed out or rebuilt by the receiver) or not.
+void fec_enc_sample(fec_enc_t *e, bool lost);
+// Add DATA packet seq. Returns true once the block is complete.
+bool fec_enc_add(fec_enc_t *e, uint32_t seq, const uint8_t *payload, uint16_t len,
+                 uint8_t flags);
+// Parity packets of the current (possibly partial) block.
+int fec_enc_parity_count(const fec_enc_t *e);
+// Build parity packet idx in place; the buffer stays valid until
+// fec_enc_next(). Returns the packet length, 0 if the group is empty.
+size_t fec_enc_build(fec_enc_t *e, int idx, const uint8_t **pkt);
+// Start the next block.
+void fec_enc_next(fec_enc_t *e);
+
+// Receiver side: recent payloads by seq, plus parity still waiting for
+// all but one member of its group.
+typedef struct {
+    uint32_t seq;
+    uint16_t len;
+    uint8_t flags;
+    bool valid;
+    uint8_t *data;
+} fec_slot_t;
+
+typedef struct {
+    pkt_fec_t fec;
+    uint16_t len;
+    bool used;
+    uint8_t *data;
+} fec_parity_t;
+
+typedef struct {
+    size_t chunk;
+    uint32_t cap;
+    fec_slot_t *slots;
+    uint8_t *pool;
+    fec_parity_t pending[FEC_PENDING];
+    uint8_t *parity_pool;
+    int next_victim;
+    uint64_t recovered;
+} fec_dec_t;
+
+// cap must exceed the receive window plus FEC_MAX_N.
+int fec_dec_init(fec_dec_t *d, uint32_t cap, size_t chunk);
+void fec_dec_free(fec_dec_t *d);
+void fec_dec_store(fec_dec_t *d, uint32_t seq, const uint8_t *payload, uint16_t len,
+                   uint8_t flags);
+void fec_dec_parity(fec_dec_t *d, const pkt_fec_t *fec, const uint8_t *parity, uint16_t len);
+// Rebuild one missing DATA payload into out (chunk bytes) if any pending
+// parity allows it. Returns true with seq/len/flags filled in.
+bool fec_dec_recover(fec_dec_t *d, uint32_t *seq, uint8_t *out, uint16_t *len, uint8_t *flags);
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef LINKMODEL_H
+#define LINKMODEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Link models for the C emulator: a seeded PRNG, Gilbert-Elliott loss,
+// delay jitter, and bandwidth/delay traces.
+
+// xoshiro256**: the same seed always gives the same draws.
+typedef struct {
+    uint64_t s[4];
+} lm_rng_t;
+
+void lm_rng_seed(lm_rng_t *rng, uint64_t seed);
+uint64_t lm_rng_next(lm_rng_t *rng);
+// Uniform in [0, 1).
+double lm_rng_uniform(lm_rng_t *rng);
+// Standard normal.
+double lm_rng_normal(lm_rng_t *rng);
+
+// Two-state bursty loss. Each packet first moves the chain (good -> bad
+// with probability p, bad -> good with probability r), then is dropped
+// with the loss probability of the state it is in. The state lives with
+// the caller, one per direction.
+typedef struct {
+    double p;
+    double r;
+    double loss_good;
+    double loss_bad;
+} lm_gilbert_t;
+
+bool lm_gilbert_drop(const lm_gilbert_t *g, bool *bad, lm_rng_t *rng);
+
+typedef enum {
+    LM_JITTER_NONE,
+    LM_JITTER_NORMAL,   // N(0, ms^2)
+    LM_JITTER_PARETO,   // heavy tail with mean ms
+} lm_jitter_kind_t;
+
+typedef struct {
+    lm_jitter_kind_t kind;
+    double ms;
+    double alpha;       // Pareto shape, > 1
+} lm_jitter_t;
+
+// Parse "normal" or "pareto". Returns -1 for anything else.
+int lm_jitter_parse(const char *name, lm_jitter_kind_t *kind);
+// Extra delay in ms; negative draws are possible with the normal shape.
+double lm_jitter_sample(const lm_jitter_t *j, lm_rng_t *rng);
+
+// Mahimahi bandwidth trace: one line per delivery opportunity of
+// LM_TRACE_MTU bytes, giving its time in ms. The trace repeats with the
+// last timestamp as its period.
+#define LM_TRACE_MTU 1500
+
+typedef struct {
+    uint32_t *ts_ms;
+    size_t n;
+    uint64_t period_ms;
+} lm_trace_t;
+
+// Where one direction stands in the trace: the next opportunity, counted
+// from the start, and the bytes a packet already took from it.
+typedef struct {
+    uint64_t opp;
+    uint32_t used;
+} lm_trace_pos_t;
+
+int lm_trace_load(lm_trace_t *t, const char *path);
+void lm_trace_free(lm_trace_t *t);
+// Serialise len bytes arriving at now_ns over the opportunities after
+// pos; origin_ns is trace time 0. Returns when the last byte leaves.
+uint64_t lm_trace_send(const lm_trace_t *t, lm_trace_pos_t *pos, uint64_t origin_ns,
+                       uint64_t now_ns, size_t len);
+
+// Delay trace: "<ms> <delay_ms>" lines; each delay holds until the next
+// line's time. The trace repeats with the last timestamp as its period.
+typedef struct {
+    uint32_t *ts_ms;
+    double *delay_ms;
+    size_t n;
+    uint64_t period_ms;
+} lm_delay_trace_t;
+
+int lm_delay_trace_load(lm_delay_trace_t *t, const char *path);
+void lm_delay_trace_free(lm_delay_trace_t *t);
+double lm_delay_at(const lm_delay_trace_t *t, uint64_t elapsed_ms);
+
+// Queue discipline of a shared bottleneck. Every discipline tail-drops
+// at limit_bytes; RED also drops early on the average backlog at
+// arrival, CoDel on the time a packet waited when it reaches the link.
+typedef enum {
+    LM_AQM_DROPTAIL,
+    LM_AQM_RED,
+    LM_AQM_CODEL,
+} lm_aqm_kind_t;
+
+typedef struct {
+    lm_aqm_kind_t kind;
+    size_t limit_bytes;
+
+    // RED (Floyd/Jacobson), thresholds in bytes.
+    double red_min;
+    double red_max;
+    double red_max_p;
+    double red_w;
+    double red_avg;
+    int red_count;
+
+    // CoDel (RFC 8289).
+    uint64_t codel_target_ns;
+    uint64_t codel_interval_ns;
+    bool codel_dropping;
+    uint64_t codel_first_above;
+    uint64_t codel_drop_next;
+    uint32_t codel_count;
+    uint32_t codel_lastcount;
+} lm_aqm_t;
+
+// Parse "droptail", "red" or "codel". Returns -1 for anything else.
+int lm_aqm_parse(const char *name, lm_aqm_kind_t *kind);
+// RED thresholds default to 1/6 and 1/2 of the limit; CoDel to 5 ms
+// target and 100 ms interval.
+void lm_aqm_init(lm_aqm_t *q, lm_aqm_kind_t kind, size_t limit_bytes);
+// A len-byte packet arrives with backlog bytes queued. True: drop it.
+bool lm_aqm_enqueue_drop(lm_aqm_t *q, size_t backlog, size_t len, lm_rng_t *rng);
+// The packet reaches the link at now_ns after waiting sojourn_ns, with
+// backlog bytes still behind it. True: drop it instead of sending.
+bool lm_aqm_dequeue_drop(lm_aqm_t *q, uint64_t sojourn_ns, uint64_t now_ns, size_t backlog);
+
+// Jain's fairness index of n rates: 1 when all are equal, 1/n when one
+// flow takes everything.
+double lm_jain_index(const double *x, size_t n);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Per-packet payload compression (--compress, PKT_FLAG_LZ). The format is
+// the LZ4 block format: a token with literal and match lengths, the
+// literals, a 2-byte little-endian offset and length extension bytes; the
+// last sequence holds literals only. Every payload is compressed on its
+// own, so packets can still be lost, resent and rebuilt from parity in
+// any order.
+
+// Worst-case output for n input bytes.
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+// Compress n bytes of src into dst. Returns the compressed length, or 0
+// if it would not fit in cap.
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+// Decompress n bytes of src into dst. Returns the decompressed length, or
+// -1 if src is malformed or the output would exceed cap.
+ssize_t lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+
+// Sender-side probe: after a payload that did not shrink enough, the next
+// attempts are skipped for a span that doubles with every miss, so data
+// that does not compress costs a compression attempt only now and then.
+typedef struct {
+    uint32_t skip;            // payloads left to send uncompressed
+    uint32_t backoff;         // next skip span after a miss
+    uint64_t tried;
+    uint64_t packed;          // payloads sent compressed
+    uint64_t raw_bytes;       // payload bytes before and after the stage
+    uint64_t wire_bytes;
+} lz_probe_t;
+
+void lz_probe_init(lz_probe_t *p);
+// Compress the n payload bytes at buf in place if the probe allows it and
+// it saves at least 1/16 of them. tmp needs LZ_BOUND(n) bytes. Returns the
+// new length; *packed says whether buf now holds compressed data.
+size_t lz_probe_pack(lz_probe_t *p, uint8_t *buf, size_t n, uint8_t *tmp, bool *packed);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef MPATH_H
+#define MPATH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "netif.h"
+
+// Multipath transfers (--paths N, SR only). Path i is a socket on local
+// port listen + i, paired with the peer's port peer + i through emulator
+// i (netif_connect_path), so every path can have its own loss, delay and
+// rate. Both ends share one seq space: the receiver answers each packet
+// on the path it came in on, and its reassembly is the same as with one
+// path. The handshake and FIN use path 0.
+//
+// The sender keeps per-path estimates (smoothed RTT, loss rate, delivery
+// rate, packets in flight) and sends each packet on the path where it is
+// expected to arrive first: half an RTT plus the time to drain what is
+// already in flight there, plus the expected cost of a retransmission at
+// the path's loss rate. A path only takes new data up to twice its
+// measured bandwidth-delay product, so a slow path does not build a queue
+// that outlasts its RTO.
+
+#define MPATH_MAX 8
+
+typedef struct {
+    int sock;
+    netif_batch_t batch;
+    uint64_t srtt_ns;         // 0 until the first sample
+    uint64_t rttvar_ns;
+    uint64_t min_rtt_ns;
+    double loss;              // moving per-packet loss rate
+    double rate_pps;          // best recent delivery rate, 0 until measured
+    uint32_t inflight;        // sent on this path, not yet ACKed or lost
+    uint64_t acked;
+    uint64_t rate_acked;      // acked at the start of the rate interval
+    uint64_t rate_ns;         // start of the rate interval
+    uint64_t sent;
+    uint64_t lost;
+} mpath_path_t;
+
+typedef struct {
+    int n;
+    int min_rto_ms;           // --timeout: floor of every path's RTO
+    int last_recv;            // path mpath_recv served last
+    mpath_path_t path[MPATH_MAX];
+} mpath_t;
+
+// Set up n paths. Path 0 is sock, already bound and connected; the others
+// are opened here. Returns 0, or -1 (with the new sockets closed).
+int mpath_open(mpath_t *m, int n, int sock, int listen_port, const char *peer_ip, int peer_port,
+               int min_rto_ms);
+// Close the sockets mpath_open opened (not path 0).
+void mpath_close(mpath_t *m);
+
+// Sender: the path with the lowest expected delivery time for a new
+// packet, preferring paths that are not full; always 0 with one path.
+int mpath_pick(const mpath_t *m);
+// Whether p already holds twice its measured bandwidth-delay product, so
+// new data should wait. Retransmissions go out regardless.
+bool mpath_full(const mpath_t *m, int p);
+void mpath_on_send(mpath_t *m, int p);
+// First ACK of a packet last sent on p; rtt_ns is 0 if it was resent
+// (Karn's rule).
+void mpath_on_ack(mpath_t *m, int p, uint64_t rtt_ns, uint64_t now_ns);
+// A packet last sent on p timed out.
+void mpath_on_loss(mpath_t *m, int p);
+// Retransmission timeout on p: the RFC 6298 estimate, at least min_rto_ms.
+int mpath_rto_ms(const mpath_t *m, int p);
+// Flush every path's send batch. Returns 0, or -1 on a send error.
+int mpath_flush(mpath_t *m);
+// Receive from any path; *p is the path it came in on.
+ssize_t mpath_recv(mpath_t *m, void *buf, size_t maxlen, int timeout_ms, int *p);
+// PATH<i>_* lines in the KEY=VALUE style of the sender summary.
+void mpath_report(const mpath_t *m, FILE *out);
+
+#endif
@@ -2,16 +2,114 @@
 #define NETIF_H
 
 #include <stddef.h>
+#include <netinet/in.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+
+// Transport under the netif_* calls. By default they drive a UDP socket
+// through the emulator; the simulator (sim.c) installs its own. send
+// carries one datagram to the peer named in connect, and recv follows the
+// timeout rules of netif_recv. Sockets are real descriptors, so callers
+// still close() them. Offload is never enabled on a custom transport.
+typedef struct {
+    int (*socket)(void *ctx);
+    int (*bind)(void *ctx, int sock, int local_port);
+    int (*connect)(void *ctx, int sock, int peer_port);
+    ssize_t (*send)(void *ctx, int sock, const struct iovec *iov, int iovcnt);
+    ssize_t (*recv)(void *ctx, int sock, void *buf, size_t maxlen, int timeout_ms);
+    void *ctx;
+} netif_ops_t;
+
+// Install ops (copied), or go back to UDP with NULL.
+void netif_set_ops(const netif_ops_t *ops);
 
 int netif_socket(void);
 int netif_bind(int sock, int local_port);
 int netif_connect(int sock, const char *peer_ip, int peer_port);
+// Multipath: like netif_connect, but everything sent on sock goes through
+// the emulator of path path, entry path of RELIABLE_EMU_PORTS (comma-
+// separated) or else RELIABLE_EMU_PORT + path. Path 0 is the default
+// emulator; a custom transport only has path 0.
+int netif_connect_path(int sock, const char *peer_ip, int peer_port, int path);
+// Repeat the last HELLO on sock: the emulator drops what arrives from a
+// port it has not heard of, so a lost HELLO would lose everything after.
+// Does nothing on a custom transport or an unconnected socket.
+int netif_rehello(int sock);
 ssize_t netif_send(int sock, const void *buf, size_t len);
+// Gathered send of one datagram (e.g. header + payload from a file mapping).
+ssize_t netif_sendv(int sock, const struct iovec *iov, int iovcnt);
 ssize_t netif_recv(int sock, void *buf, size_t maxlen, int timeout_ms);
+// Receive from whichever of nsocks sockets has a datagram first; *which is
+// its index. On entry *which is the socket the caller was served from
+// last, and the scan starts after it, so a busy socket cannot starve the
+// others. Same timeout rules and return values as netif_recv.
+ssize_t netif_recv_any(const int *socks, int nsocks, void *buf, size_t maxlen, int timeout_ms,
+                       int *which);
 ssize_t netif_sendto(int sock, const char *ip, int port,
                      const void *buf, size_t len);
 ssize_t netif_recvfrom(int sock, void *buf, size_t maxlen,
                        int timeout_ms, char *src_ip, int *src_port);
 
+// UDP segmentation/receive offload (Linux). Both return 0 when the kernel
+// accepts the socket option and -1 when it does not; the socket then keeps
+// working without offload.
+int netif_enable_gso(int sock);
+int netif_enable_gro(int sock);
+
+// Low-latency receive (--busy_poll). netif_recv* on sock first spin on
+// non-blocking receives for up to usecs before they block, and the kernel
+// busy-polls the device queue (SO_BUSY_POLL) while they wait. The spin
+// budget halves while data keeps arriving well after it and grows back
+// when data arrives sooner; for netif_recv_any, the first socket's setting
+// covers all of them. Returns 0, or -1 if the kernel refused SO_BUSY_POLL
+// (the spin is still on). A custom transport never spins.
+int netif_enable_busy_poll(int sock, int usecs);
+
+// Servers (receiverd): one socket serves many senders and answers each at
+// the address its packets came from. UDP only; these return -1 on a
+// custom transport.
+//
+// Before netif_bind: let several sockets bind the same port
+// (SO_REUSEPORT). The kernel hashes each source address to one of them.
+int netif_enable_reuseport(int sock);
+// Register with the emulator as a listener ("HELLO 0"): every sender whose
+// HELLO names our port is forwarded to us from a proxy port of its own,
+// and what we send to that port goes back to that sender alone.
+int netif_listen(int sock);
+
+typedef struct {
+    struct sockaddr_in addr;   // where the datagram came from
+    void *buf;
+    size_t cap;
+    size_t len;                // bytes received
+} netif_dgram_t;
+
+// Receive up to n datagrams with one recvmmsg, waiting as netif_recv does
+// for the first one. Returns how many arrived, 0 on timeout, -1 on error.
+int netif_recv_batch(int sock, netif_dgram_t *d, int n, int timeout_ms);
+// Send one datagram to addr, e.g. the source of a netif_recv_batch entry.
+ssize_t netif_send_addr(int sock, const struct sockaddr_in *addr, const void *buf, size_t len);
+
+// Send npkts datagrams to the emulator, each described by iov_per_pkt
+// consecutive iovec entries. With GSO, runs of equal-sized datagrams leave
+// as one UDP_SEGMENT send; otherwise the batch goes out with sendmmsg.
+// Returns the number of datagrams sent, or -1 on error.
+int netif_send_batch(int sock, const struct iovec *iov, int iov_per_pkt, int npkts);
+
+// Collects header + payload pairs and flushes them with netif_send_batch.
+#define NETIF_BATCH_MAX 64
+
+typedef struct {
+    int sock;
+    int npkts;
+    struct iovec iov[2 * NETIF_BATCH_MAX];
+} netif_batch_t;
+
+void netif_batch_init(netif_batch_t *b, int sock);
+// Queue one datagram; flushes first when the batch is full. The buffers
+// must stay valid until the next flush.
+int netif_batch_add(netif_batch_t *b, const void *hdr, size_t hdr_len,
+                    const void *payload, size_t payload_len);
+int netif_batch_flush(netif_batch_t *b);
+
 #endif
@@ -5,15 +5,42 @@
 #include <stddef.h>
 
 #define MAGIC_CONST 0xCCAA
-#define MAX_PAYLOAD 1000
+// Payload size used unless the SYN/SYNACK exchange agrees on another one.
+#define DEFAULT_PAYLOAD 1000
+// Largest payload that fits a UDP/IPv4 datagram with our header.
+#define MAX_PAYLOAD 65489
 
 #define PKT_TYPE_DATA   0
 #define PKT_TYPE_ACK    1
 #define PKT_TYPE_FIN    2
 #define PKT_TYPE_FINACK 3
+#define PKT_TYPE_SYN    4
+#define PKT_TYPE_SYNACK 5
+#define PKT_TYPE_PARITY 6
 
 #define SR_MAX_WINDOW 512
 
+// DATA flags.
+#define PKT_FLAG_STREAM      0x01  // payload starts with a stream header
+#define PKT_FLAG_STREAM_OPEN 0x02  // stream payload is the stream name
+// ACK flags.
+#define PKT_FLAG_FEC         0x04  // the ACKed packet was rebuilt from parity
+// DATA/PARITY: a congested queue marked the packet (set by the emulator).
+// ACK: the ACKed packet carried the mark.
+#define PKT_FLAG_CE          0x08
+// ACK/FINACK: seq carries the receive window as its right edge, the
+// first seq the receiver has no room for yet. Without it the sender
+// assumes no limit.
+#define PKT_FLAG_RWND        0x10
+// FIN: the payload is the SHA-256 of the whole file (sha256.h).
+// FINACK: the receiver compared it with the digest of what it wrote;
+// PKT_FLAG_DIGEST_BAD means they differ.
+#define PKT_FLAG_DIGEST      0x20
+#define PKT_FLAG_DIGEST_BAD  0x40
+// DATA: the payload is LZ-compressed (lz.h); the receiver expands it
+// before anything else looks at it. Parity covers the wire bytes.
+#define PKT_FLAG_LZ          0x80
+
 #pragma pack(push, 1)
 typedef struct {
     uint16_t magic;
@@ -28,13 +55,110 @@ typedef struct {
 
 #define PKT_HDR_LEN ((size_t)sizeof(pkt_hdr_t))
 
+// Session parameters carried in SYN/SYNACK payloads (host order here,
+// network order on the wire). SYN proposes, SYNACK answers with the
+// agreed values. A 2-byte SYN (payload only) is still accepted; the other
+// fields then read as 0. A 10-byte one leaves resume_seq at start_seq, and
+// one without session reads it as 0.
+typedef struct {
+    uint16_t payload;
+    uint16_t window;          // 0: no preference
+    uint8_t ack_mode;         // PKT_ACK_*; 0 in a SYN accepts either
+    uint8_t features;         // PKT_FEAT_* bits
+    uint32_t start_seq;       // seq of the first DATA packet
+    uint32_t resume_seq;      // SYNACK: first seq the receiver still needs
+    // Sender's transfer id, echoed in the SYNACK. A receiver serving many
+    // senders (receiverd) tells a restarted transfer from a resent SYN by it.
+    uint32_t session;
+} pkt_syn_t;
+
+#define PKT_SYN_LEN 18
+#define PKT_SYN_LEN_V3 14
+#define PKT_SYN_LEN_V2 10
+#define PKT_SYN_LEN_V1 2
+
+#define PKT_ACK_CUMULATIVE 1  // ACK carries the next expected seq (GBN)
+#define PKT_ACK_SELECTIVE  2  // ACK carries the seq it acknowledges (SR)
+
+#define PKT_FEAT_STREAM   0x01  // stream mode (PKT_FLAG_STREAM payloads)
+#define PKT_FEAT_FEC      0x02  // PARITY packets
+// SYN: the sender can start past start_seq. SYNACK: seqs below resume_seq
+// are already in the receiver's output file.
+#define PKT_FEAT_RESUME   0x04
+#define PKT_FEAT_COMPRESS 0x08  // PKT_FLAG_LZ payloads
+// SYN: the first window of DATA follows the SYN without waiting.
+// SYNACK: that data was accepted; otherwise start_seq skips past it.
+#define PKT_FEAT_ZERO_RTT 0x80
+
+// Stream extension header at the front of PKT_FLAG_STREAM payloads. For
+// data, offset is the byte offset of the chunk within the stream; for
+// PKT_FLAG_STREAM_OPEN it is the total stream size.
+typedef struct {
+    uint32_t stream_id;
+    uint64_t offset;
+} pkt_stream_hdr_t;
+
+#define PKT_STREAM_HDR_LEN 12
+
+// FEC parity over one block of n consecutive DATA packets starting at
+// base. Member i of the block belongs to parity group i % k; a PARITY
+// packet is the XOR of its group's payloads (zero-padded to the longest),
+// so it rebuilds any one lost member. On the wire base is the header seq,
+// n/k/index/flags_xor are packed into the ack field and len_xor leads the
+// payload.
+typedef struct {
+    uint32_t base;
+    uint8_t n;
+    uint8_t k;
+    uint8_t index;
+    uint8_t flags_xor;
+    uint16_t len_xor;
+} pkt_fec_t;
+
+#define PKT_FEC_HDR_LEN 2
+
 uint32_t crc32_ieee(const uint8_t *data, size_t len);
+uint32_t crc32_ieee_update(uint32_t crc, const uint8_t *data, size_t len);
 
 size_t pkt_build_data(uint8_t *buf, size_t buf_cap, uint32_t seq,
                       const uint8_t *payload, uint16_t len);
+// Header-only DATA build: writes PKT_HDR_LEN bytes to hdr_buf, with the CRC
+// covering the payload that stays in place (e.g. an mmap'd file).
+size_t pkt_build_data_hdr(uint8_t *hdr_buf, size_t buf_cap, uint32_t seq,
+                          uint8_t flags, const uint8_t *payload, uint16_t len);
+size_t pkt_build_data_flags(uint8_t *buf, size_t buf_cap, uint32_t seq,
+                            uint8_t flags, const uint8_t *payload, uint16_t len);
 size_t pkt_build_ack(uint8_t *buf, size_t buf_cap, uint32_t ack);
+size_t pkt_build_ack_flags(uint8_t *buf, size_t buf_cap, uint32_t ack, uint8_t flags);
+// ACK/FINACK advertising the receive window edge (PKT_FLAG_RWND).
+size_t pkt_build_ack_wnd(uint8_t *buf, size_t buf_cap, uint32_t ack, uint8_t flags, uint32_t wnd_edge);
+size_t pkt_build_finack_wnd(uint8_t *buf, size_t buf_cap, uint32_t ack, uint8_t flags,
+                            uint32_t wnd_edge);
 size_t pkt_build_fin(uint8_t *buf, size_t buf_cap, uint32_t seq);
+// FIN carrying the file digest (PKT_FLAG_DIGEST); digest is SHA256_LEN bytes.
+size_t pkt_build_fin_digest(uint8_t *buf, size_t buf_cap, uint32_t seq, const uint8_t *digest);
 size_t pkt_build_finack(uint8_t *buf, size_t buf_cap, uint32_t ack);
+// OR flags into the header of a built packet of len bytes and fix its
+// CRC. Returns -1 if buf is not a packet.
+int pkt_mark(uint8_t *buf, size_t len, uint8_t flags);
+size_t pkt_build_syn(uint8_t *buf, size_t buf_cap, const pkt_syn_t *syn);
+size_t pkt_build_synack(uint8_t *buf, size_t buf_cap, const pkt_syn_t *syn);
+int pkt_parse_syn(const uint8_t *payload, uint16_t len, pkt_syn_t *syn);
+
+// parity may sit at buf + PKT_HDR_LEN + PKT_FEC_HDR_LEN already.
+size_t pkt_build_parity(uint8_t *buf, size_t buf_cap, const pkt_fec_t *fec,
+                        const uint8_t *parity, uint16_t len);
+int pkt_parse_parity(const pkt_hdr_t *hdr, const uint8_t *payload, uint16_t len,
+                     pkt_fec_t *fec, const uint8_t **parity, uint16_t *parity_len);
+
+void pkt_put_stream_hdr(uint8_t *dst, const pkt_stream_hdr_t *sh);
+int pkt_get_stream_hdr(const uint8_t *payload, uint16_t len, pkt_stream_hdr_t *sh);
+
+// Per-session payload limit enforced by pkt_parse (default MAX_PAYLOAD).
+// PARITY payloads may exceed it by PKT_FEC_HDR_LEN. The limit is kept
+// per thread.
+void pkt_set_payload_limit(uint16_t limit);
+uint16_t pkt_payload_limit(void);
 
 int pkt_parse(const uint8_t *buf, size_t len, pkt_hdr_t *hdr,
               const uint8_t **payload, uint16_t *payload_len);
@@ -0,0 +1,40 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Disk reader thread. Payload chunks are produced ahead of the send loop
+// into a single-producer/single-consumer ring, so a slow read never holds
+// up ACK processing or retransmission timers on the network thread.
+typedef struct reader reader_t;
+
+// Produces the next payload into dst (at most cap bytes) on the reader
+// thread. Returns the length, 0 at end of input, -1 on error. flags is
+// copied into the DATA header by the sender.
+typedef ssize_t (*reader_fill_fn)(void *ctx, uint8_t *dst, size_t cap, uint8_t *flags);
+
+// Start a reader that keeps up to depth chunks of chunk bytes ready.
+reader_t *reader_start(reader_fill_fn fill, void *ctx, size_t chunk, size_t depth);
+// Sequential reader over fd in full chunks from its current offset, with
+// kernel readahead hints.
+reader_t *reader_start_fd(int fd, size_t chunk, size_t depth);
+
+#define READER_AGAIN (-2)
+
+// Non-blocking: copy the next chunk into dst. Returns its length, 0 at end
+// of input, -1 on a read error, READER_AGAIN if the chunk is not read yet.
+ssize_t reader_next(reader_t *r, uint8_t *dst, size_t cap, uint8_t *flags);
+// Wait up to timeout_ms for reader_next to have something to return.
+// Returns 1 when it does, 0 on timeout.
+int reader_wait(reader_t *r, int timeout_ms);
+// Stop and join the thread, then free the ring.
+void reader_stop(reader_t *r);
+
+// Process-wide: when on, reader_next waits for the reader thread instead
+// of returning READER_AGAIN. The simulator turns it on so that a run never
+// depends on how fast the disk happened to be.
+void reader_set_blocking(int on);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+
+#include "protocol.h"
+
+// Sender side of the SYN/SYNACK exchange: propose session parameters and
+// wait for the receiver's answer, resending the SYN every rto_ms. On
+// success agreed holds the receiver's answer (payload and window never
+// exceed the offer; resume_seq is start_seq unless PKT_FEAT_RESUME was
+// granted) and the payload limit is set. Returns 0, or -1 if no
+// usable SYNACK arrived in time.
+int session_connect(int sock, const pkt_syn_t *offer, int rto_ms, pkt_syn_t *agreed);
+// Sender check of the answer: our ACK mode must match the receiver's and
+// every feature in required must be granted. Prints why not and returns -1.
+int session_check(const pkt_syn_t *offer, const pkt_syn_t *agreed, uint8_t required);
+// A fresh nonzero id for pkt_syn_t.session.
+uint32_t session_new_id(void);
+// Send one SYN without waiting, so 0-RTT DATA can follow it.
+int session_send_syn(int sock, const pkt_syn_t *offer);
+
+// Receiver side: answer a SYN. local gives our limits: the largest payload,
+// our window (0 accepts the sender's), our ACK mode and the features we
+// support. With PKT_FEAT_RESUME, local's start_seq and resume_seq describe
+// what the output file already holds; the answer resumes from there if
+// the SYN has the same start_seq and payload is agreed unchanged.
+// Returns 0 with agreed filled in, or -1 on a malformed SYN.
+int session_accept(int sock, const uint8_t *syn_payload, uint16_t syn_len,
+                   const pkt_syn_t *local, pkt_syn_t *agreed);
+// Answer a late SYN of an established session with its first SYNACK
+// again. local moves on during a session (checkpoint, window), so a new
+// answer could differ. Returns -1 if the SYN is malformed or belongs to
+// another session; it is not answered then.
+int session_reanswer(int sock, const uint8_t *syn_payload, uint16_t syn_len,
+                     const pkt_syn_t *agreed);
+// The answer session_accept would send to a parsed SYN, without sending
+// it or touching the payload limit (receiverd answers many senders from
+// one thread). Returns 0.
+int session_answer(const pkt_syn_t *syn, const pkt_syn_t *local, pkt_syn_t *agreed);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Incremental SHA-256 (FIPS 180-4) for the end-to-end file digest: the
+// sender hashes each chunk as it is read, the receiver each payload as it
+// goes to the writer, and the FIN exchange compares the two.
+
+#define SHA256_LEN 32
+
+typedef struct {
+    uint32_t h[8];
+    uint64_t bytes;
+    uint8_t block[64];
+    size_t fill;
+} sha256_t;
+
+void sha256_init(sha256_t *s);
+void sha256_update(sha256_t *s, const void *data, size_t len);
+// Write the digest of everything so far; s is left untouched, so hashing
+// may go on.
+void sha256_final(const sha256_t *s, uint8_t out[SHA256_LEN]);
+// Hash the first len bytes of fd (pread, the file offset does not move).
+// Returns 0, or -1 if the file is shorter or unreadable.
+int sha256_fd(sha256_t *s, int fd, uint64_t len);
+// The same for the file at path.
+int sha256_path(sha256_t *s, const char *path, uint64_t len);
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Live transfer statistics in shared memory. With RDT_STATS set in the
+// environment, each GBN/SR endpoint publishes one stats_page_t as
+// /dev/shm/rdt-stats-<port> and rewrites it as the transfer runs; rdt-top
+// shows every page it finds. There is one writer per page and it never
+// waits: readers copy the page and retry if the sequence count moved
+// (a seqlock).
+
+#define STATS_MAGIC "RDTSTAT1"
+#define STATS_SHM_PREFIX "rdt-stats-"
+
+enum {
+    STATS_SENDER = 1,
+    STATS_RECEIVER = 2,
+};
+
+// Send->ACK latency histogram in microseconds, HDR style: exact below
+// 16 us, then 16 linear buckets per power of two (within ~6%), up to
+// about an hour.
+#define STATS_LAT_SUB 16
+#define STATS_LAT_BUCKETS (29 * STATS_LAT_SUB)
+
+typedef struct {
+    char magic[8];
+    uint32_t size;              // sizeof(stats_page_t)
+    _Atomic uint32_t seq;       // odd while an update is in progress
+    int32_t pid;
+    uint16_t port;
+    uint8_t role;               // STATS_SENDER or STATS_RECEIVER
+    uint8_t done;               // the endpoint has finished
+    char mode[8];               // "gbn", "sr"
+
+    uint64_t update_ns;         // clock_now_ns() of the last update
+    uint64_t base;              // sender: oldest unACKed seq; receiver: next expected seq
+    uint64_t next_seq;          // sender: next new seq
+    uint64_t inflight;          // sender: packets sent and not ACKed
+    uint64_t cwnd;              // packets allowed in flight
+    uint64_t rto_ms;            // retransmission timeout in use
+    uint64_t srtt_ns;           // RFC 6298 estimates from clean samples
+    uint64_t rttvar_ns;
+    uint64_t pkts_sent;         // sender: new DATA; receiver: ACKs
+    uint64_t pkts_retx;         // sender: DATA sent again
+    uint64_t pkts_recv;         // sender: ACKs; receiver: valid DATA
+    uint64_t bytes_delivered;   // sender: ACKed payload; receiver: payload written in order
+
+    uint64_t lat_count;
+    uint64_t lat_max_ns;
+    uint64_t lat_hist[STATS_LAT_BUCKETS];
+} stats_page_t;
+
+// Create this endpoint's page, or return NULL if RDT_STATS is unset or the
+// segment cannot be made (the transfer then runs without one).
+stats_page_t *stats_open(int port, uint8_t role, const char *mode);
+// Mark the page done, unmap it and remove its name. Viewers that have it
+// mapped keep the final values.
+void stats_close(stats_page_t *st);
+// Reader side: copy a consistent snapshot of st into out. Returns 0, or -1
+// if the writer kept it busy for every attempt.
+int stats_read(const stats_page_t *st, stats_page_t *out);
+
+static inline void stats_begin(stats_page_t *st) {
+    uint32_t s = atomic_load_explicit(&st->seq, memory_order_relaxed);
+    atomic_store_explicit(&st->seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void stats_end(stats_page_t *st) {
+    uint32_t s = atomic_load_explicit(&st->seq, memory_order_relaxed);
+    atomic_store_explicit(&st->seq, s + 1, memory_order_release);
+}
+
+static inline int stats_lat_bucket(uint64_t us) {
+    if (us < STATS_LAT_SUB) {
+        return (int)us;
+    }
+    int e = 63 - __builtin_clzll(us);
+    int idx = (e - 3) * STATS_LAT_SUB + (int)((us >> (e - 4)) & (STATS_LAT_SUB - 1));
+    return idx < STATS_LAT_BUCKETS ? idx : STATS_LAT_BUCKETS - 1;
+}
+
+// Smallest latency in us that lands in bucket idx.
+static inline uint64_t stats_lat_floor(int idx) {
+    if (idx < STATS_LAT_SUB) {
+        return (uint64_t)idx;
+    }
+    int e = idx / STATS_LAT_SUB + 3;
+    return (uint64_t)(STATS_LAT_SUB + idx % STATS_LAT_SUB) << (e - 4);
+}
+
+// Sender: one send->ACK sample of a packet sent once (Karn's rule). Updates
+// the histogram and srtt/rttvar; call it inside stats_begin/stats_end.
+void stats_rtt_sample(stats_page_t *st, uint64_t rtt_ns);
+
+// Latency in us at quantile q (0-1) of a histogram of count samples: the
+// upper edge of its bucket, clamped to max_ns.
+uint64_t stats_lat_quantile_us(const uint64_t *hist, uint64_t count, uint64_t max_ns, double q);
+
+// Send->ACK latencies a sender keeps for its final report, page or not.
+typedef struct {
+    uint64_t count;
+    uint64_t max_ns;
+    uint64_t hist[STATS_LAT_BUCKETS];
+} stats_lat_t;
+
+void stats_lat_add(stats_lat_t *l, uint64_t ns);
+// Print ACK_LAT_SAMPLES and the ACK_LAT_P50/P90/P99/P999/MAX_US lines.
+void stats_lat_report(const stats_lat_t *l, FILE *out);
+
+#endif
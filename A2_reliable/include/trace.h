@@ -0,0 +1,98 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "clock.h"
+
+// Binary per-packet event trace, compiled in with `make TRACE=1` (which
+// defines RDT_TRACE). At run time, RDT_TRACE=<prefix> in the environment
+// makes each endpoint that calls TRACE_START write <prefix>.<port>. Every
+// thread fills its own buffer of fixed-size records and writes it out in
+// one go when it is full and when the thread or the process ends.
+// scripts/rdt_trace.py decodes the files to CSV or JSON. Built without
+// RDT_TRACE, the macros expand to nothing.
+
+#define TRACE_MAGIC "RDTTRC1"
+#define TRACE_BUF_RECS 4096
+
+enum {
+    TRACE_DATA_SEND = 1,    // sender: new DATA
+    TRACE_DATA_RETX,        // sender: DATA sent again
+    TRACE_ACK_RECV,         // sender: valid ACK
+    TRACE_TIMEOUT,          // sender: retransmission timer fired
+    TRACE_DATA_RECV,        // receiver: valid DATA
+    TRACE_ACK_SEND,         // receiver: ACK
+    TRACE_DELIVER,          // receiver: payload handed to the writer in order
+    TRACE_FEC_RECOVER,      // receiver: payload rebuilt from parity
+};
+
+typedef struct {
+    uint64_t ts_ns;         // clock_now_ns(), so virtual time under ./sim
+    uint32_t seq;
+    uint32_t ack;
+    uint32_t cwnd;          // packets the sender may have in flight
+    uint32_t rto_ms;
+    uint16_t len;           // payload bytes
+    uint16_t port;          // local port of the endpoint
+    uint8_t type;
+    uint8_t flags;          // header flags of the packet
+    uint8_t pad[2];
+} trace_rec_t;
+
+// Start of every trace file; records follow back to back.
+typedef struct {
+    char magic[8];
+    uint32_t rec_size;
+    uint32_t port;
+} trace_file_hdr_t;
+
+typedef struct {
+    int fd;
+    uint16_t port;
+    uint32_t n;
+    trace_rec_t recs[TRACE_BUF_RECS];
+} trace_buf_t;
+
+// This thread's buffer, or NULL when it is not tracing.
+extern _Thread_local trace_buf_t *trace_tls;
+
+// Trace this thread as the endpoint on port, if RDT_TRACE is set.
+void trace_start(int port);
+// Write out the buffered records.
+void trace_flush(trace_buf_t *tb);
+
+static inline void trace_event(uint8_t type, uint32_t seq, uint32_t ack, uint32_t cwnd,
+                               uint32_t rto_ms, uint16_t len, uint8_t flags) {
+    trace_buf_t *tb = trace_tls;
+    if (!tb) {
+        return;
+    }
+    trace_rec_t *r = &tb->recs[tb->n];
+    r->ts_ns = clock_now_ns();
+    r->seq = seq;
+    r->ack = ack;
+    r->cwnd = cwnd;
+    r->rto_ms = rto_ms;
+    r->len = len;
+    r->port = tb->port;
+    r->type = type;
+    r->flags = flags;
+    r->pad[0] = 0;
+    r->pad[1] = 0;
+    if (++tb->n == TRACE_BUF_RECS) {
+        trace_flush(tb);
+    }
+}
+
+#ifdef RDT_TRACE
+#define TRACE_START(port) trace_start(port)
+#define TRACE(type, seq, ack, cwnd, rto_ms, len, flags)                                    \
+    trace_event((type), (uint32_t)(seq), (uint32_t)(ack), (uint32_t)(cwnd),              \
+                (uint32_t)(rto_ms), (uint16_t)(len), (uint8_t)(flags))
+#else
+#define TRACE_START(port) ((void)0)
+#define TRACE(type, seq, ack, cwnd, rto_ms, len, flags) ((void)0)
+#endif
+
+#endif
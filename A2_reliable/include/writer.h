@@ -0,0 +1,45 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Disk writer thread. The network thread appends in-order payload bytes to
+// a lock-free single-producer/single-consumer ring; the writer thread
+// drains it to the output file in large block-aligned writes, so a slow
+// disk never delays an ACK.
+typedef struct writer writer_t;
+
+// Write size, and the alignment of every write but the last one.
+#define WRITER_BLOCK (1u << 20)
+// Bytes the network thread can run ahead of the disk.
+#define WRITER_RING (16u * WRITER_BLOCK)
+
+// Create/truncate path and start the writer thread. With direct set, the
+// file is opened with O_DIRECT where the filesystem supports it. fsync_mb
+// < 0 never syncs, 0 syncs once at close, N > 0 also syncs after every N MB.
+writer_t *writer_open(const char *path, int direct, int fsync_mb);
+// Like writer_open, but keep the first offset bytes of an existing file
+// (anything past them is cut off) and append from there. O_DIRECT is only
+// used if offset is block aligned.
+writer_t *writer_open_at(const char *path, int direct, int fsync_mb, uint64_t offset);
+// Nonzero if the file really is open with O_DIRECT.
+int writer_direct(const writer_t *w);
+
+#define WRITER_FULL (-2)
+
+// Non-blocking: append len bytes. Returns 0, WRITER_FULL if the ring has
+// no room for all of them (nothing is taken), or -1 after a write error.
+int writer_put(writer_t *w, const void *data, size_t len);
+// Bytes a writer_put could take right now.
+size_t writer_room(writer_t *w);
+// File size the writer thread has written out so far (not necessarily
+// synced).
+uint64_t writer_written(writer_t *w);
+// Wait up to timeout_ms for room for len bytes. Returns 1 when there is.
+int writer_wait(writer_t *w, size_t len, int timeout_ms);
+// Write out everything queued, apply the fsync policy and close the file.
+// Returns 0, or -1 if any write failed.
+int writer_close(writer_t *w);
+
+#endif
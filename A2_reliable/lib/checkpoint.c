@@ -0,0 +1,72 @@
+#define _POSIX_C_SOURCE 200809L
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// One text line: "RDTCKPT1 <payload> <start_seq> <done>".
+#define CHECKPOINT_MAGIC "RDTCKPT1"
+
+static int checkpoint_path(char *buf, size_t cap, const char *out_path, const char *suffix) {
+    int n = snprintf(buf, cap, "%s" CHECKPOINT_SUFFIX "%s", out_path, suffix);
+    return (n < 0 || (size_t)n >= cap) ? -1 : 0;
+}
+
+int checkpoint_load(const char *out_path, checkpoint_t *c) {
+    char path[4096];
+    if (checkpoint_path(path, sizeof(path), out_path, "") != 0) {
+        return -1;
+    }
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    unsigned payload = 0;
+    unsigned long start_seq = 0;
+    unsigned long done = 0;
+    int n = fscanf(f, CHECKPOINT_MAGIC " %u %lu %lu", &payload, &start_seq, &done);
+    fclose(f);
+    if (n != 3 || payload == 0 || payload > UINT16_MAX || start_seq > UINT32_MAX ||
+        done > UINT32_MAX) {
+        return -1;
+    }
+
+    // The checkpoint may be older than the file, never newer.
+    struct stat sb;
+    if (stat(out_path, &sb) != 0) {
+        return -1;
+    }
+    uint64_t whole = (uint64_t)sb.st_size / payload;
+    c->payload = (uint16_t)payload;
+    c->start_seq = (uint32_t)start_seq;
+    c->done = (uint32_t)(done < whole ? done : whole);
+    return 0;
+}
+
+int checkpoint_save(const char *out_path, const checkpoint_t *c) {
+    char path[4096];
+    char tmp[4096];
+    if (checkpoint_path(path, sizeof(path), out_path, "") != 0 ||
+        checkpoint_path(tmp, sizeof(tmp), out_path, ".tmp") != 0) {
+        return -1;
+    }
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        return -1;
+    }
+    fprintf(f, CHECKPOINT_MAGIC " %u %lu %lu\n", (unsigned)c->payload,
+            (unsigned long)c->start_seq, (unsigned long)c->done);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+void checkpoint_remove(const char *out_path) {
+    char path[4096];
+    if (checkpoint_path(path, sizeof(path), out_path, "") == 0) {
+        unlink(path);
+    }
+}
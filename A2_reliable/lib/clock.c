@@ -0,0 +1,29 @@
+#define _POSIX_C_SOURCE 200809L
+#include "clock.h"
+
+#include <stddef.h>
+#include <time.h>
+
+static clock_ops_t clock_ops;
+
+void clock_set_ops(const clock_ops_t *ops) {
+    if (ops) {
+        clock_ops = *ops;
+    } else {
+        clock_ops.now_ns = NULL;
+        clock_ops.ctx = NULL;
+    }
+}
+
+uint64_t clock_now_ns(void) {
+    if (clock_ops.now_ns) {
+        return clock_ops.now_ns(clock_ops.ctx);
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t clock_now_ms(void) {
+    return clock_now_ns() / 1000000ULL;
+}
@@ -0,0 +1,24 @@
+#define _GNU_SOURCE
+#include "cpu.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+int cpu_pin(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return -1;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+uint64_t cpu_time_ms(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
@@ -19,13 +19,18 @@ static void crc32_init(void) {
     crc_table_ready = 1;
 }
 
-uint32_t crc32_ieee(const uint8_t *data, size_t len) {
+// Continue a CRC over another span; start with crc = 0.
+uint32_t crc32_ieee_update(uint32_t crc, const uint8_t *data, size_t len) {
     if (!crc_table_ready) {
         crc32_init();
     }
-    uint32_t c = 0xFFFFFFFFU;
+    uint32_t c = crc ^ 0xFFFFFFFFU;
     for (size_t i = 0; i < len; i++) {
         c = crc_table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
     }
     return c ^ 0xFFFFFFFFU;
 }
+
+uint32_t crc32_ieee(const uint8_t *data, size_t len) {
+    return crc32_ieee_update(0, data, len);
+}
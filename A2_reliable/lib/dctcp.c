@@ -0,0 +1,58 @@
+#include "dctcp.h"
+
+// alpha gain, as in the DCTCP paper.
+#define DCTCP_G (1.0 / 16.0)
+
+void dctcp_init(dctcp_t *cc, int max) {
+    cc->cwnd = max;
+    cc->max = max;
+    cc->alpha = 1.0;
+    cc->acked = 0;
+    cc->marked = 0;
+    cc->span = (uint32_t)max;
+    cc->marks = 0;
+    cc->min_cwnd = max;
+}
+
+void dctcp_on_ack(dctcp_t *cc, uint32_t acked, bool ce) {
+    if (acked == 0) {
+        acked = 1;
+    }
+    cc->acked += acked;
+    if (ce) {
+        cc->marked += acked;
+        cc->marks++;
+    } else {
+        cc->cwnd += (double)acked / cc->cwnd;
+        if (cc->cwnd > cc->max) {
+            cc->cwnd = cc->max;
+        }
+    }
+
+    // One observation window is one RTT: the ACKs for the packets that
+    // were in flight when it began, i.e. the cwnd of that moment. Ending
+    // it after the reduced cwnd would cut again on marks from the same
+    // queue.
+    if (cc->acked < cc->span) {
+        return;
+    }
+    cc->span = (uint32_t)dctcp_window(cc);
+    double frac = (double)cc->marked / (double)cc->acked;
+    cc->alpha += DCTCP_G * (frac - cc->alpha);
+    if (cc->marked > 0) {
+        cc->cwnd *= 1.0 - cc->alpha / 2.0;
+        if (cc->cwnd < 1.0) {
+            cc->cwnd = 1.0;
+        }
+        if (cc->cwnd < cc->min_cwnd) {
+            cc->min_cwnd = cc->cwnd;
+        }
+    }
+    cc->acked = 0;
+    cc->marked = 0;
+}
+
+int dctcp_window(const dctcp_t *cc) {
+    int w = (int)cc->cwnd;
+    return w < 1 ? 1 : w;
+}
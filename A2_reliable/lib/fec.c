@@ -0,0 +1,242 @@
+#include "fec.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Loss EWMA gain, and parity groups per lost packet expected in a block.
+#define FEC_LOSS_GAIN (1.0 / 32.0)
+#define FEC_OVERHEAD 2.0
+
+void fec_xor(uint8_t *dst, const uint8_t *src, size_t len) {
+    size_t i = 0;
+    // memcpy keeps the word loads legal at any alignment; the compiler
+    // turns this loop into vector XORs.
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, sizeof(a));
+        memcpy(&b, src + i, sizeof(b));
+        a ^= b;
+        memcpy(dst + i, &a, sizeof(a));
+    }
+    for (; i < len; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+static size_t parity_stride(size_t chunk) {
+    return PKT_HDR_LEN + PKT_FEC_HDR_LEN + chunk;
+}
+
+static uint8_t *parity_body(fec_enc_t *e, int g) {
+    return e->parity + (size_t)g * parity_stride(e->chunk) + PKT_HDR_LEN + PKT_FEC_HDR_LEN;
+}
+
+static int pick_k(const fec_enc_t *e) {
+    int k = (int)(e->n * e->loss * FEC_OVERHEAD + 0.999);
+    int max_k = e->n / 2 < FEC_MAX_K ? e->n / 2 : FEC_MAX_K;
+    if (k > max_k) {
+        k = max_k;
+    }
+    return k < 1 ? 1 : k;
+}
+
+int fec_enc_init(fec_enc_t *e, int n, size_t chunk) {
+    memset(e, 0, sizeof(*e));
+    if (n < 2 || n > FEC_MAX_N || chunk + PKT_FEC_HDR_LEN > MAX_PAYLOAD) {
+        return -1;
+    }
+    e->n = n;
+    e->chunk = chunk;
+    e->parity = calloc(FEC_MAX_K, parity_stride(chunk));
+    if (!e->parity) {
+        return -1;
+    }
+    fec_enc_next(e);
+    return 0;
+}
+
+void fec_enc_free(fec_enc_t *e) {
+    free(e->parity);
+    e->parity = NULL;
+}
+
+void fec_enc_sample(fec_enc_t *e, bool lost) {
+    e->loss += FEC_LOSS_GAIN * ((lost ? 1.0 : 0.0) - e->loss);
+}
+
+bool fec_enc_add(fec_enc_t *e, uint32_t seq, const uint8_t *payload, uint16_t len,
+                 uint8_t flags) {
+    if (e->count == 0) {
+        e->base = seq;
+    }
+    int g = e->count % e->k;
+    fec_xor(parity_body(e, g), payload, len);
+    if (len > e->max_len[g]) {
+        e->max_len[g] = len;
+    }
+    e->len_xor[g] ^= len;
+    e->flags_xor[g] ^= flags;
+    e->count++;
+    return e->count >= e->n;
+}
+
+int fec_enc_parity_count(const fec_enc_t *e) {
+    return e->count < e->k ? e->count : e->k;
+}
+
+size_t fec_enc_build(fec_enc_t *e, int idx, const uint8_t **pkt) {
+    if (idx >= fec_enc_parity_count(e)) {
+        return 0;
+    }
+    pkt_fec_t fec;
+    fec.base = e->base;
+    fec.n = (uint8_t)e->count;
+    fec.k = (uint8_t)e->k;
+    fec.index = (uint8_t)idx;
+    fec.flags_xor = e->flags_xor[idx];
+    fec.len_xor = e->len_xor[idx];
+
+    uint8_t *buf = e->parity + (size_t)idx * parity_stride(e->chunk);
+    *pkt = buf;
+    return pkt_build_parity(buf, parity_stride(e->chunk), &fec, parity_body(e, idx),
+                            e->max_len[idx]);
+}
+
+void fec_enc_next(fec_enc_t *e) {
+    for (int g = 0; g < e->k; g++) {
+        memset(parity_body(e, g), 0, e->max_len[g]);
+    }
+    memset(e->max_len, 0, sizeof(e->max_len));
+    memset(e->len_xor, 0, sizeof(e->len_xor));
+    memset(e->flags_xor, 0, sizeof(e->flags_xor));
+    e->count = 0;
+    e->k = pick_k(e);
+}
+
+int fec_dec_init(fec_dec_t *d, uint32_t cap, size_t chunk) {
+    memset(d, 0, sizeof(*d));
+    d->cap = cap;
+    d->chunk = chunk;
+    d->slots = calloc(cap, sizeof(fec_slot_t));
+    d->pool = malloc((size_t)cap * chunk);
+    d->parity_pool = malloc((size_t)FEC_PENDING * chunk);
+    if (!d->slots || !d->pool || !d->parity_pool) {
+        fec_dec_free(d);
+        return -1;
+    }
+    for (uint32_t i = 0; i < cap; i++) {
+        d->slots[i].data = d->pool + (size_t)i * chunk;
+    }
+    for (int i = 0; i < FEC_PENDING; i++) {
+        d->pending[i].data = d->parity_pool + (size_t)i * chunk;
+    }
+    return 0;
+}
+
+void fec_dec_free(fec_dec_t *d) {
+    free(d->slots);
+    free(d->pool);
+    free(d->parity_pool);
+    d->slots = NULL;
+    d->pool = NULL;
+    d->parity_pool = NULL;
+}
+
+void fec_dec_store(fec_dec_t *d, uint32_t seq, const uint8_t *payload, uint16_t len,
+                   uint8_t flags) {
+    if (len > d->chunk) {
+        return;
+    }
+    fec_slot_t *slot = &d->slots[seq % d->cap];
+    // Never let an old retransmission evict a newer packet.
+    if (slot->valid && (int32_t)(slot->seq - seq) >= 0) {
+        return;
+    }
+    slot->seq = seq;
+    slot->len = len;
+    slot->flags = flags;
+    slot->valid = true;
+    memcpy(slot->data, payload, len);
+}
+
+void fec_dec_parity(fec_dec_t *d, const pkt_fec_t *fec, const uint8_t *parity, uint16_t len) {
+    if (len > d->chunk) {
+        return;
+    }
+    fec_parity_t *p = NULL;
+    for (int i = 0; i < FEC_PENDING && !p; i++) {
+        if (!d->pending[i].used) {
+            p = &d->pending[i];
+        }
+    }
+    if (!p) {
+        p = &d->pending[d->next_victim];
+        d->next_victim = (d->next_victim + 1) % FEC_PENDING;
+    }
+    p->fec = *fec;
+    p->len = len;
+    p->used = true;
+    memcpy(p->data, parity, len);
+}
+
+bool fec_dec_recover(fec_dec_t *d, uint32_t *seq, uint8_t *out, uint16_t *len, uint8_t *flags) {
+    for (int i = 0; i < FEC_PENDING; i++) {
+        fec_parity_t *p = &d->pending[i];
+        if (!p->used) {
+            continue;
+        }
+
+        uint32_t missing = 0;
+        int nmiss = 0;
+        bool stale = false;
+        for (uint32_t m = p->fec.index; m < p->fec.n; m += p->fec.k) {
+            uint32_t s = p->fec.base + m;
+            const fec_slot_t *slot = &d->slots[s % d->cap];
+            if (slot->valid && slot->seq == s) {
+                continue;
+            }
+            if (slot->valid && (int32_t)(slot->seq - s) > 0) {
+                // A member already fell out of the cache.
+                stale = true;
+                break;
+            }
+            missing = s;
+            if (++nmiss > 1) {
+                break;
+            }
+        }
+        if (stale || nmiss == 0) {
+            p->used = false;
+            continue;
+        }
+        if (nmiss > 1) {
+            continue;
+        }
+
+        uint16_t rlen = p->fec.len_xor;
+        uint8_t rflags = p->fec.flags_xor;
+        memcpy(out, p->data, p->len);
+        for (uint32_t m = p->fec.index; m < p->fec.n; m += p->fec.k) {
+            uint32_t s = p->fec.base + m;
+            if (s == missing) {
+                continue;
+            }
+            const fec_slot_t *slot = &d->slots[s % d->cap];
+            fec_xor(out, slot->data, slot->len);
+            rlen ^= slot->len;
+            rflags ^= slot->flags;
+        }
+        p->used = false;
+        if (rlen > p->len) {
+            continue;
+        }
+
+        fec_dec_store(d, missing, out, rlen, rflags);
+        d->recovered++;
+        *seq = missing;
+        *len = rlen;
+        *flags = rflags;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,363 @@
+#define _GNU_SOURCE
+#include "linkmodel.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+void lm_rng_seed(lm_rng_t *rng, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        rng->s[i] = splitmix64(&seed);
+    }
+}
+
+uint64_t lm_rng_next(lm_rng_t *rng) {
+    uint64_t *s = rng->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+double lm_rng_uniform(lm_rng_t *rng) {
+    return (double)(lm_rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+double lm_rng_normal(lm_rng_t *rng) {
+    // Box-Muller; 1 - u keeps the log argument in (0, 1].
+    double u = 1.0 - lm_rng_uniform(rng);
+    double v = lm_rng_uniform(rng);
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+bool lm_gilbert_drop(const lm_gilbert_t *g, bool *bad, lm_rng_t *rng) {
+    double flip = *bad ? g->r : g->p;
+    if (lm_rng_uniform(rng) < flip) {
+        *bad = !*bad;
+    }
+    return lm_rng_uniform(rng) < (*bad ? g->loss_bad : g->loss_good);
+}
+
+int lm_jitter_parse(const char *name, lm_jitter_kind_t *kind) {
+    if (strcmp(name, "normal") == 0) {
+        *kind = LM_JITTER_NORMAL;
+    } else if (strcmp(name, "pareto") == 0) {
+        *kind = LM_JITTER_PARETO;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+double lm_jitter_sample(const lm_jitter_t *j, lm_rng_t *rng) {
+    switch (j->kind) {
+    case LM_JITTER_NORMAL:
+        return j->ms * lm_rng_normal(rng);
+    case LM_JITTER_PARETO: {
+        // Scale chosen so the mean is j->ms.
+        double xm = j->ms * (j->alpha - 1.0) / j->alpha;
+        return xm / pow(1.0 - lm_rng_uniform(rng), 1.0 / j->alpha);
+    }
+    default:
+        return 0.0;
+    }
+}
+
+// Read up to two numbers per non-empty line into growing arrays.
+static int load_columns(const char *path, int cols, uint32_t **ts, double **val, size_t *n) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    size_t cap = 0;
+    char line[256];
+    int rc = 0;
+    *ts = NULL;
+    *n = 0;
+    if (val) {
+        *val = NULL;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line;
+        char *end = NULL;
+        unsigned long t = strtoul(p, &end, 10);
+        if (end == p) {
+            if (strspn(line, " \t\r\n") == strlen(line)) {
+                continue;
+            }
+            rc = -1;
+            break;
+        }
+        double v = 0.0;
+        if (cols == 2) {
+            p = end;
+            v = strtod(p, &end);
+            if (end == p || v < 0) {
+                rc = -1;
+                break;
+            }
+        }
+        if (t > UINT32_MAX || (*n > 0 && t < (*ts)[*n - 1])) {
+            rc = -1;
+            break;
+        }
+        if (*n == cap) {
+            cap = cap ? 2 * cap : 1024;
+            uint32_t *nts = realloc(*ts, cap * sizeof(**ts));
+            if (!nts) {
+                rc = -1;
+                break;
+            }
+            *ts = nts;
+            if (val) {
+                double *nval = realloc(*val, cap * sizeof(**val));
+                if (!nval) {
+                    rc = -1;
+                    break;
+                }
+                *val = nval;
+            }
+        }
+        (*ts)[*n] = (uint32_t)t;
+        if (val) {
+            (*val)[*n] = v;
+        }
+        (*n)++;
+    }
+    fclose(f);
+    if (rc != 0 || *n == 0) {
+        fprintf(stderr, "%s: bad trace\n", path);
+        free(*ts);
+        *ts = NULL;
+        if (val) {
+            free(*val);
+            *val = NULL;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+int lm_trace_load(lm_trace_t *t, const char *path) {
+    memset(t, 0, sizeof(*t));
+    if (load_columns(path, 1, &t->ts_ms, NULL, &t->n) != 0) {
+        return -1;
+    }
+    t->period_ms = t->ts_ms[t->n - 1];
+    if (t->period_ms == 0) {
+        fprintf(stderr, "%s: trace must end after 0 ms\n", path);
+        lm_trace_free(t);
+        return -1;
+    }
+    return 0;
+}
+
+void lm_trace_free(lm_trace_t *t) {
+    free(t->ts_ms);
+    t->ts_ms = NULL;
+    t->n = 0;
+}
+
+static uint64_t opp_ns(const lm_trace_t *t, uint64_t opp) {
+    uint64_t ms = (opp / t->n) * t->period_ms + t->ts_ms[opp % t->n];
+    return ms * 1000000ULL;
+}
+
+uint64_t lm_trace_send(const lm_trace_t *t, lm_trace_pos_t *pos, uint64_t origin_ns,
+                       uint64_t now_ns, size_t len) {
+    uint64_t rel = now_ns > origin_ns ? now_ns - origin_ns : 0;
+    if (opp_ns(t, pos->opp) < rel) {
+        // The link sat idle: opportunities before now are gone.
+        uint64_t rel_ms = (rel + 999999ULL) / 1000000ULL;
+        uint64_t cycle = rel_ms / t->period_ms;
+        uint32_t in_cycle = (uint32_t)(rel_ms % t->period_ms);
+        size_t lo = 0;
+        size_t hi = t->n;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (t->ts_ms[mid] < in_cycle) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        pos->opp = cycle * t->n + lo;
+        pos->used = 0;
+    }
+
+    size_t left = len;
+    for (;;) {
+        uint32_t room = LM_TRACE_MTU - pos->used;
+        if (left <= room) {
+            uint64_t depart = opp_ns(t, pos->opp);
+            pos->used += (uint32_t)left;
+            if (pos->used == LM_TRACE_MTU) {
+                pos->opp++;
+                pos->used = 0;
+            }
+            return origin_ns + depart;
+        }
+        left -= room;
+        pos->opp++;
+        pos->used = 0;
+    }
+}
+
+int lm_delay_trace_load(lm_delay_trace_t *t, const char *path) {
+    memset(t, 0, sizeof(*t));
+    if (load_columns(path, 2, &t->ts_ms, &t->delay_ms, &t->n) != 0) {
+        return -1;
+    }
+    t->period_ms = t->ts_ms[t->n - 1];
+    return 0;
+}
+
+void lm_delay_trace_free(lm_delay_trace_t *t) {
+    free(t->ts_ms);
+    free(t->delay_ms);
+    t->ts_ms = NULL;
+    t->delay_ms = NULL;
+    t->n = 0;
+}
+
+double lm_delay_at(const lm_delay_trace_t *t, uint64_t elapsed_ms) {
+    if (t->period_ms == 0) {
+        return t->delay_ms[0];
+    }
+    uint32_t in_cycle = (uint32_t)(elapsed_ms % t->period_ms);
+    // Last line at or before in_cycle; before the first line, the first.
+    size_t lo = 0;
+    size_t hi = t->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (t->ts_ms[mid] <= in_cycle) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return t->delay_ms[lo > 0 ? lo - 1 : 0];
+}
+
+int lm_aqm_parse(const char *name, lm_aqm_kind_t *kind) {
+    if (strcmp(name, "droptail") == 0) {
+        *kind = LM_AQM_DROPTAIL;
+    } else if (strcmp(name, "red") == 0) {
+        *kind = LM_AQM_RED;
+    } else if (strcmp(name, "codel") == 0) {
+        *kind = LM_AQM_CODEL;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void lm_aqm_init(lm_aqm_t *q, lm_aqm_kind_t kind, size_t limit_bytes) {
+    memset(q, 0, sizeof(*q));
+    q->kind = kind;
+    q->limit_bytes = limit_bytes;
+    q->red_min = (double)limit_bytes / 6.0;
+    q->red_max = (double)limit_bytes / 2.0;
+    q->red_max_p = 0.1;
+    q->red_w = 0.002;
+    q->codel_target_ns = 5000000ULL;
+    q->codel_interval_ns = 100000000ULL;
+}
+
+bool lm_aqm_enqueue_drop(lm_aqm_t *q, size_t backlog, size_t len, lm_rng_t *rng) {
+    if (backlog + len > q->limit_bytes) {
+        return true;
+    }
+    if (q->kind != LM_AQM_RED) {
+        return false;
+    }
+    q->red_avg += q->red_w * ((double)backlog - q->red_avg);
+    if (q->red_avg < q->red_min) {
+        q->red_count = -1;
+        return false;
+    }
+    if (q->red_avg >= q->red_max) {
+        q->red_count = 0;
+        return true;
+    }
+    // Spread early drops evenly: the chance grows with packets since the
+    // last one.
+    q->red_count++;
+    double pb = q->red_max_p * (q->red_avg - q->red_min) / (q->red_max - q->red_min);
+    double pa = pb / (1.0 - (q->red_count > 0 ? q->red_count : 0) * pb);
+    if (pa <= 0.0 || pa >= 1.0 || lm_rng_uniform(rng) < pa) {
+        q->red_count = 0;
+        return true;
+    }
+    return false;
+}
+
+static uint64_t codel_control_law(const lm_aqm_t *q, uint64_t t) {
+    return t + (uint64_t)((double)q->codel_interval_ns / sqrt((double)q->codel_count));
+}
+
+bool lm_aqm_dequeue_drop(lm_aqm_t *q, uint64_t sojourn_ns, uint64_t now_ns, size_t backlog) {
+    if (q->kind != LM_AQM_CODEL) {
+        return false;
+    }
+    bool ok_to_drop = false;
+    if (sojourn_ns < q->codel_target_ns || backlog <= LM_TRACE_MTU) {
+        q->codel_first_above = 0;
+    } else if (q->codel_first_above == 0) {
+        q->codel_first_above = now_ns + q->codel_interval_ns;
+    } else {
+        ok_to_drop = now_ns >= q->codel_first_above;
+    }
+
+    if (q->codel_dropping) {
+        if (!ok_to_drop) {
+            q->codel_dropping = false;
+            return false;
+        }
+        if (now_ns >= q->codel_drop_next) {
+            q->codel_count++;
+            q->codel_drop_next = codel_control_law(q, q->codel_drop_next);
+            return true;
+        }
+        return false;
+    }
+    if (ok_to_drop) {
+        // Resume near the old drop rate if the last episode was recent.
+        q->codel_dropping = true;
+        uint32_t delta = q->codel_count - q->codel_lastcount;
+        q->codel_count = (delta > 1 && now_ns - q->codel_drop_next < 16 * q->codel_interval_ns)
+                             ? delta : 1;
+        q->codel_drop_next = codel_control_law(q, now_ns);
+        q->codel_lastcount = q->codel_count;
+        return true;
+    }
+    return false;
+}
+
+double lm_jain_index(const double *x, size_t n) {
+    double sum = 0.0;
+    double sq = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += x[i];
+        sq += x[i] * x[i];
+    }
+    return sq > 0.0 ? (sum * sum) / ((double)n * sq) : 1.0;
+}
@@ -0,0 +1,195 @@
+#include "lz.h"
+
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+// As in LZ4: the last match starts at least 12 bytes before the end, and
+// the last 5 bytes are always literals.
+#define LZ_MF_LIMIT 12
+#define LZ_LAST_LITERALS 5
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+// Probe backoff bounds, in payloads.
+#define LZ_BACKOFF_MIN 8
+#define LZ_BACKOFF_MAX 1024
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint32_t hash32(uint32_t v) {
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// Length field continuation: runs of 255, then the remainder.
+static size_t put_len(uint8_t *dst, size_t op, size_t cap, size_t len) {
+    for (; len >= 255; len -= 255) {
+        if (op >= cap) {
+            return 0;
+        }
+        dst[op++] = 255;
+    }
+    if (op >= cap) {
+        return 0;
+    }
+    dst[op++] = (uint8_t)len;
+    return op;
+}
+
+// One sequence: lit literals from src, then a match (mlen 0: none).
+static size_t put_seq(uint8_t *dst, size_t op, size_t cap, const uint8_t *lit, size_t nlit,
+                      size_t offset, size_t mlen) {
+    if (op >= cap) {
+        return 0;
+    }
+    size_t token = op++;
+    size_t ml = mlen ? mlen - LZ_MIN_MATCH : 0;
+    dst[token] = (uint8_t)((nlit < 15 ? nlit : 15) << 4 | (ml < 15 ? ml : 15));
+    if (nlit >= 15 && (op = put_len(dst, op, cap, nlit - 15)) == 0) {
+        return 0;
+    }
+    if (op + nlit > cap) {
+        return 0;
+    }
+    memcpy(dst + op, lit, nlit);
+    op += nlit;
+    if (mlen == 0) {
+        return op;
+    }
+    if (op + 2 > cap) {
+        return 0;
+    }
+    dst[op++] = (uint8_t)offset;
+    dst[op++] = (uint8_t)(offset >> 8);
+    if (ml >= 15 && (op = put_len(dst, op, cap, ml - 15)) == 0) {
+        return 0;
+    }
+    return op;
+}
+
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    uint32_t table[1 << LZ_HASH_BITS];   // position + 1, 0 when empty
+    memset(table, 0, sizeof(table));
+    size_t ip = 0;
+    size_t anchor = 0;
+    size_t op = 0;
+
+    if (n > LZ_MF_LIMIT) {
+        size_t limit = n - LZ_MF_LIMIT;
+        size_t match_end = n - LZ_LAST_LITERALS;
+        while (ip < limit) {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = hash32(seq);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip + 1;
+            if (ref == 0 || ip - (ref - 1) > LZ_MAX_OFFSET || read32(src + ref - 1) != seq) {
+                // Step faster through data that keeps missing.
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            ref--;
+            size_t mlen = LZ_MIN_MATCH;
+            while (ip + mlen < match_end && src[ref + mlen] == src[ip + mlen]) {
+                mlen++;
+            }
+            op = put_seq(dst, op, cap, src + anchor, ip - anchor, ip - ref, mlen);
+            if (op == 0) {
+                return 0;
+            }
+            ip += mlen;
+            anchor = ip;
+        }
+    }
+    op = put_seq(dst, op, cap, src + anchor, n - anchor, 0, 0);
+    return op;
+}
+
+// Length field continuation; -1 if src ends first.
+static ssize_t get_len(const uint8_t *src, size_t n, size_t *ip, size_t len) {
+    uint8_t b;
+    do {
+        if (*ip >= n) {
+            return -1;
+        }
+        b = src[(*ip)++];
+        len += b;
+    } while (b == 255);
+    return (ssize_t)len;
+}
+
+ssize_t lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < n) {
+        uint8_t token = src[ip++];
+        ssize_t nlit = token >> 4;
+        if (nlit == 15 && (nlit = get_len(src, n, &ip, 15)) < 0) {
+            return -1;
+        }
+        if ((size_t)nlit > n - ip || (size_t)nlit > cap - op) {
+            return -1;
+        }
+        memcpy(dst + op, src + ip, (size_t)nlit);
+        ip += (size_t)nlit;
+        op += (size_t)nlit;
+        if (ip == n) {
+            break;
+        }
+
+        if (n - ip < 2) {
+            return -1;
+        }
+        size_t offset = (size_t)src[ip] | (size_t)src[ip + 1] << 8;
+        ip += 2;
+        ssize_t mlen = token & 15;
+        if (mlen == 15 && (mlen = get_len(src, n, &ip, 15)) < 0) {
+            return -1;
+        }
+        mlen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || (size_t)mlen > cap - op) {
+            return -1;
+        }
+        // Matches may overlap their own output (offset < mlen).
+        const uint8_t *from = dst + op - offset;
+        if (offset >= (size_t)mlen) {
+            memcpy(dst + op, from, (size_t)mlen);
+        } else {
+            for (ssize_t i = 0; i < mlen; i++) {
+                dst[op + (size_t)i] = from[i];
+            }
+        }
+        op += (size_t)mlen;
+    }
+    return (ssize_t)op;
+}
+
+void lz_probe_init(lz_probe_t *p) {
+    memset(p, 0, sizeof(*p));
+    p->backoff = LZ_BACKOFF_MIN;
+}
+
+size_t lz_probe_pack(lz_probe_t *p, uint8_t *buf, size_t n, uint8_t *tmp, bool *packed) {
+    *packed = false;
+    p->raw_bytes += n;
+    if (p->skip > 0) {
+        p->skip--;
+        p->wire_bytes += n;
+        return n;
+    }
+    p->tried++;
+    size_t c = lz_compress(buf, n, tmp, n - n / 16);
+    if (c == 0) {
+        p->skip = p->backoff;
+        p->backoff = p->backoff < LZ_BACKOFF_MAX ? 2 * p->backoff : LZ_BACKOFF_MAX;
+        p->wire_bytes += n;
+        return n;
+    }
+    p->backoff = LZ_BACKOFF_MIN;
+    p->packed++;
+    p->wire_bytes += c;
+    memcpy(buf, tmp, c);
+    *packed = true;
+    return c;
+}
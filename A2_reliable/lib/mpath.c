@@ -0,0 +1,199 @@
+#include "mpath.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+// RFC 6298 gains, and the per-packet gain of the loss average.
+#define MPATH_ALPHA (1.0 / 8.0)
+#define MPATH_BETA (1.0 / 4.0)
+#define MPATH_LOSS_G (1.0 / 16.0)
+// A path that loses almost everything still gets the odd packet, so it is
+// noticed when it recovers.
+#define MPATH_LOSS_CAP 0.9
+// Per-interval decay of the delivery rate maximum.
+#define MPATH_RATE_DECAY 0.95
+// New data stops at this many path BDPs (rate x lowest RTT) in flight,
+// which leaves room for the delivery rate to grow but keeps a rate
+// limited path from queueing past its RTO.
+#define MPATH_BDP_GAIN 2.0
+// Packets a path may hold before its delivery rate is measured.
+#define MPATH_INIT_PKTS 10
+
+int mpath_open(mpath_t *m, int n, int sock, int listen_port, const char *peer_ip, int peer_port,
+               int min_rto_ms) {
+    memset(m, 0, sizeof(*m));
+    if (n < 1 || n > MPATH_MAX) {
+        return -1;
+    }
+    m->min_rto_ms = min_rto_ms;
+    m->path[0].sock = sock;
+    netif_batch_init(&m->path[0].batch, sock);
+    for (int i = 1; i < n; i++) {
+        int s = netif_socket();
+        if (s < 0) {
+            mpath_close(m);
+            return -1;
+        }
+        m->path[i].sock = s;
+        m->n = i + 1;
+        if (netif_bind(s, listen_port + i) != 0 ||
+            netif_connect_path(s, peer_ip, peer_port + i, i) != 0) {
+            mpath_close(m);
+            return -1;
+        }
+        netif_batch_init(&m->path[i].batch, s);
+    }
+    m->n = n;
+    return 0;
+}
+
+void mpath_close(mpath_t *m) {
+    for (int i = 1; i < m->n; i++) {
+        close(m->path[i].sock);
+    }
+    m->n = 1;
+}
+
+// Expected time until a packet sent on p now reaches the receiver.
+static double delivery_ns(const mpath_t *m, const mpath_path_t *p) {
+    double floor_ns = (double)m->min_rto_ms * 1e6;
+    if (p->srtt_ns == 0) {
+        // Not measured yet: one packet at a time until the first ACK.
+        return (double)(p->inflight + 1) * floor_ns;
+    }
+    double srtt = (double)p->srtt_ns;
+    // Until a rate is measured, assume MPATH_INIT_PKTS per RTT.
+    double rate = p->rate_pps > 0 ? p->rate_pps : MPATH_INIT_PKTS * 1e9 / srtt;
+    double drain = (double)(p->inflight + 1) / rate * 1e9;
+    double loss = p->loss < MPATH_LOSS_CAP ? p->loss : MPATH_LOSS_CAP;
+    double rto = srtt + 4.0 * (double)p->rttvar_ns;
+    if (rto < floor_ns) {
+        rto = floor_ns;
+    }
+    return srtt / 2.0 + drain + loss / (1.0 - loss) * rto;
+}
+
+bool mpath_full(const mpath_t *m, int p) {
+    const mpath_path_t *pp = &m->path[p];
+    if (m->n == 1) {
+        return false;
+    }
+    if (pp->rate_pps <= 0) {
+        return pp->inflight >= MPATH_INIT_PKTS;
+    }
+    double bdp = pp->rate_pps * (double)pp->min_rtt_ns / 1e9;
+    return pp->inflight >= (uint32_t)(MPATH_BDP_GAIN * bdp) + 2;
+}
+
+int mpath_pick(const mpath_t *m) {
+    int best = 0;
+    double best_ns = 0;
+    bool best_full = true;
+    for (int i = 0; i < m->n && m->n > 1; i++) {
+        double t = delivery_ns(m, &m->path[i]);
+        bool full = mpath_full(m, i);
+        // A path with room beats any full one.
+        if (i == 0 || (best_full && !full) || (full == best_full && t < best_ns)) {
+            best = i;
+            best_ns = t;
+            best_full = full;
+        }
+    }
+    return best;
+}
+
+void mpath_on_send(mpath_t *m, int p) {
+    m->path[p].sent++;
+    m->path[p].inflight++;
+}
+
+void mpath_on_ack(mpath_t *m, int p, uint64_t rtt_ns, uint64_t now_ns) {
+    mpath_path_t *pp = &m->path[p];
+    if (pp->inflight > 0) {
+        pp->inflight--;
+    }
+    pp->acked++;
+    pp->loss -= MPATH_LOSS_G * pp->loss;
+
+    if (rtt_ns > 0) {
+        if (pp->min_rtt_ns == 0 || rtt_ns < pp->min_rtt_ns) {
+            pp->min_rtt_ns = rtt_ns;
+        }
+        if (pp->srtt_ns == 0) {
+            pp->srtt_ns = rtt_ns;
+            pp->rttvar_ns = rtt_ns / 2;
+        } else {
+            double err = (double)rtt_ns - (double)pp->srtt_ns;
+            double var = (double)pp->rttvar_ns;
+            var += MPATH_BETA * ((err < 0 ? -err : err) - var);
+            pp->rttvar_ns = (uint64_t)var;
+            pp->srtt_ns = (uint64_t)((double)pp->srtt_ns + MPATH_ALPHA * err);
+        }
+    }
+
+    // Delivery rate: ACKs per interval of one smoothed RTT, keeping a
+    // slowly decaying maximum so a briefly idle path keeps its capacity.
+    if (pp->rate_ns == 0) {
+        pp->rate_ns = now_ns;
+        pp->rate_acked = pp->acked;
+    } else if (pp->srtt_ns > 0 && now_ns - pp->rate_ns >= pp->srtt_ns) {
+        double r = (double)(pp->acked - pp->rate_acked) * 1e9 / (double)(now_ns - pp->rate_ns);
+        pp->rate_pps *= MPATH_RATE_DECAY;
+        if (r > pp->rate_pps) {
+            pp->rate_pps = r;
+        }
+        pp->rate_ns = now_ns;
+        pp->rate_acked = pp->acked;
+    }
+}
+
+void mpath_on_loss(mpath_t *m, int p) {
+    mpath_path_t *pp = &m->path[p];
+    if (pp->inflight > 0) {
+        pp->inflight--;
+    }
+    pp->lost++;
+    pp->loss += MPATH_LOSS_G * (1.0 - pp->loss);
+}
+
+int mpath_rto_ms(const mpath_t *m, int p) {
+    const mpath_path_t *pp = &m->path[p];
+    if (m->n == 1 || pp->srtt_ns == 0) {
+        return m->min_rto_ms;
+    }
+    uint64_t rto_ms = (pp->srtt_ns + 4 * pp->rttvar_ns + 999999) / 1000000;
+    return rto_ms > (uint64_t)m->min_rto_ms ? (int)rto_ms : m->min_rto_ms;
+}
+
+int mpath_flush(mpath_t *m) {
+    for (int i = 0; i < m->n; i++) {
+        if (netif_batch_flush(&m->path[i].batch) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+ssize_t mpath_recv(mpath_t *m, void *buf, size_t maxlen, int timeout_ms, int *p) {
+    int socks[MPATH_MAX];
+    for (int i = 0; i < m->n; i++) {
+        socks[i] = m->path[i].sock;
+    }
+    *p = m->last_recv;
+    ssize_t n = netif_recv_any(socks, m->n, buf, maxlen, timeout_ms, p);
+    if (n > 0) {
+        m->last_recv = *p;
+    }
+    return n;
+}
+
+void mpath_report(const mpath_t *m, FILE *out) {
+    for (int i = 0; i < m->n; i++) {
+        const mpath_path_t *p = &m->path[i];
+        fprintf(out, "PATH%d_PKTS=%llu\n", i, (unsigned long long)p->sent);
+        fprintf(out, "PATH%d_LOST=%llu\n", i, (unsigned long long)p->lost);
+        fprintf(out, "PATH%d_SRTT_MS=%.1f\n", i, (double)p->srtt_ns / 1e6);
+        fprintf(out, "PATH%d_RATE_PPS=%.0f\n", i, p->rate_pps);
+    }
+}
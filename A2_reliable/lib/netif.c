@@ -1,5 +1,9 @@
+#define _GNU_SOURCE
 #include "netif.h"
 
+#include "capture.h"
+#include "clock.h"
+
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -8,10 +12,55 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 
 #define EMU_DEFAULT_IP "127.0.0.1"
 #define EMU_DEFAULT_PORT 11000
 
+// Largest UDP/IPv4 payload, and the kernel's cap on segments per GSO send.
+#define NETIF_MAX_DGRAM 65507
+#define NETIF_GSO_MAX_SEGS 64
+// Busy-poll spin budget: below NETIF_SPIN_MIN_NS it drops to 0, and it
+// restarts from NETIF_SPIN_START_NS.
+#define NETIF_SPIN_MIN_NS 1000
+#define NETIF_SPIN_START_NS 10000
+
+// Offload state per socket. select() already limits us to FD_SETSIZE.
+typedef struct {
+    int gso;
+    int gro;
+    uint8_t *gro_buf;          // coalesced datagram being handed out
+    size_t gro_len;
+    size_t gro_off;
+    size_t gro_seg;
+    struct sockaddr_in gro_src;
+    int emu_set;               // netif_connect_path picked another emulator
+    struct sockaddr_in emu;
+    int hello_port;            // peer port of the last HELLO, for netif_rehello
+    int local_set;             // local: getsockname, for the capture
+    struct sockaddr_in local;
+    uint64_t spin_max_ns;      // netif_enable_busy_poll; 0 when off
+    uint64_t spin_ns;          // current budget
+} sock_state_t;
+
+static sock_state_t sock_state[FD_SETSIZE];
+
+// Custom transport; unset (send == NULL) means UDP.
+static netif_ops_t ops;
+
+void netif_set_ops(const netif_ops_t *o) {
+    if (o) {
+        ops = *o;
+    } else {
+        memset(&ops, 0, sizeof(ops));
+    }
+}
+
+static sock_state_t *state_of(int sock) {
+    return (sock >= 0 && sock < FD_SETSIZE) ? &sock_state[sock] : NULL;
+}
+
 static int get_emu_port(void) {
     const char *env = getenv("RELIABLE_EMU_PORT");
     if (env && *env) {
@@ -31,7 +80,67 @@ static const char *get_emu_ip(void) {
     return EMU_DEFAULT_IP;
 }
 
+// Emulator of path i: entry i of RELIABLE_EMU_PORTS (comma-separated),
+// else RELIABLE_EMU_PORT + i.
+static int get_path_emu_port(int path) {
+    const char *env = getenv("RELIABLE_EMU_PORTS");
+    if (env && *env) {
+        const char *p = env;
+        for (int i = 0; i < path && p; i++) {
+            p = strchr(p, ',');
+            p = p ? p + 1 : NULL;
+        }
+        int port = p ? atoi(p) : 0;
+        return port > 0 ? port : -1;
+    }
+    return get_emu_port() + path;
+}
+
+static int fill_addr(struct sockaddr_in *dst, const char *ip, int port);
+
+// Where sends on sock go: its path's emulator, or the default one.
+static int emu_addr(int sock, struct sockaddr_in *dst) {
+    sock_state_t *st = state_of(sock);
+    if (st && st->emu_set) {
+        *dst = st->emu;
+        return 0;
+    }
+    return fill_addr(dst, get_emu_ip(), get_emu_port());
+}
+
+// Capture (capture.h): one datagram of sock, to or from remote.
+static void capture_sock(int sock, int dir, const struct sockaddr_in *remote,
+                         const struct iovec *iov, int iovcnt) {
+    sock_state_t *st = state_of(sock);
+    struct sockaddr_in local;
+    if (!st || !st->local_set) {
+        socklen_t len = sizeof(local);
+        memset(&local, 0, sizeof(local));
+        getsockname(sock, (struct sockaddr *)&local, &len);
+        if (st) {
+            st->local = local;
+            st->local_set = 1;
+        }
+    } else {
+        local = st->local;
+    }
+    // Bound to any address: show the one the peer was reached on.
+    if (local.sin_addr.s_addr == htonl(INADDR_ANY)) {
+        local.sin_addr = remote->sin_addr;
+    }
+    capture_dgram(dir, &local, remote, iov, iovcnt);
+}
+
+static void capture_buf(int sock, int dir, const struct sockaddr_in *remote, const void *buf,
+                        size_t len) {
+    struct iovec iov = {(void *)buf, len};
+    capture_sock(sock, dir, remote, &iov, 1);
+}
+
 int netif_socket(void) {
+    if (ops.send) {
+        return ops.socket(ops.ctx);
+    }
     int sock = socket(AF_INET, SOCK_DGRAM, 0);
     if (sock < 0) {
         perror("socket");
@@ -41,6 +150,9 @@ int netif_socket(void) {
 }
 
 int netif_bind(int sock, int local_port) {
+    if (ops.send) {
+        return ops.bind(ops.ctx, sock, local_port);
+    }
     int reuse = 1;
     if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
         perror("setsockopt");
@@ -57,44 +169,294 @@ int netif_bind(int sock, int local_port) {
         return -1;
     }
 
+    const char *prefix = getenv("RDT_PCAP");
+    if (prefix && *prefix && !capture_on) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s.%d.pcap", prefix, local_port);
+        if (capture_open(path) != 0) {
+            fprintf(stderr, "cannot capture to %s\n", path);
+        }
+    }
     return 0;
 }
 
 int netif_connect(int sock, const char *peer_ip, int peer_port) {
+    return netif_connect_path(sock, peer_ip, peer_port, 0);
+}
+
+int netif_connect_path(int sock, const char *peer_ip, int peer_port, int path) {
     (void)peer_ip;
-    if (peer_port <= 0) {
+    if (peer_port <= 0 || path < 0) {
         return -1;
     }
+    if (ops.send) {
+        // A custom transport is a single link.
+        return path == 0 ? ops.connect(ops.ctx, sock, peer_port) : -1;
+    }
+
+    sock_state_t *st = state_of(sock);
+    if (path > 0) {
+        int port = get_path_emu_port(path);
+        if (!st || port <= 0 || fill_addr(&st->emu, get_emu_ip(), port) != 0) {
+            fprintf(stderr, "no emulator for path %d\n", path);
+            return -1;
+        }
+        st->emu_set = 1;
+    } else if (st) {
+        st->emu_set = 0;
+    }
+
+    if (st) {
+        st->hello_port = peer_port;
+    }
 
     char msg[64];
     snprintf(msg, sizeof(msg), "HELLO %d", peer_port);
-    return (netif_sendto(sock, get_emu_ip(), get_emu_port(), msg, strlen(msg)) < 0) ? -1 : 0;
+    return (netif_send(sock, msg, strlen(msg)) < 0) ? -1 : 0;
+}
+
+int netif_rehello(int sock) {
+    sock_state_t *st = state_of(sock);
+    if (ops.send || !st || st->hello_port <= 0) {
+        return 0;
+    }
+    char msg[64];
+    snprintf(msg, sizeof(msg), "HELLO %d", st->hello_port);
+    return (netif_send(sock, msg, strlen(msg)) < 0) ? -1 : 0;
 }
 
 ssize_t netif_send(int sock, const void *buf, size_t len) {
-    return netif_sendto(sock, get_emu_ip(), get_emu_port(), buf, len);
+    if (ops.send) {
+        struct iovec iov = {(void *)buf, len};
+        return ops.send(ops.ctx, sock, &iov, 1);
+    }
+    struct sockaddr_in dst;
+    if (emu_addr(sock, &dst) != 0) {
+        return -1;
+    }
+    ssize_t n = sendto(sock, buf, len, 0, (struct sockaddr *)&dst, sizeof(dst));
+    if (n >= 0 && capture_on) {
+        capture_buf(sock, CAPTURE_OUT, &dst, buf, len);
+    }
+    return n;
 }
 
 ssize_t netif_recv(int sock, void *buf, size_t maxlen, int timeout_ms) {
     return netif_recvfrom(sock, buf, maxlen, timeout_ms, NULL, NULL);
 }
 
+static int fill_addr(struct sockaddr_in *dst, const char *ip, int port) {
+    memset(dst, 0, sizeof(*dst));
+    dst->sin_family = AF_INET;
+    dst->sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, ip, &dst->sin_addr) != 1) {
+        fprintf(stderr, "inet_pton failed for %s\n", ip);
+        return -1;
+    }
+    return 0;
+}
+
 ssize_t netif_sendto(int sock, const char *ip, int port,
                      const void *buf, size_t len) {
     struct sockaddr_in dst;
-    memset(&dst, 0, sizeof(dst));
-    dst.sin_family = AF_INET;
-    dst.sin_port = htons((uint16_t)port);
-    if (inet_pton(AF_INET, ip, &dst.sin_addr) != 1) {
-        fprintf(stderr, "inet_pton failed for %s\n", ip);
+    if (fill_addr(&dst, ip, port) != 0) {
+        return -1;
+    }
+
+    ssize_t n = sendto(sock, buf, len, 0, (struct sockaddr *)&dst, sizeof(dst));
+    if (n >= 0 && capture_on) {
+        capture_buf(sock, CAPTURE_OUT, &dst, buf, len);
+    }
+    return n;
+}
+
+ssize_t netif_sendv(int sock, const struct iovec *iov, int iovcnt) {
+    if (ops.send) {
+        return ops.send(ops.ctx, sock, iov, iovcnt);
+    }
+    struct sockaddr_in dst;
+    if (emu_addr(sock, &dst) != 0) {
+        return -1;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &dst;
+    msg.msg_namelen = sizeof(dst);
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = (size_t)iovcnt;
+
+    ssize_t n = sendmsg(sock, &msg, 0);
+    if (n >= 0 && capture_on) {
+        capture_sock(sock, CAPTURE_OUT, &dst, iov, iovcnt);
+    }
+    return n;
+}
+
+static void report_src(const struct sockaddr_in *src, char *src_ip, int *src_port) {
+    if (src_ip) {
+        inet_ntop(AF_INET, &src->sin_addr, src_ip, INET_ADDRSTRLEN);
+    }
+    if (src_port) {
+        *src_port = ntohs(src->sin_port);
+    }
+}
+
+// Hand out the next segment of a GRO-coalesced datagram.
+static ssize_t next_gro_segment(int sock, sock_state_t *st, void *buf, size_t maxlen,
+                                char *src_ip, int *src_port) {
+    size_t left = st->gro_len - st->gro_off;
+    size_t seg = left < st->gro_seg ? left : st->gro_seg;
+    memcpy(buf, st->gro_buf + st->gro_off, seg < maxlen ? seg : maxlen);
+    if (capture_on) {
+        // Each segment was a datagram of its own on the wire.
+        capture_buf(sock, CAPTURE_IN, &st->gro_src, st->gro_buf + st->gro_off, seg);
+    }
+    st->gro_off += seg;
+    report_src(&st->gro_src, src_ip, src_port);
+    return (ssize_t)(seg < maxlen ? seg : maxlen);
+}
+
+// Receive into the socket's GRO buffer and split off the first segment.
+static ssize_t recv_gro(int sock, sock_state_t *st, void *buf, size_t maxlen,
+                        char *src_ip, int *src_port, int flags) {
+    struct iovec iov;
+    iov.iov_base = st->gro_buf;
+    iov.iov_len = NETIF_MAX_DGRAM;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &st->gro_src;
+    msg.msg_namelen = sizeof(st->gro_src);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(sock, &msg, flags);
+    if (n < 0) {
         return -1;
     }
 
-    return sendto(sock, buf, len, 0, (struct sockaddr *)&dst, sizeof(dst));
+    size_t seg = (size_t)n;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+            int gso_size;
+            memcpy(&gso_size, CMSG_DATA(c), sizeof(gso_size));
+            if (gso_size > 0) {
+                seg = (size_t)gso_size;
+            }
+        }
+    }
+
+    st->gro_len = (size_t)n;
+    st->gro_off = 0;
+    st->gro_seg = seg;
+    return next_gro_segment(sock, st, buf, maxlen, src_ip, src_port);
+}
+
+// One datagram from sock; with MSG_DONTWAIT in flags, -1 and EAGAIN when
+// none is queued.
+static ssize_t recv_one(int sock, sock_state_t *st, void *buf, size_t maxlen,
+                        char *src_ip, int *src_port, int flags) {
+    if (st && st->gro) {
+        return recv_gro(sock, st, buf, maxlen, src_ip, src_port, flags);
+    }
+    struct sockaddr_in src;
+    socklen_t srclen = sizeof(src);
+    ssize_t n = recvfrom(sock, buf, maxlen, flags, (struct sockaddr *)&src, &srclen);
+    if (n < 0) {
+        return -1;
+    }
+    if (capture_on) {
+        capture_buf(sock, CAPTURE_IN, &src, buf, (size_t)n < maxlen ? (size_t)n : maxlen);
+    }
+    report_src(&src, src_ip, src_port);
+    return n;
+}
+
+// Busy-poll mode: before blocking, try non-blocking receives on every
+// socket for the budget of socks[0], at most timeout_ms. Returns the
+// datagram length, 0 if nothing came, -1 on error. *spent_ms is the time
+// taken out of the timeout.
+static ssize_t spin_recv(const int *socks, int nsocks, void *buf, size_t maxlen, int timeout_ms,
+                         char *src_ip, int *src_port, int *which, int *spent_ms) {
+    sock_state_t *st = state_of(socks[0]);
+    uint64_t budget = st->spin_ns;
+    if (timeout_ms >= 0 && budget > (uint64_t)timeout_ms * 1000000) {
+        budget = (uint64_t)timeout_ms * 1000000;
+    }
+    uint64_t start = clock_now_ns();
+    *spent_ms = 0;
+    if (budget == 0) {
+        return 0;
+    }
+    do {
+        for (int i = 0; i < nsocks; i++) {
+            ssize_t n = recv_one(socks[i], state_of(socks[i]), buf, maxlen, src_ip, src_port,
+                                 MSG_DONTWAIT);
+            if (n >= 0) {
+                *which = i;
+                // Caught while spinning: a budget this long pays off.
+                st->spin_ns = st->spin_ns * 2 < st->spin_max_ns ? st->spin_ns * 2 : st->spin_max_ns;
+                return n;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
+            }
+        }
+    } while (clock_now_ns() - start < budget);
+    *spent_ms = (int)(budget / 1000000);
+    return 0;
+}
+
+// After a block: grow the budget when the datagram came soon enough for a
+// longer spin to catch it, shrink it when the wait went on much longer (as
+// KVM adapts halt polling).
+static void spin_adapt(sock_state_t *st, int got, uint64_t waited_ns) {
+    if (got && waited_ns < st->spin_max_ns) {
+        st->spin_ns = st->spin_ns == 0 ? NETIF_SPIN_START_NS : st->spin_ns * 2;
+        if (st->spin_ns > st->spin_max_ns) {
+            st->spin_ns = st->spin_max_ns;
+        }
+    } else if (!got || waited_ns > 2 * st->spin_max_ns) {
+        st->spin_ns /= 2;
+        if (st->spin_ns < NETIF_SPIN_MIN_NS) {
+            st->spin_ns = 0;
+        }
+    }
 }
 
 ssize_t netif_recvfrom(int sock, void *buf, size_t maxlen,
                        int timeout_ms, char *src_ip, int *src_port) {
+    if (ops.send) {
+        // A custom transport has no addresses to report.
+        if (src_ip) {
+            src_ip[0] = '\0';
+        }
+        if (src_port) {
+            *src_port = 0;
+        }
+        return ops.recv(ops.ctx, sock, buf, maxlen, timeout_ms);
+    }
+    sock_state_t *st = state_of(sock);
+    if (st && st->gro && st->gro_off < st->gro_len) {
+        return next_gro_segment(sock, st, buf, maxlen, src_ip, src_port);
+    }
+    int spin = st && st->spin_max_ns && timeout_ms != 0;
+    if (spin) {
+        int which;
+        int spent_ms;
+        ssize_t n = spin_recv(&sock, 1, buf, maxlen, timeout_ms, src_ip, src_port, &which, &spent_ms);
+        if (n != 0) {
+            return n;
+        }
+        if (timeout_ms > 0) {
+            timeout_ms = timeout_ms > spent_ms ? timeout_ms - spent_ms : 0;
+        }
+    }
+
     fd_set rfds;
     FD_ZERO(&rfds);
     FD_SET(sock, &rfds);
@@ -107,7 +469,11 @@ ssize_t netif_recvfrom(int sock, void *buf, size_t maxlen,
         tvp = &tv;
     }
 
+    uint64_t blocked_ns = clock_now_ns();
     int ret = select(sock + 1, &rfds, NULL, NULL, tvp);
+    if (spin) {
+        spin_adapt(st, ret > 0, clock_now_ns() - blocked_ns);
+    }
     if (ret < 0) {
         if (errno == EINTR) {
             return 0;
@@ -119,19 +485,350 @@ ssize_t netif_recvfrom(int sock, void *buf, size_t maxlen,
         return 0;
     }
 
-    struct sockaddr_in src;
-    socklen_t srclen = sizeof(src);
-    ssize_t n = recvfrom(sock, buf, maxlen, 0, (struct sockaddr *)&src, &srclen);
-    if (n < 0) {
+    return recv_one(sock, st, buf, maxlen, src_ip, src_port, 0);
+}
+
+ssize_t netif_recv_any(const int *socks, int nsocks, void *buf, size_t maxlen, int timeout_ms,
+                       int *which) {
+    int last = *which;
+    *which = 0;
+    if (ops.send || nsocks == 1) {
+        return netif_recv(socks[0], buf, maxlen, timeout_ms);
+    }
+    for (int i = 0; i < nsocks; i++) {
+        sock_state_t *st = state_of(socks[i]);
+        if (st && st->gro && st->gro_off < st->gro_len) {
+            *which = i;
+            return next_gro_segment(socks[i], st, buf, maxlen, NULL, NULL);
+        }
+    }
+    sock_state_t *st0 = state_of(socks[0]);
+    int spin = st0 && st0->spin_max_ns && timeout_ms != 0;
+    if (spin) {
+        int spent_ms;
+        ssize_t n = spin_recv(socks, nsocks, buf, maxlen, timeout_ms, NULL, NULL, which, &spent_ms);
+        if (n != 0) {
+            return n;
+        }
+        if (timeout_ms > 0) {
+            timeout_ms = timeout_ms > spent_ms ? timeout_ms - spent_ms : 0;
+        }
+    }
+
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    int maxfd = -1;
+    for (int i = 0; i < nsocks; i++) {
+        FD_SET(socks[i], &rfds);
+        maxfd = socks[i] > maxfd ? socks[i] : maxfd;
+    }
+    struct timeval tv;
+    struct timeval *tvp = NULL;
+    if (timeout_ms >= 0) {
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+        tvp = &tv;
+    }
+    uint64_t blocked_ns = clock_now_ns();
+    int ret = select(maxfd + 1, &rfds, NULL, NULL, tvp);
+    if (spin) {
+        spin_adapt(st0, ret > 0, clock_now_ns() - blocked_ns);
+    }
+    if (ret < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        perror("select");
         return -1;
     }
+    if (ret == 0) {
+        return 0;
+    }
+    for (int k = 0; k < nsocks; k++) {
+        int i = (last + 1 + k) % nsocks;
+        if (FD_ISSET(socks[i], &rfds)) {
+            *which = i;
+            return netif_recv(socks[i], buf, maxlen, 0);
+        }
+    }
+    return 0;
+}
 
-    if (src_ip) {
-        inet_ntop(AF_INET, &src.sin_addr, src_ip, INET_ADDRSTRLEN);
+int netif_enable_reuseport(int sock) {
+    int one = 1;
+    if (ops.send || setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        return -1;
     }
-    if (src_port) {
-        *src_port = ntohs(src.sin_port);
+    return 0;
+}
+
+int netif_listen(int sock) {
+    if (ops.send) {
+        return -1;
+    }
+    sock_state_t *st = state_of(sock);
+    if (st) {
+        st->emu_set = 0;
+    }
+    static const char msg[] = "HELLO 0";
+    return netif_send(sock, msg, sizeof(msg) - 1) < 0 ? -1 : 0;
+}
+
+int netif_recv_batch(int sock, netif_dgram_t *d, int n, int timeout_ms) {
+    if (ops.send || n <= 0 || sock < 0 || sock >= FD_SETSIZE) {
+        return -1;
+    }
+    if (timeout_ms != 0) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(sock, &rfds);
+        struct timeval tv;
+        struct timeval *tvp = NULL;
+        if (timeout_ms > 0) {
+            tv.tv_sec = timeout_ms / 1000;
+            tv.tv_usec = (timeout_ms % 1000) * 1000;
+            tvp = &tv;
+        }
+        int ret = select(sock + 1, &rfds, NULL, NULL, tvp);
+        if (ret < 0) {
+            return errno == EINTR ? 0 : -1;
+        }
+        if (ret == 0) {
+            return 0;
+        }
+    }
+
+    struct mmsghdr msgs[NETIF_BATCH_MAX];
+    struct iovec iov[NETIF_BATCH_MAX];
+    if (n > NETIF_BATCH_MAX) {
+        n = NETIF_BATCH_MAX;
+    }
+    memset(msgs, 0, sizeof(msgs[0]) * (size_t)n);
+    for (int i = 0; i < n; i++) {
+        iov[i].iov_base = d[i].buf;
+        iov[i].iov_len = d[i].cap;
+        msgs[i].msg_hdr.msg_name = &d[i].addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(d[i].addr);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int got = recvmmsg(sock, msgs, (unsigned)n, MSG_DONTWAIT, NULL);
+    if (got < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+    for (int i = 0; i < got; i++) {
+        d[i].len = msgs[i].msg_len;
+        if (capture_on) {
+            capture_buf(sock, CAPTURE_IN, &d[i].addr, d[i].buf, d[i].len);
+        }
     }
+    return got;
+}
 
+ssize_t netif_send_addr(int sock, const struct sockaddr_in *addr, const void *buf, size_t len) {
+    if (ops.send) {
+        return -1;
+    }
+    ssize_t n = sendto(sock, buf, len, 0, (const struct sockaddr *)addr, sizeof(*addr));
+    if (n >= 0 && capture_on) {
+        capture_buf(sock, CAPTURE_OUT, addr, buf, len);
+    }
     return n;
 }
+
+int netif_enable_gso(int sock) {
+    sock_state_t *st = ops.send ? NULL : state_of(sock);
+    // A zero default segment size only probes support; sends set their own.
+    int zero = 0;
+    if (!st || setsockopt(sock, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)) < 0) {
+        return -1;
+    }
+    st->gso = 1;
+    return 0;
+}
+
+int netif_enable_busy_poll(int sock, int usecs) {
+    sock_state_t *st = ops.send ? NULL : state_of(sock);
+    if (!st || usecs <= 0) {
+        return -1;
+    }
+    st->spin_max_ns = (uint64_t)usecs * 1000;
+    st->spin_ns = st->spin_max_ns;
+#ifdef SO_BUSY_POLL
+    if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) == 0) {
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+int netif_enable_gro(int sock) {
+    sock_state_t *st = ops.send ? NULL : state_of(sock);
+    int one = 1;
+    if (!st || setsockopt(sock, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0) {
+        return -1;
+    }
+    if (!st->gro_buf) {
+        st->gro_buf = malloc(NETIF_MAX_DGRAM);
+        if (!st->gro_buf) {
+            return -1;
+        }
+    }
+    st->gro = 1;
+    st->gro_len = 0;
+    st->gro_off = 0;
+    return 0;
+}
+
+static size_t iov_total(const struct iovec *iov, int n) {
+    size_t total = 0;
+    for (int i = 0; i < n; i++) {
+        total += iov[i].iov_len;
+    }
+    return total;
+}
+
+// One UDP_SEGMENT send of npkts datagrams; all but the last are seg bytes.
+static ssize_t send_gso(int sock, struct sockaddr_in *dst, const struct iovec *iov,
+                        int iovcnt, uint16_t seg) {
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = dst;
+    msg.msg_namelen = sizeof(*dst);
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = (size_t)iovcnt;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_UDP;
+    c->cmsg_type = UDP_SEGMENT;
+    c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(c), &seg, sizeof(seg));
+
+    return sendmsg(sock, &msg, 0);
+}
+
+int netif_send_batch(int sock, const struct iovec *iov, int iov_per_pkt, int npkts) {
+    if (ops.send) {
+        for (int i = 0; i < npkts; i++) {
+            if (ops.send(ops.ctx, sock, iov + (size_t)i * iov_per_pkt, iov_per_pkt) < 0) {
+                return -1;
+            }
+        }
+        return npkts;
+    }
+    struct sockaddr_in dst;
+    if (emu_addr(sock, &dst) != 0) {
+        return -1;
+    }
+
+    sock_state_t *st = state_of(sock);
+    int sent = 0;
+    while (sent < npkts) {
+        const struct iovec *first = iov + (size_t)sent * iov_per_pkt;
+
+        if (st && st->gso) {
+            // Longest run of equal-sized datagrams; a shorter one may end it.
+            size_t seg = iov_total(first, iov_per_pkt);
+            size_t total = seg;
+            int run = 1;
+            while (sent + run < npkts && run < NETIF_GSO_MAX_SEGS) {
+                size_t len = iov_total(first + (size_t)run * iov_per_pkt, iov_per_pkt);
+                if (len > seg || total + len > NETIF_MAX_DGRAM) {
+                    break;
+                }
+                total += len;
+                run++;
+                if (len < seg) {
+                    break;
+                }
+            }
+
+            if (run > 1) {
+                if (send_gso(sock, &dst, first, run * iov_per_pkt, (uint16_t)seg) >= 0) {
+                    for (int i = 0; capture_on && i < run; i++) {
+                        capture_sock(sock, CAPTURE_OUT, &dst, first + (size_t)i * iov_per_pkt,
+                                     iov_per_pkt);
+                    }
+                    sent += run;
+                    continue;
+                }
+                if (errno != EIO && errno != EINVAL && errno != ENOPROTOOPT &&
+                    errno != EOPNOTSUPP) {
+                    return -1;
+                }
+                // The path cannot segment for us: stay on sendmmsg from now on.
+                st->gso = 0;
+            } else {
+                struct msghdr msg;
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_name = &dst;
+                msg.msg_namelen = sizeof(dst);
+                msg.msg_iov = (struct iovec *)first;
+                msg.msg_iovlen = (size_t)iov_per_pkt;
+                if (sendmsg(sock, &msg, 0) < 0) {
+                    return -1;
+                }
+                if (capture_on) {
+                    capture_sock(sock, CAPTURE_OUT, &dst, first, iov_per_pkt);
+                }
+                sent += 1;
+                continue;
+            }
+        }
+
+        struct mmsghdr msgs[NETIF_BATCH_MAX];
+        int m = npkts - sent;
+        if (m > NETIF_BATCH_MAX) {
+            m = NETIF_BATCH_MAX;
+        }
+        memset(msgs, 0, sizeof(msgs[0]) * (size_t)m);
+        for (int i = 0; i < m; i++) {
+            msgs[i].msg_hdr.msg_name = &dst;
+            msgs[i].msg_hdr.msg_namelen = sizeof(dst);
+            msgs[i].msg_hdr.msg_iov = (struct iovec *)(first + (size_t)i * iov_per_pkt);
+            msgs[i].msg_hdr.msg_iovlen = (size_t)iov_per_pkt;
+        }
+        int r = sendmmsg(sock, msgs, (unsigned int)m, 0);
+        if (r <= 0) {
+            return -1;
+        }
+        for (int i = 0; capture_on && i < r; i++) {
+            capture_sock(sock, CAPTURE_OUT, &dst, first + (size_t)i * iov_per_pkt, iov_per_pkt);
+        }
+        sent += r;
+    }
+    return sent;
+}
+
+void netif_batch_init(netif_batch_t *b, int sock) {
+    b->sock = sock;
+    b->npkts = 0;
+}
+
+int netif_batch_add(netif_batch_t *b, const void *hdr, size_t hdr_len,
+                    const void *payload, size_t payload_len) {
+    if (b->npkts == NETIF_BATCH_MAX && netif_batch_flush(b) < 0) {
+        return -1;
+    }
+    struct iovec *iov = &b->iov[2 * b->npkts];
+    iov[0].iov_base = (void *)hdr;
+    iov[0].iov_len = hdr_len;
+    iov[1].iov_base = (void *)payload;
+    iov[1].iov_len = payload ? payload_len : 0;
+    b->npkts++;
+    return 0;
+}
+
+int netif_batch_flush(netif_batch_t *b) {
+    if (b->npkts == 0) {
+        return 0;
+    }
+    int n = b->npkts;
+    b->npkts = 0;
+    return netif_send_batch(b->sock, b->iov, 2, n) == n ? 0 : -1;
+}
@@ -1,26 +1,50 @@
 #include "protocol.h"
+#include "sha256.h"
 
 #include <string.h>
 #include <stddef.h>
 #include <arpa/inet.h>
 
+// Per thread: the simulator runs a sender and a receiver in one process.
+static _Thread_local uint16_t payload_limit = MAX_PAYLOAD;
+
+void pkt_set_payload_limit(uint16_t limit) {
+    payload_limit = (limit > 0 && limit <= MAX_PAYLOAD) ? limit : MAX_PAYLOAD;
+}
+
+uint16_t pkt_payload_limit(void) {
+    return payload_limit;
+}
+
 static uint32_t crc_for_packet(const pkt_hdr_t *net_hdr, const uint8_t *payload, uint16_t len) {
-    uint8_t tmp[PKT_HDR_LEN + MAX_PAYLOAD];
-    size_t total = PKT_HDR_LEN + len;
+    pkt_hdr_t tmp;
 
-    memcpy(tmp, net_hdr, PKT_HDR_LEN);
-    tmp[offsetof(pkt_hdr_t, crc32) + 0] = 0;
-    tmp[offsetof(pkt_hdr_t, crc32) + 1] = 0;
-    tmp[offsetof(pkt_hdr_t, crc32) + 2] = 0;
-    tmp[offsetof(pkt_hdr_t, crc32) + 3] = 0;
+    memcpy(&tmp, net_hdr, PKT_HDR_LEN);
+    tmp.crc32 = 0;
 
+    uint32_t crc = crc32_ieee_update(0, (const uint8_t *)&tmp, PKT_HDR_LEN);
     if (payload && len > 0) {
-        memcpy(tmp + PKT_HDR_LEN, payload, len);
+        crc = crc32_ieee_update(crc, payload, len);
     }
-    return crc32_ieee(tmp, total);
+    return crc;
 }
 
-static size_t build_common(uint8_t *buf, size_t buf_cap, uint8_t type,
+static void fill_header(pkt_hdr_t *hdr, uint8_t type, uint8_t flags,
+                        uint32_t seq, uint32_t ack,
+                        const uint8_t *payload, uint16_t len) {
+    hdr->magic = htons(MAGIC_CONST);
+    hdr->type = type;
+    hdr->flags = flags;
+    hdr->seq = htonl(seq);
+    hdr->ack = htonl(ack);
+    hdr->len = htons(len);
+    hdr->crc32 = 0;
+
+    uint32_t crc = crc_for_packet(hdr, payload, len);
+    hdr->crc32 = htonl(crc);
+}
+
+static size_t build_common(uint8_t *buf, size_t buf_cap, uint8_t type, uint8_t flags,
                            uint32_t seq, uint32_t ack,
                            const uint8_t *payload, uint16_t len) {
     if (len > MAX_PAYLOAD || buf_cap < PKT_HDR_LEN + len) {
@@ -28,40 +52,208 @@ static size_t build_common(uint8_t *buf, size_t buf_cap, uint8_t type,
     }
 
     pkt_hdr_t hdr;
-    hdr.magic = htons(MAGIC_CONST);
-    hdr.type = type;
-    hdr.flags = 0;
-    hdr.seq = htonl(seq);
-    hdr.ack = htonl(ack);
-    hdr.len = htons(len);
-    hdr.crc32 = 0;
-
-    uint32_t crc = crc_for_packet(&hdr, payload, len);
-    hdr.crc32 = htonl(crc);
+    fill_header(&hdr, type, flags, seq, ack, payload, len);
 
     memcpy(buf, &hdr, PKT_HDR_LEN);
-    if (len > 0 && payload) {
+    // Payloads read straight into buf + PKT_HDR_LEN are already in place.
+    if (len > 0 && payload && payload != buf + PKT_HDR_LEN) {
         memcpy(buf + PKT_HDR_LEN, payload, len);
     }
 
     return PKT_HDR_LEN + len;
 }
 
+size_t pkt_build_data_hdr(uint8_t *hdr_buf, size_t buf_cap, uint32_t seq,
+                          uint8_t flags, const uint8_t *payload, uint16_t len) {
+    if (len > MAX_PAYLOAD || buf_cap < PKT_HDR_LEN) {
+        return 0;
+    }
+
+    pkt_hdr_t hdr;
+    fill_header(&hdr, PKT_TYPE_DATA, flags, seq, 0, payload, len);
+    memcpy(hdr_buf, &hdr, PKT_HDR_LEN);
+    return PKT_HDR_LEN;
+}
+
 size_t pkt_build_data(uint8_t *buf, size_t buf_cap, uint32_t seq,
                       const uint8_t *payload, uint16_t len) {
-    return build_common(buf, buf_cap, PKT_TYPE_DATA, seq, 0, payload, len);
+    return build_common(buf, buf_cap, PKT_TYPE_DATA, 0, seq, 0, payload, len);
+}
+
+size_t pkt_build_data_flags(uint8_t *buf, size_t buf_cap, uint32_t seq,
+                            uint8_t flags, const uint8_t *payload, uint16_t len) {
+    return build_common(buf, buf_cap, PKT_TYPE_DATA, flags, seq, 0, payload, len);
 }
 
 size_t pkt_build_ack(uint8_t *buf, size_t buf_cap, uint32_t ack) {
-    return build_common(buf, buf_cap, PKT_TYPE_ACK, 0, ack, NULL, 0);
+    return build_common(buf, buf_cap, PKT_TYPE_ACK, 0, 0, ack, NULL, 0);
+}
+
+size_t pkt_build_ack_flags(uint8_t *buf, size_t buf_cap, uint32_t ack, uint8_t flags) {
+    return build_common(buf, buf_cap, PKT_TYPE_ACK, flags, 0, ack, NULL, 0);
+}
+
+size_t pkt_build_ack_wnd(uint8_t *buf, size_t buf_cap, uint32_t ack, uint8_t flags, uint32_t wnd_edge) {
+    return build_common(buf, buf_cap, PKT_TYPE_ACK, flags | PKT_FLAG_RWND, wnd_edge, ack, NULL, 0);
+}
+
+int pkt_mark(uint8_t *buf, size_t len, uint8_t flags) {
+    pkt_hdr_t hdr;
+    if (len < PKT_HDR_LEN) {
+        return -1;
+    }
+    memcpy(&hdr, buf, PKT_HDR_LEN);
+    uint16_t plen = ntohs(hdr.len);
+    if (ntohs(hdr.magic) != MAGIC_CONST || PKT_HDR_LEN + plen != len) {
+        return -1;
+    }
+    hdr.flags |= flags;
+    hdr.crc32 = htonl(crc_for_packet(&hdr, buf + PKT_HDR_LEN, plen));
+    memcpy(buf, &hdr, PKT_HDR_LEN);
+    return 0;
 }
 
 size_t pkt_build_fin(uint8_t *buf, size_t buf_cap, uint32_t seq) {
-    return build_common(buf, buf_cap, PKT_TYPE_FIN, seq, 0, NULL, 0);
+    return build_common(buf, buf_cap, PKT_TYPE_FIN, 0, seq, 0, NULL, 0);
 }
 
 size_t pkt_build_finack(uint8_t *buf, size_t buf_cap, uint32_t ack) {
-    return build_common(buf, buf_cap, PKT_TYPE_FINACK, 0, ack, NULL, 0);
+    return build_common(buf, buf_cap, PKT_TYPE_FINACK, 0, 0, ack, NULL, 0);
+}
+
+size_t pkt_build_fin_digest(uint8_t *buf, size_t buf_cap, uint32_t seq, const uint8_t *digest) {
+    return build_common(buf, buf_cap, PKT_TYPE_FIN, PKT_FLAG_DIGEST, seq, 0, digest, SHA256_LEN);
+}
+
+size_t pkt_build_finack_wnd(uint8_t *buf, size_t buf_cap, uint32_t ack, uint8_t flags,
+                            uint32_t wnd_edge) {
+    return build_common(buf, buf_cap, PKT_TYPE_FINACK, flags | PKT_FLAG_RWND, wnd_edge, ack, NULL, 0);
+}
+
+static size_t build_syn_common(uint8_t *buf, size_t buf_cap, uint8_t type,
+                               const pkt_syn_t *syn) {
+    uint8_t body[PKT_SYN_LEN];
+    uint16_t payload = htons(syn->payload);
+    uint16_t window = htons(syn->window);
+    uint32_t start_seq = htonl(syn->start_seq);
+    uint32_t resume_seq = htonl(syn->resume_seq);
+    uint32_t session = htonl(syn->session);
+    memcpy(body, &payload, 2);
+    memcpy(body + 2, &window, 2);
+    body[4] = syn->ack_mode;
+    body[5] = syn->features;
+    memcpy(body + 6, &start_seq, 4);
+    memcpy(body + 10, &resume_seq, 4);
+    memcpy(body + 14, &session, 4);
+    return build_common(buf, buf_cap, type, 0, 0, 0, body, PKT_SYN_LEN);
+}
+
+size_t pkt_build_syn(uint8_t *buf, size_t buf_cap, const pkt_syn_t *syn) {
+    return build_syn_common(buf, buf_cap, PKT_TYPE_SYN, syn);
+}
+
+size_t pkt_build_synack(uint8_t *buf, size_t buf_cap, const pkt_syn_t *syn) {
+    return build_syn_common(buf, buf_cap, PKT_TYPE_SYNACK, syn);
+}
+
+int pkt_parse_syn(const uint8_t *payload, uint16_t len, pkt_syn_t *syn) {
+    if (!payload || len < PKT_SYN_LEN_V1) {
+        return -1;
+    }
+
+    memset(syn, 0, sizeof(*syn));
+    uint16_t v;
+    memcpy(&v, payload, sizeof(v));
+    syn->payload = ntohs(v);
+    if (syn->payload == 0 || syn->payload > MAX_PAYLOAD) {
+        return -1;
+    }
+    if (len >= PKT_SYN_LEN_V2) {
+        uint32_t start_seq;
+        memcpy(&v, payload + 2, sizeof(v));
+        syn->window = ntohs(v);
+        syn->ack_mode = payload[4];
+        syn->features = payload[5];
+        memcpy(&start_seq, payload + 6, sizeof(start_seq));
+        syn->start_seq = ntohl(start_seq);
+    }
+    syn->resume_seq = syn->start_seq;
+    if (len >= PKT_SYN_LEN_V3) {
+        uint32_t resume_seq;
+        memcpy(&resume_seq, payload + 10, sizeof(resume_seq));
+        syn->resume_seq = ntohl(resume_seq);
+    }
+    if (len >= PKT_SYN_LEN) {
+        uint32_t session;
+        memcpy(&session, payload + 14, sizeof(session));
+        syn->session = ntohl(session);
+    }
+    return 0;
+}
+
+size_t pkt_build_parity(uint8_t *buf, size_t buf_cap, const pkt_fec_t *fec,
+                        const uint8_t *parity, uint16_t len) {
+    if ((size_t)len + PKT_FEC_HDR_LEN > MAX_PAYLOAD ||
+        buf_cap < PKT_HDR_LEN + PKT_FEC_HDR_LEN + len) {
+        return 0;
+    }
+    uint8_t *body = buf + PKT_HDR_LEN;
+    if (len > 0 && parity != body + PKT_FEC_HDR_LEN) {
+        memmove(body + PKT_FEC_HDR_LEN, parity, len);
+    }
+    uint16_t len_xor = htons(fec->len_xor);
+    memcpy(body, &len_xor, sizeof(len_xor));
+
+    uint32_t desc = ((uint32_t)fec->n << 24) | ((uint32_t)fec->k << 16) |
+                    ((uint32_t)fec->index << 8) | fec->flags_xor;
+    return build_common(buf, buf_cap, PKT_TYPE_PARITY, 0, fec->base, desc, body,
+                        (uint16_t)(PKT_FEC_HDR_LEN + len));
+}
+
+int pkt_parse_parity(const pkt_hdr_t *hdr, const uint8_t *payload, uint16_t len,
+                     pkt_fec_t *fec, const uint8_t **parity, uint16_t *parity_len) {
+    if (hdr->type != PKT_TYPE_PARITY || !payload || len < PKT_FEC_HDR_LEN) {
+        return -1;
+    }
+
+    fec->base = hdr->seq;
+    fec->n = (uint8_t)(hdr->ack >> 24);
+    fec->k = (uint8_t)(hdr->ack >> 16);
+    fec->index = (uint8_t)(hdr->ack >> 8);
+    fec->flags_xor = (uint8_t)hdr->ack;
+    if (fec->n == 0 || fec->k == 0 || fec->index >= fec->k) {
+        return -1;
+    }
+
+    uint16_t len_xor;
+    memcpy(&len_xor, payload, sizeof(len_xor));
+    fec->len_xor = ntohs(len_xor);
+    *parity = payload + PKT_FEC_HDR_LEN;
+    *parity_len = (uint16_t)(len - PKT_FEC_HDR_LEN);
+    return 0;
+}
+
+void pkt_put_stream_hdr(uint8_t *dst, const pkt_stream_hdr_t *sh) {
+    uint32_t id = htonl(sh->stream_id);
+    uint32_t hi = htonl((uint32_t)(sh->offset >> 32));
+    uint32_t lo = htonl((uint32_t)sh->offset);
+    memcpy(dst, &id, 4);
+    memcpy(dst + 4, &hi, 4);
+    memcpy(dst + 8, &lo, 4);
+}
+
+int pkt_get_stream_hdr(const uint8_t *payload, uint16_t len, pkt_stream_hdr_t *sh) {
+    if (!payload || len < PKT_STREAM_HDR_LEN) {
+        return -1;
+    }
+
+    uint32_t id, hi, lo;
+    memcpy(&id, payload, 4);
+    memcpy(&hi, payload + 4, 4);
+    memcpy(&lo, payload + 8, 4);
+    sh->stream_id = ntohl(id);
+    sh->offset = ((uint64_t)ntohl(hi) << 32) | ntohl(lo);
+    return 0;
 }
 
 int pkt_parse(const uint8_t *buf, size_t len, pkt_hdr_t *hdr,
@@ -82,6 +274,9 @@ int pkt_parse(const uint8_t *buf, size_t len, pkt_hdr_t *hdr,
     if (len < PKT_HDR_LEN + plen) {
         return -3;
     }
+    if (plen > payload_limit + (net_hdr.type == PKT_TYPE_PARITY ? PKT_FEC_HDR_LEN : 0)) {
+        return -5;
+    }
 
     uint32_t recv_crc = ntohl(net_hdr.crc32);
     uint32_t calc_crc = crc_for_packet(&net_hdr, buf + PKT_HDR_LEN, plen);
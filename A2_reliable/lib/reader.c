@@ -0,0 +1,261 @@
+#define _POSIX_C_SOURCE 200809L
+#include "reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// How far ahead of the read offset the kernel is asked to prefetch.
+#define READER_READAHEAD (4u << 20)
+
+typedef struct {
+    ssize_t len;
+    uint8_t flags;
+    uint8_t *data;
+} reader_slot_t;
+
+struct reader {
+    // head is written only by the reader thread, tail only by the network
+    // thread; keep them on separate cache lines.
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    _Alignas(64) atomic_int prod_waiting;
+    atomic_int cons_waiting;
+    atomic_int stop;
+
+    // Sleeping only: the ring itself is lock-free.
+    pthread_mutex_t lock;
+    pthread_cond_t space;
+    pthread_cond_t ready;
+    pthread_t thread;
+
+    reader_fill_fn fill;
+    void *ctx;
+    size_t chunk;
+    size_t depth;
+    reader_slot_t *slots;
+    uint8_t *pool;
+
+    // reader_start_fd state.
+    int fd;
+    off_t off;
+    off_t advised;
+};
+
+static atomic_int reader_blocking;
+
+void reader_set_blocking(int on) {
+    atomic_store(&reader_blocking, on);
+}
+
+static ssize_t fd_fill(void *ctx, uint8_t *dst, size_t cap, uint8_t *flags) {
+    reader_t *r = ctx;
+    (void)flags;
+
+    if (r->off + (off_t)READER_READAHEAD > r->advised) {
+        posix_fadvise(r->fd, r->advised, READER_READAHEAD, POSIX_FADV_WILLNEED);
+        r->advised += READER_READAHEAD;
+    }
+
+    // Full chunks until the last one, like fread.
+    size_t got = 0;
+    while (got < cap) {
+        ssize_t n = pread(r->fd, dst + got, cap - got, r->off + (off_t)got);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+    r->off += (off_t)got;
+    return (ssize_t)got;
+}
+
+static void *reader_main(void *arg) {
+    reader_t *r = arg;
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    for (;;) {
+        if (head - atomic_load_explicit(&r->tail, memory_order_acquire) == r->depth) {
+            pthread_mutex_lock(&r->lock);
+            atomic_store(&r->prod_waiting, 1);
+            while (head - atomic_load(&r->tail) == r->depth && !atomic_load(&r->stop)) {
+                pthread_cond_wait(&r->space, &r->lock);
+            }
+            atomic_store(&r->prod_waiting, 0);
+            pthread_mutex_unlock(&r->lock);
+        }
+        if (atomic_load_explicit(&r->stop, memory_order_relaxed)) {
+            break;
+        }
+
+        reader_slot_t *slot = &r->slots[head % r->depth];
+        slot->flags = 0;
+        slot->len = r->fill(r->ctx, slot->data, r->chunk, &slot->flags);
+        atomic_store(&r->head, ++head);
+        if (atomic_load(&r->cons_waiting)) {
+            pthread_mutex_lock(&r->lock);
+            pthread_cond_signal(&r->ready);
+            pthread_mutex_unlock(&r->lock);
+        }
+        // End of input and errors are left in the ring for the consumer.
+        if (slot->len <= 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void reader_free(reader_t *r) {
+    pthread_cond_destroy(&r->ready);
+    pthread_cond_destroy(&r->space);
+    pthread_mutex_destroy(&r->lock);
+    free(r->slots);
+    free(r->pool);
+    free(r);
+}
+
+static reader_t *reader_new(reader_fill_fn fill, void *ctx, size_t chunk, size_t depth) {
+    if (!fill || chunk == 0 || depth == 0) {
+        return NULL;
+    }
+    reader_t *r = aligned_alloc(_Alignof(reader_t), sizeof(reader_t));
+    if (!r) {
+        return NULL;
+    }
+    memset(r, 0, sizeof(*r));
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->prod_waiting, 0);
+    atomic_init(&r->cons_waiting, 0);
+    atomic_init(&r->stop, 0);
+    r->fill = fill;
+    r->ctx = ctx;
+    r->chunk = chunk;
+    r->depth = depth;
+    r->fd = -1;
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->space, &ca);
+    pthread_cond_init(&r->ready, &ca);
+    pthread_condattr_destroy(&ca);
+
+    r->slots = calloc(depth, sizeof(reader_slot_t));
+    r->pool = malloc(depth * chunk);
+    if (!r->slots || !r->pool) {
+        reader_free(r);
+        return NULL;
+    }
+    for (size_t i = 0; i < depth; i++) {
+        r->slots[i].data = r->pool + i * chunk;
+    }
+    return r;
+}
+
+static reader_t *reader_launch(reader_t *r) {
+    if (r && pthread_create(&r->thread, NULL, reader_main, r) != 0) {
+        reader_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+reader_t *reader_start(reader_fill_fn fill, void *ctx, size_t chunk, size_t depth) {
+    return reader_launch(reader_new(fill, ctx, chunk, depth));
+}
+
+reader_t *reader_start_fd(int fd, size_t chunk, size_t depth) {
+    reader_t *r = reader_new(fd_fill, NULL, chunk, depth);
+    if (!r) {
+        return NULL;
+    }
+    r->ctx = r;
+    r->fd = fd;
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    r->off = start > 0 ? start : 0;
+    r->advised = r->off;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return reader_launch(r);
+}
+
+ssize_t reader_next(reader_t *r, uint8_t *dst, size_t cap, uint8_t *flags) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&r->head, memory_order_acquire)) {
+        if (!atomic_load(&reader_blocking)) {
+            return READER_AGAIN;
+        }
+        while (!reader_wait(r, 1000)) {
+        }
+    }
+
+    reader_slot_t *slot = &r->slots[tail % r->depth];
+    if (slot->len <= 0) {
+        // Sticky: every later call reports the same end of input or error.
+        return slot->len;
+    }
+    size_t len = (size_t)slot->len < cap ? (size_t)slot->len : cap;
+    memcpy(dst, slot->data, len);
+    if (flags) {
+        *flags = slot->flags;
+    }
+
+    atomic_store(&r->tail, tail + 1);
+    if (atomic_load(&r->prod_waiting)) {
+        pthread_mutex_lock(&r->lock);
+        pthread_cond_signal(&r->space);
+        pthread_mutex_unlock(&r->lock);
+    }
+    return (ssize_t)len;
+}
+
+int reader_wait(reader_t *r, int timeout_ms) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (tail != atomic_load_explicit(&r->head, memory_order_acquire)) {
+        return 1;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    atomic_store(&r->cons_waiting, 1);
+    while (tail == atomic_load(&r->head)) {
+        if (pthread_cond_timedwait(&r->ready, &r->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    atomic_store(&r->cons_waiting, 0);
+    pthread_mutex_unlock(&r->lock);
+    return tail != atomic_load(&r->head);
+}
+
+void reader_stop(reader_t *r) {
+    if (!r) {
+        return;
+    }
+    pthread_mutex_lock(&r->lock);
+    atomic_store(&r->stop, 1);
+    pthread_cond_signal(&r->space);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+    reader_free(r);
+}
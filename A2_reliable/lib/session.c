@@ -0,0 +1,165 @@
+#define _POSIX_C_SOURCE 200809L
+#include "session.h"
+#include "clock.h"
+#include "netif.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SESSION_CONNECT_MS 5000
+
+uint32_t session_new_id(void) {
+    // splitmix64 over the clock and pid: distinct for runs that share a port.
+    uint64_t z = clock_now_ns() ^ ((uint64_t)getpid() << 32);
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (uint32_t)z ? (uint32_t)z : 1;
+}
+
+int session_send_syn(int sock, const pkt_syn_t *offer) {
+    uint8_t buf[PKT_HDR_LEN + PKT_SYN_LEN];
+    size_t syn_len = pkt_build_syn(buf, sizeof(buf), offer);
+    if (syn_len == 0 || netif_send(sock, buf, syn_len) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int session_connect(int sock, const pkt_syn_t *offer, int rto_ms, pkt_syn_t *agreed) {
+    uint8_t recvbuf[PKT_HDR_LEN + PKT_SYN_LEN];
+
+    uint64_t start = clock_now_ms();
+    uint64_t last_send = 0;
+    while (clock_now_ms() - start < SESSION_CONNECT_MS) {
+        uint64_t now = clock_now_ms();
+        if (last_send == 0 || now - last_send >= (uint64_t)rto_ms) {
+            // No answer yet: maybe the emulator never got our HELLO.
+            if (last_send != 0 && netif_rehello(sock) != 0) {
+                return -1;
+            }
+            if (session_send_syn(sock, offer) != 0) {
+                return -1;
+            }
+            last_send = now;
+        }
+
+        ssize_t n = netif_recv(sock, recvbuf, sizeof(recvbuf), 50);
+        if (n <= 0) {
+            continue;
+        }
+
+        pkt_hdr_t hdr;
+        const uint8_t *body = NULL;
+        uint16_t body_len = 0;
+        if (pkt_parse(recvbuf, (size_t)n, &hdr, &body, &body_len) != 0 ||
+            hdr.type != PKT_TYPE_SYNACK) {
+            continue;
+        }
+
+        if (pkt_parse_syn(body, body_len, agreed) != 0 || agreed->payload > offer->payload) {
+            return -1;
+        }
+        // A late answer to an earlier transfer from this port.
+        if (body_len >= PKT_SYN_LEN && agreed->session != offer->session) {
+            continue;
+        }
+        // An old receiver answers with the payload only.
+        if (body_len < PKT_SYN_LEN_V2) {
+            agreed->window = offer->window;
+            agreed->start_seq = offer->start_seq;
+        }
+        if (!(agreed->features & PKT_FEAT_RESUME) ||
+            agreed->resume_seq - agreed->start_seq > INT32_MAX) {
+            agreed->resume_seq = agreed->start_seq;
+        }
+        if (agreed->window == 0 || agreed->window > offer->window) {
+            agreed->window = offer->window;
+        }
+        pkt_set_payload_limit(agreed->payload);
+        return 0;
+    }
+    return -1;
+}
+
+int session_check(const pkt_syn_t *offer, const pkt_syn_t *agreed, uint8_t required) {
+    if (offer->ack_mode && agreed->ack_mode && agreed->ack_mode != offer->ack_mode) {
+        fprintf(stderr, "receiver uses %s ACKs\n",
+                agreed->ack_mode == PKT_ACK_CUMULATIVE ? "cumulative" : "selective");
+        return -1;
+    }
+    if ((agreed->features & required) != required) {
+        fprintf(stderr, "receiver does not support this mode (features 0x%02x)\n",
+                (unsigned)agreed->features);
+        return -1;
+    }
+    return 0;
+}
+
+int session_answer(const pkt_syn_t *syn, const pkt_syn_t *local, pkt_syn_t *agreed) {
+    *agreed = *syn;
+    if (agreed->payload > local->payload) {
+        agreed->payload = local->payload;
+    }
+    if (local->window && (agreed->window == 0 || agreed->window > local->window)) {
+        agreed->window = local->window;
+    }
+    agreed->ack_mode = local->ack_mode;
+    agreed->features = syn->features & local->features & (uint8_t)~PKT_FEAT_ZERO_RTT;
+
+    // 0-RTT DATA was built with the offered parameters; keep it only if
+    // they all stand. Otherwise the data starts after the window the
+    // sender may already have sent.
+    if (syn->features & PKT_FEAT_ZERO_RTT) {
+        uint8_t wanted = syn->features & (uint8_t)~PKT_FEAT_ZERO_RTT;
+        if (agreed->payload == syn->payload && agreed->window == syn->window &&
+            (syn->ack_mode == 0 || syn->ack_mode == local->ack_mode) &&
+            agreed->features == wanted) {
+            agreed->features |= PKT_FEAT_ZERO_RTT;
+        } else {
+            agreed->start_seq = syn->start_seq + syn->window;
+        }
+    }
+
+    // Resume only into the same file layout: the checkpoint in local was
+    // cut at local->payload bytes per packet from the same start_seq.
+    agreed->resume_seq = agreed->start_seq;
+    if ((agreed->features & PKT_FEAT_RESUME) && !(syn->features & PKT_FEAT_ZERO_RTT) &&
+        agreed->start_seq == local->start_seq && agreed->payload == local->payload) {
+        agreed->resume_seq = local->resume_seq;
+    }
+    return 0;
+}
+
+int session_accept(int sock, const uint8_t *syn_payload, uint16_t syn_len,
+                   const pkt_syn_t *local, pkt_syn_t *agreed) {
+    pkt_syn_t syn;
+    if (pkt_parse_syn(syn_payload, syn_len, &syn) != 0) {
+        return -1;
+    }
+    session_answer(&syn, local, agreed);
+
+    uint8_t buf[PKT_HDR_LEN + PKT_SYN_LEN];
+    size_t len = pkt_build_synack(buf, sizeof(buf), agreed);
+    if (len > 0) {
+        netif_send(sock, buf, len);
+    }
+    pkt_set_payload_limit(agreed->payload);
+    return 0;
+}
+
+int session_reanswer(int sock, const uint8_t *syn_payload, uint16_t syn_len,
+                     const pkt_syn_t *agreed) {
+    pkt_syn_t syn;
+    if (pkt_parse_syn(syn_payload, syn_len, &syn) != 0 || syn.session != agreed->session) {
+        return -1;
+    }
+    uint8_t buf[PKT_HDR_LEN + PKT_SYN_LEN];
+    size_t len = pkt_build_synack(buf, sizeof(buf), agreed);
+    if (len > 0) {
+        netif_send(sock, buf, len);
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+#define _GNU_SOURCE
+#include "stats.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "clock.h"
+
+static void shm_name(char *name, size_t cap, int port) {
+    snprintf(name, cap, "/" STATS_SHM_PREFIX "%d", port);
+}
+
+stats_page_t *stats_open(int port, uint8_t role, const char *mode) {
+    const char *on = getenv("RDT_STATS");
+    if (!on || !*on || strcmp(on, "0") == 0) {
+        return NULL;
+    }
+    char name[64];
+    shm_name(name, sizeof(name), port);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("shm_open");
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(stats_page_t)) != 0) {
+        perror("ftruncate");
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    stats_page_t *st = mmap(NULL, sizeof(stats_page_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (st == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(name);
+        return NULL;
+    }
+    // The segment is fresh and zeroed; the magic goes in last so that a
+    // viewer never takes a half-initialised page for a live one.
+    st->size = sizeof(stats_page_t);
+    st->pid = (int32_t)getpid();
+    st->port = (uint16_t)port;
+    st->role = role;
+    snprintf(st->mode, sizeof(st->mode), "%s", mode);
+    st->update_ns = clock_now_ns();
+    atomic_thread_fence(memory_order_release);
+    memcpy(st->magic, STATS_MAGIC, sizeof(st->magic));
+    return st;
+}
+
+void stats_close(stats_page_t *st) {
+    if (!st) {
+        return;
+    }
+    char name[64];
+    shm_name(name, sizeof(name), st->port);
+    stats_begin(st);
+    st->done = 1;
+    st->update_ns = clock_now_ns();
+    stats_end(st);
+    munmap(st, sizeof(stats_page_t));
+    shm_unlink(name);
+}
+
+int stats_read(const stats_page_t *st, stats_page_t *out) {
+    for (int tries = 0; tries < 1000; tries++) {
+        uint32_t s1 = atomic_load_explicit(&st->seq, memory_order_acquire);
+        if (s1 & 1) {
+            continue;
+        }
+        memcpy(out, (const void *)st, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        uint32_t s2 = atomic_load_explicit(&st->seq, memory_order_relaxed);
+        if (s1 == s2) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void stats_rtt_sample(stats_page_t *st, uint64_t rtt_ns) {
+    st->lat_hist[stats_lat_bucket(rtt_ns / 1000)]++;
+    st->lat_count++;
+    if (rtt_ns > st->lat_max_ns) {
+        st->lat_max_ns = rtt_ns;
+    }
+    if (st->srtt_ns == 0) {
+        st->srtt_ns = rtt_ns;
+        st->rttvar_ns = rtt_ns / 2;
+        return;
+    }
+    uint64_t err = rtt_ns > st->srtt_ns ? rtt_ns - st->srtt_ns : st->srtt_ns - rtt_ns;
+    st->rttvar_ns = (3 * st->rttvar_ns + err) / 4;
+    st->srtt_ns = (7 * st->srtt_ns + rtt_ns) / 8;
+}
+
+uint64_t stats_lat_quantile_us(const uint64_t *hist, uint64_t count, uint64_t max_ns, double q) {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t want = (uint64_t)(q * (double)count);
+    if (want == 0) {
+        want = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_LAT_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= want) {
+            // The bucket's upper edge, never past the largest sample.
+            uint64_t us = stats_lat_floor(i + 1) - 1;
+            return us < max_ns / 1000 ? us : max_ns / 1000;
+        }
+    }
+    return max_ns / 1000;
+}
+
+void stats_lat_add(stats_lat_t *l, uint64_t ns) {
+    l->hist[stats_lat_bucket(ns / 1000)]++;
+    l->count++;
+    if (ns > l->max_ns) {
+        l->max_ns = ns;
+    }
+}
+
+void stats_lat_report(const stats_lat_t *l, FILE *out) {
+    static const struct {
+        const char *name;
+        double q;
+    } qs[] = {{"P50", 0.50}, {"P90", 0.90}, {"P99", 0.99}, {"P999", 0.999}};
+    fprintf(out, "ACK_LAT_SAMPLES=%llu\n", (unsigned long long)l->count);
+    for (size_t i = 0; i < sizeof(qs) / sizeof(qs[0]); i++) {
+        fprintf(out, "ACK_LAT_%s_US=%llu\n", qs[i].name,
+                (unsigned long long)stats_lat_quantile_us(l->hist, l->count, l->max_ns, qs[i].q));
+    }
+    fprintf(out, "ACK_LAT_MAX_US=%llu\n", (unsigned long long)(l->max_ns / 1000));
+}
@@ -0,0 +1,97 @@
+#define _POSIX_C_SOURCE 200809L
+#include "trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+_Thread_local trace_buf_t *trace_tls;
+
+// The key's destructor flushes a thread's buffer when the thread ends;
+// atexit does it for the thread that calls exit.
+static pthread_key_t trace_key;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void trace_end(void *arg) {
+    trace_buf_t *tb = arg;
+    trace_flush(tb);
+    close(tb->fd);
+    free(tb);
+}
+
+static void trace_exit(void) {
+    trace_buf_t *tb = trace_tls;
+    if (tb) {
+        trace_tls = NULL;
+        pthread_setspecific(trace_key, NULL);
+        trace_end(tb);
+    }
+}
+
+static void trace_init(void) {
+    pthread_key_create(&trace_key, trace_end);
+    atexit(trace_exit);
+}
+
+void trace_start(int port) {
+    const char *prefix = getenv("RDT_TRACE");
+    if (!prefix || !*prefix || trace_tls) {
+        return;
+    }
+    pthread_once(&trace_once, trace_init);
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.%d", prefix, port);
+    trace_buf_t *tb = malloc(sizeof(*tb));
+    if (!tb) {
+        return;
+    }
+    tb->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (tb->fd < 0) {
+        perror(path);
+        free(tb);
+        return;
+    }
+    trace_file_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    hdr.rec_size = sizeof(trace_rec_t);
+    hdr.port = (uint32_t)port;
+    if (write_all(tb->fd, &hdr, sizeof(hdr)) != 0) {
+        perror(path);
+        close(tb->fd);
+        free(tb);
+        return;
+    }
+    tb->port = (uint16_t)port;
+    tb->n = 0;
+    trace_tls = tb;
+    pthread_setspecific(trace_key, tb);
+}
+
+void trace_flush(trace_buf_t *tb) {
+    if (tb->n > 0 && write_all(tb->fd, tb->recs, tb->n * sizeof(trace_rec_t)) != 0) {
+        perror("trace");
+    }
+    tb->n = 0;
+}
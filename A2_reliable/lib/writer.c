@@ -0,0 +1,286 @@
+#define _GNU_SOURCE
+#include "writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Largest single write, and how long a partial block may sit in the ring
+// before a buffered (non-O_DIRECT) writer flushes it anyway.
+#define WRITER_MAX_IO (4u * WRITER_BLOCK)
+#define WRITER_FLUSH_MS 20
+
+struct writer {
+    // head: bytes queued (network thread); tail: bytes on disk (writer
+    // thread). Both are also file offsets.
+    _Alignas(64) atomic_uint_fast64_t head;
+    _Alignas(64) atomic_uint_fast64_t tail;
+    _Alignas(64) atomic_int prod_waiting;
+    atomic_int cons_waiting;
+    atomic_int closing;
+    atomic_int failed;
+
+    // Sleeping only: the ring itself is lock-free.
+    pthread_mutex_t lock;
+    pthread_cond_t space;
+    pthread_cond_t data;
+    pthread_t thread;
+
+    uint8_t *ring;
+    int fd;
+    int direct;
+    int fsync_mb;
+    uint64_t synced;
+};
+
+static void deadline_in(struct timespec *ts, int timeout_ms) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec += 1;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static int write_all(int fd, const uint8_t *buf, size_t len, uint64_t off) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, (off_t)off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+        off += (uint64_t)n;
+    }
+    return 0;
+}
+
+static void *writer_main(void *arg) {
+    writer_t *w = arg;
+    uint64_t tail = atomic_load_explicit(&w->tail, memory_order_relaxed);
+    int flush_partial = 0;
+
+    for (;;) {
+        uint64_t head = atomic_load_explicit(&w->head, memory_order_acquire);
+        int closing = atomic_load(&w->closing);
+        uint64_t avail = head - tail;
+
+        // Whole blocks go out as soon as they are complete; a partial block
+        // only at close (O_DIRECT) or after sitting for WRITER_FLUSH_MS.
+        uint64_t n = avail - avail % WRITER_BLOCK;
+        if (n == 0 && avail > 0 && (closing || (flush_partial && !w->direct))) {
+            n = avail;
+        }
+        if (n == 0) {
+            if (closing) {
+                break;
+            }
+            struct timespec deadline;
+            deadline_in(&deadline, WRITER_FLUSH_MS);
+            pthread_mutex_lock(&w->lock);
+            atomic_store(&w->cons_waiting, 1);
+            int rc = 0;
+            while (atomic_load(&w->head) - tail < WRITER_BLOCK && !atomic_load(&w->closing) &&
+                   rc != ETIMEDOUT) {
+                rc = pthread_cond_timedwait(&w->data, &w->lock, &deadline);
+            }
+            atomic_store(&w->cons_waiting, 0);
+            pthread_mutex_unlock(&w->lock);
+            flush_partial = (rc == ETIMEDOUT);
+            continue;
+        }
+        flush_partial = 0;
+
+        size_t off = (size_t)(tail % WRITER_RING);
+        if (n > WRITER_RING - off) {
+            n = WRITER_RING - off;
+        }
+        if (n > WRITER_MAX_IO) {
+            n = WRITER_MAX_IO;
+        }
+        if (w->direct && n % WRITER_BLOCK != 0) {
+            // The file tail is not block sized: finish it through the page cache.
+            int fl = fcntl(w->fd, F_GETFL);
+            fcntl(w->fd, F_SETFL, fl & ~O_DIRECT);
+            w->direct = 0;
+        }
+        if (write_all(w->fd, w->ring + off, (size_t)n, tail) != 0) {
+            perror("write");
+            atomic_store(&w->failed, 1);
+        }
+        tail += n;
+
+        atomic_store(&w->tail, tail);
+        if (atomic_load(&w->prod_waiting)) {
+            pthread_mutex_lock(&w->lock);
+            pthread_cond_signal(&w->space);
+            pthread_mutex_unlock(&w->lock);
+        }
+        if (atomic_load(&w->failed)) {
+            break;
+        }
+
+        if (w->fsync_mb > 0 && tail - w->synced >= (uint64_t)w->fsync_mb << 20) {
+            fdatasync(w->fd);
+            w->synced = tail;
+        }
+    }
+    return NULL;
+}
+
+static void writer_free(writer_t *w) {
+    pthread_cond_destroy(&w->data);
+    pthread_cond_destroy(&w->space);
+    pthread_mutex_destroy(&w->lock);
+    free(w->ring);
+    free(w);
+}
+
+writer_t *writer_open(const char *path, int direct, int fsync_mb) {
+    return writer_open_at(path, direct, fsync_mb, 0);
+}
+
+writer_t *writer_open_at(const char *path, int direct, int fsync_mb, uint64_t offset) {
+    writer_t *w = aligned_alloc(_Alignof(writer_t), sizeof(writer_t));
+    if (!w) {
+        return NULL;
+    }
+    memset(w, 0, sizeof(*w));
+    atomic_init(&w->head, offset);
+    atomic_init(&w->tail, offset);
+    atomic_init(&w->prod_waiting, 0);
+    atomic_init(&w->cons_waiting, 0);
+    atomic_init(&w->closing, 0);
+    atomic_init(&w->failed, 0);
+    w->fsync_mb = fsync_mb;
+    w->synced = offset;
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->space, &ca);
+    pthread_cond_init(&w->data, &ca);
+    pthread_condattr_destroy(&ca);
+
+    // Page aligned so whole blocks can be handed to O_DIRECT as they are.
+    w->ring = aligned_alloc(4096, WRITER_RING);
+    if (!w->ring) {
+        writer_free(w);
+        return NULL;
+    }
+
+    w->fd = -1;
+    int keep = offset ? 0 : O_TRUNC;
+    if (direct && offset % 4096 == 0) {
+        w->fd = open(path, O_WRONLY | O_CREAT | keep | O_DIRECT, 0644);
+        w->direct = (w->fd >= 0);
+    }
+    if (w->fd < 0) {
+        w->fd = open(path, O_WRONLY | O_CREAT | keep, 0644);
+    }
+    if (w->fd < 0 || (offset && ftruncate(w->fd, (off_t)offset) != 0)) {
+        perror(path);
+        if (w->fd >= 0) {
+            close(w->fd);
+        }
+        writer_free(w);
+        return NULL;
+    }
+
+    if (pthread_create(&w->thread, NULL, writer_main, w) != 0) {
+        close(w->fd);
+        writer_free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int writer_direct(const writer_t *w) {
+    return w->direct;
+}
+
+int writer_put(writer_t *w, const void *data, size_t len) {
+    if (atomic_load_explicit(&w->failed, memory_order_relaxed)) {
+        return -1;
+    }
+    uint64_t head = atomic_load_explicit(&w->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&w->tail, memory_order_acquire);
+    if (len > WRITER_RING - (head - tail)) {
+        return WRITER_FULL;
+    }
+
+    size_t off = (size_t)(head % WRITER_RING);
+    size_t first = len < WRITER_RING - off ? len : WRITER_RING - off;
+    memcpy(w->ring + off, data, first);
+    memcpy(w->ring, (const uint8_t *)data + first, len - first);
+
+    atomic_store(&w->head, head + len);
+    // Wake the writer once a block is complete; partial blocks wait for
+    // its flush timer.
+    if (head / WRITER_BLOCK != (head + len) / WRITER_BLOCK && atomic_load(&w->cons_waiting)) {
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_signal(&w->data);
+        pthread_mutex_unlock(&w->lock);
+    }
+    return 0;
+}
+
+size_t writer_room(writer_t *w) {
+    uint64_t head = atomic_load_explicit(&w->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&w->tail, memory_order_acquire);
+    return (size_t)(WRITER_RING - (head - tail));
+}
+
+uint64_t writer_written(writer_t *w) {
+    return atomic_load_explicit(&w->tail, memory_order_acquire);
+}
+
+int writer_wait(writer_t *w, size_t len, int timeout_ms) {
+    struct timespec deadline;
+    deadline_in(&deadline, timeout_ms);
+
+    pthread_mutex_lock(&w->lock);
+    atomic_store(&w->prod_waiting, 1);
+    int rc = 0;
+    while (len > WRITER_RING - (atomic_load(&w->head) - atomic_load(&w->tail)) &&
+           !atomic_load(&w->failed) && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&w->space, &w->lock, &deadline);
+    }
+    atomic_store(&w->prod_waiting, 0);
+    pthread_mutex_unlock(&w->lock);
+    return len <= WRITER_RING - (atomic_load(&w->head) - atomic_load(&w->tail));
+}
+
+int writer_close(writer_t *w) {
+    if (!w) {
+        return 0;
+    }
+    pthread_mutex_lock(&w->lock);
+    atomic_store(&w->closing, 1);
+    pthread_cond_signal(&w->data);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    int failed = atomic_load(&w->failed);
+    if (w->fsync_mb >= 0 && !failed && fsync(w->fd) != 0) {
+        perror("fsync");
+        failed = 1;
+    }
+    if (close(w->fd) != 0) {
+        failed = 1;
+    }
+    writer_free(w);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,212 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stats.h"
+
+// Live view of the stats pages that GBN/SR endpoints publish under
+// /dev/shm when RDT_STATS is set (include/stats.h). Pages are only
+// mapped and read, so watching a transfer never slows it down. A page
+// whose endpoint has finished is shown once more with its final values.
+
+#define TOP_MAX_PAGES 128
+
+typedef struct {
+    char name[NAME_MAX + 1];
+    ino_t ino;
+    const stats_page_t *page;
+    bool seen_done;
+    uint64_t prev_bytes;
+    uint64_t prev_ns;
+} top_entry_t;
+
+static top_entry_t entries[TOP_MAX_PAGES];
+static size_t nentries;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--interval MS] [--once] [--port PORT]\n", prog);
+}
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void drop_entry(size_t i) {
+    munmap((void *)entries[i].page, sizeof(stats_page_t));
+    entries[i] = entries[--nentries];
+}
+
+static top_entry_t *find_entry(const char *name) {
+    for (size_t i = 0; i < nentries; i++) {
+        if (strcmp(entries[i].name, name) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Map every page under /dev/shm not mapped yet. A name that now belongs
+// to a new segment (the port was reused) replaces the old mapping.
+static void scan_pages(void) {
+    DIR *d = opendir("/dev/shm");
+    if (!d) {
+        perror("/dev/shm");
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (strncmp(de->d_name, STATS_SHM_PREFIX, strlen(STATS_SHM_PREFIX)) != 0) {
+            continue;
+        }
+        char path[NAME_MAX + 2];
+        snprintf(path, sizeof(path), "/%s", de->d_name);
+        int fd = shm_open(path, O_RDONLY, 0);
+        if (fd < 0) {
+            continue;
+        }
+        struct stat sb;
+        top_entry_t *e = find_entry(de->d_name);
+        if (fstat(fd, &sb) != 0 || sb.st_size != (off_t)sizeof(stats_page_t) ||
+            (e && e->ino == sb.st_ino)) {
+            close(fd);
+            continue;
+        }
+        const stats_page_t *page = mmap(NULL, sizeof(stats_page_t), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (page == MAP_FAILED) {
+            continue;
+        }
+        if (memcmp(page->magic, STATS_MAGIC, sizeof(page->magic)) != 0 ||
+            page->size != sizeof(stats_page_t)) {
+            munmap((void *)page, sizeof(stats_page_t));
+            continue;
+        }
+        if (e) {
+            munmap((void *)e->page, sizeof(stats_page_t));
+        } else if (nentries < TOP_MAX_PAGES) {
+            e = &entries[nentries++];
+        } else {
+            munmap((void *)page, sizeof(stats_page_t));
+            continue;
+        }
+        memset(e, 0, sizeof(*e));
+        snprintf(e->name, sizeof(e->name), "%s", de->d_name);
+        e->ino = sb.st_ino;
+        e->page = page;
+    }
+    closedir(d);
+}
+
+// Latency in ms at quantile q of the histogram (lower edge of its bucket).
+static double lat_quantile(const stats_page_t *s, double q) {
+    return (double)stats_lat_quantile_us(s->lat_hist, s->lat_count, s->lat_max_ns, q) / 1000.0;
+}
+
+static int cmp_port(const void *a, const void *b) {
+    const top_entry_t *x = a;
+    const top_entry_t *y = b;
+    return (int)x->page->port - (int)y->page->port;
+}
+
+static void show(int only_port, bool clear) {
+    if (clear) {
+        fputs("\033[H\033[J", stdout);
+    }
+    printf("%-5s %-4s %-4s %7s %-4s %9s %6s %5s %9s %7s %9s %9s %9s %7s %6s %7s %7s %7s\n",
+           "PORT", "ROLE", "MODE", "PID", "STAT", "BASE", "INFLT", "CWND", "SENT", "RETX", "RECV",
+           "MBYTES", "KBPS", "SRTT_MS", "RTO_MS", "P50_MS", "P99_MS", "MAX_MS");
+    qsort(entries, nentries, sizeof(entries[0]), cmp_port);
+    uint64_t now = mono_ns();
+    for (size_t i = 0; i < nentries;) {
+        top_entry_t *e = &entries[i];
+        stats_page_t s;
+        if (stats_read(e->page, &s) != 0 || (only_port > 0 && s.port != only_port)) {
+            i++;
+            continue;
+        }
+        const char *state = "run";
+        if (s.done) {
+            state = "done";
+        } else if (kill(s.pid, 0) != 0 && errno == ESRCH) {
+            state = "dead";
+        }
+        // Rate over the last refresh, from this viewer's clock.
+        double kbps = 0.0;
+        if (e->prev_ns && now > e->prev_ns && s.bytes_delivered >= e->prev_bytes) {
+            kbps = (double)(s.bytes_delivered - e->prev_bytes) * 8.0 * 1e6 / (double)(now - e->prev_ns);
+        }
+        e->prev_ns = now;
+        e->prev_bytes = s.bytes_delivered;
+        bool sender = s.role == STATS_SENDER;
+        printf("%-5u %-4s %-4.4s %7d %-4s %9llu %6llu %5llu %9llu %7llu %9llu %9.2f %9.1f",
+               (unsigned)s.port, sender ? "snd" : "rcv", s.mode, (int)s.pid, state,
+               (unsigned long long)s.base, (unsigned long long)s.inflight,
+               (unsigned long long)s.cwnd, (unsigned long long)s.pkts_sent,
+               (unsigned long long)s.pkts_retx, (unsigned long long)s.pkts_recv,
+               (double)s.bytes_delivered / 1e6, kbps);
+        if (sender) {
+            printf(" %7.2f %6llu %7.2f %7.2f %7.2f\n", (double)s.srtt_ns / 1e6,
+                   (unsigned long long)s.rto_ms, lat_quantile(&s, 0.50), lat_quantile(&s, 0.99),
+                   (double)s.lat_max_ns / 1e6);
+        } else {
+            printf(" %7s %6s %7s %7s %7s\n", "-", "-", "-", "-", "-");
+        }
+        // Finished pages are shown once with their final values, then dropped.
+        if (s.done && e->seen_done) {
+            drop_entry(i);
+            continue;
+        }
+        e->seen_done = s.done;
+        i++;
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    int interval_ms = 1000;
+    bool once = false;
+    int only_port = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--once") == 0) {
+            once = true;
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            only_port = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (interval_ms <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (;;) {
+        scan_pages();
+        show(only_port, !once);
+        if (once) {
+            break;
+        }
+        struct timespec ts = {interval_ms / 1000, (long)(interval_ms % 1000) * 1000000L};
+        nanosleep(&ts, NULL);
+    }
+    while (nentries > 0) {
+        drop_entry(nentries - 1);
+    }
+    return 0;
+}
@@ -1,6 +1,8 @@
 #define _POSIX_C_SOURCE 200809L
+#include "clock.h"
 #include "netif.h"
 #include "protocol.h"
+#include "session.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,21 +13,16 @@
 
 static void usage(const char *prog) {
     fprintf(stderr,
-            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT --out FILE\n",
+            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT --out FILE [--mss BYTES]\n",
             prog);
 }
 
-static uint64_t now_ms(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)(ts.tv_nsec / 1000000ULL);
-}
-
 int main(int argc, char **argv) {
     int listen_port = -1;
     const char *peer_ip = NULL;
     int peer_port = -1;
     const char *out_path = NULL;
+    int mss = MAX_PAYLOAD;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
@@ -36,13 +33,16 @@ int main(int argc, char **argv) {
             peer_port = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
             out_path = argv[++i];
+        } else if (strcmp(argv[i], "--mss") == 0 && i + 1 < argc) {
+            mss = atoi(argv[++i]);
         } else {
             usage(argv[0]);
             return 1;
         }
     }
 
-    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || !out_path) {
+    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || !out_path ||
+        mss <= 0 || mss > MAX_PAYLOAD) {
         usage(argv[0]);
         return 1;
     }
@@ -73,9 +73,20 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    uint8_t recvbuf[PKT_HDR_LEN + MAX_PAYLOAD];
+    // Largest payload we accept; the SYN exchange may settle on less.
+    pkt_set_payload_limit((uint16_t)mss);
+    size_t buf_cap = PKT_HDR_LEN + (size_t)mss;
+    uint8_t *recvbuf = malloc(buf_cap);
+    if (!recvbuf) {
+        perror("malloc");
+        fclose(out);
+        close(sock);
+        return 1;
+    }
 
     uint32_t expected = 0;
+    // DATA counts only once a SYN has fixed the session parameters.
+    int session_up = 0;
     int done = 0;
     int fin_seen = 0;
     uint64_t fin_deadline_ms = 0;
@@ -87,7 +98,7 @@ int main(int argc, char **argv) {
     while (!done) {
         int timeout_ms = -1;
         if (fin_seen) {
-            uint64_t now = now_ms();
+            uint64_t now = clock_now_ms();
             if (now >= fin_deadline_ms) {
                 done = 1;
                 break;
@@ -96,7 +107,7 @@ int main(int argc, char **argv) {
         }
 
         // Receive a packet with optional timeout.
-        ssize_t n = netif_recv(sock, recvbuf, sizeof(recvbuf), timeout_ms);
+        ssize_t n = netif_recv(sock, recvbuf, buf_cap, timeout_ms);
         if (n < 0) {
             perror("recv");
             break;
@@ -112,7 +123,7 @@ int main(int argc, char **argv) {
         if (pkt_parse(recvbuf, (size_t)n, &hdr, &payload, &payload_len) != 0) {
             continue;
         }
-        if (hdr.type == PKT_TYPE_DATA) {
+        if (hdr.type == PKT_TYPE_DATA && session_up) {
             // We received an DATA packet, write it to the output file
 			if (payload_len > 0) {
 				fwrite(payload, 1, payload_len, out);
@@ -122,7 +133,7 @@ int main(int argc, char **argv) {
 			// Here we implement an example ACK send call 
             // TODO(student): change ACK policy according to GBN or SR
 
-            uint8_t ackbuf[PKT_HDR_LEN + MAX_PAYLOAD];
+            uint8_t ackbuf[PKT_HDR_LEN];
             uint32_t ack_no = hdr.seq + 1;
             size_t pktlen = pkt_build_ack(ackbuf, sizeof(ackbuf), ack_no);
             if (pktlen > 0) {
@@ -131,16 +142,25 @@ int main(int argc, char **argv) {
         } else if (hdr.type == PKT_TYPE_FIN) {
 			// We receive an FIN packet
             // FIN marks end of file; reply with FINACK.
-            uint8_t finbuf[PKT_HDR_LEN + MAX_PAYLOAD];
+            uint8_t finbuf[PKT_HDR_LEN];
             size_t pktlen = pkt_build_finack(finbuf, sizeof(finbuf), expected);
             if (pktlen > 0) {
                 netif_send(sock, finbuf, pktlen);
             }
             fin_seen = 1;
-            fin_deadline_ms = now_ms() + 1000;
+            fin_deadline_ms = clock_now_ms() + 1000;
+        } else if (hdr.type == PKT_TYPE_SYN) {
+            // Answer every SYN: a lost SYNACK makes the sender resend it.
+            pkt_syn_t local = {(uint16_t)mss, 0, PKT_ACK_CUMULATIVE, 0, 0, 0, 0};
+            pkt_syn_t agreed;
+            if (session_accept(sock, payload, payload_len, &local, &agreed) == 0 && !session_up) {
+                expected = agreed.start_seq;
+                session_up = 1;
+            }
         }
     }
 
+    free(recvbuf);
     fclose(out);
     close(sock);
     return done ? 0 : 1;
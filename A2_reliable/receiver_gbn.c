@@ -1,6 +1,15 @@
 #define _POSIX_C_SOURCE 200809L
+#include "checkpoint.h"
+#include "clock.h"
+#include "cpu.h"
+#include "lz.h"
 #include "netif.h"
 #include "protocol.h"
+#include "session.h"
+#include "sha256.h"
+#include "stats.h"
+#include "trace.h"
+#include "writer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,21 +21,22 @@
 
 static void usage(const char *prog) {
     fprintf(stderr,
-            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT --out FILE\n",
+            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT --out FILE [--mss BYTES] [--gro] [--odirect] [--fsync MB] [--resume]\n       [--busy_poll US] [--cpu N]\n",
             prog);
 }
 
-static uint64_t now_ms(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)(ts.tv_nsec / 1000000ULL);
-}
-
 int main(int argc, char **argv) {
     int listen_port = -1;
     const char *peer_ip = NULL;
     int peer_port = -1;
     const char *out_path = NULL;
+    int mss = MAX_PAYLOAD;
+    int use_gro = 0;
+    int use_direct = 0;
+    int fsync_mb = -1;
+    int resume = 0;
+    int busy_poll_us = 0;
+    int cpu = -1;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
@@ -37,59 +47,143 @@ int main(int argc, char **argv) {
             peer_port = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
             out_path = argv[++i];
+        } else if (strcmp(argv[i], "--mss") == 0 && i + 1 < argc) {
+            mss = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gro") == 0) {
+            use_gro = 1;
+        } else if (strcmp(argv[i], "--odirect") == 0) {
+            use_direct = 1;
+        } else if (strcmp(argv[i], "--fsync") == 0 && i + 1 < argc) {
+            fsync_mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            resume = 1;
+        } else if (strcmp(argv[i], "--busy_poll") == 0 && i + 1 < argc) {
+            busy_poll_us = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            cpu = atoi(argv[++i]);
         } else {
             usage(argv[0]);
             return 1;
         }
     }
 #pragma region exception
-    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || !out_path) {
+    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || !out_path ||
+        mss <= 0 || mss > MAX_PAYLOAD || busy_poll_us < 0) {
         usage(argv[0]);
         return 1;
     }
 
-    FILE *out = fopen(out_path, "wb");
+    // With --resume, keep what an earlier run checkpointed; the SYN
+    // exchange decides whether the sender continues from there.
+    checkpoint_t ckpt = {0, 0, 0};
+    if (resume && (checkpoint_load(out_path, &ckpt) != 0 || ckpt.payload > mss)) {
+        ckpt.done = 0;
+    }
+    uint64_t kept = (uint64_t)ckpt.done * ckpt.payload;
+
+    // Payloads go to disk on a writer thread; see writer.h.
+    writer_t *out = writer_open_at(out_path, use_direct, fsync_mb, kept);
     if (!out) {
-        perror("fopen");
         return 1;
     }
+    if (use_direct && !writer_direct(out)) {
+        fprintf(stderr, "O_DIRECT unavailable, using buffered writes\n");
+    }
 
     // Create a UDP socket through the netif wrapper (emulator-aware).
     int sock = netif_socket();
     if (sock < 0) {
-        fclose(out);
+        writer_close(out);
         return 1;
     }
 
     // Bind local port for this receiver.
     if (netif_bind(sock, listen_port) != 0) {
-        fclose(out);
+        writer_close(out);
         close(sock);
         return 1;
     }
     // Tell emulator which peer port to forward to.
     if (netif_connect(sock, peer_ip, peer_port) != 0) {
-        fclose(out);
+        writer_close(out);
         close(sock);
         return 1;
     }
+    TRACE_START(listen_port);
+    stats_page_t *stats = stats_open(listen_port, STATS_RECEIVER, "gbn");
 #pragma endregion
 
-    uint8_t recvbuf[PKT_HDR_LEN + MAX_PAYLOAD];
+    // With --gro, netif splits coalesced datagrams back into packets.
+    if (use_gro && netif_enable_gro(sock) != 0) {
+        fprintf(stderr, "UDP GRO unavailable, receiving single datagrams\n");
+    }
+    // --busy_poll US: waits for DATA spin before they sleep.
+    if (busy_poll_us > 0 && netif_enable_busy_poll(sock, busy_poll_us) != 0) {
+        fprintf(stderr, "SO_BUSY_POLL unavailable, spinning in user space only\n");
+    }
+    // --cpu N: pin the event loop; the writer thread is already running
+    // and stays free to run elsewhere.
+    if (cpu >= 0 && cpu_pin(cpu) != 0) {
+        fprintf(stderr, "cannot pin to CPU %d\n", cpu);
+    }
+
+    // Largest payload we accept; the SYN exchange may settle on less.
+    pkt_set_payload_limit((uint16_t)mss);
+    size_t buf_cap = PKT_HDR_LEN + (size_t)mss;
+    uint8_t *recvbuf = malloc(buf_cap);
+    if (!recvbuf) {
+        perror("malloc");
+        writer_close(out);
+        close(sock);
+        return 1;
+    }
 
     uint32_t expected = 0;
+    // Agreed payload size, the unit of the advertised window.
+    size_t chunk = (size_t)mss;
+    // DATA counts only once a SYN has fixed the session parameters.
+    int session_up = 0;
+    pkt_syn_t established;          // the answer the session got
     int done = 0;
     int fin_seen = 0;
     uint64_t fin_deadline_ms = 0;
+    uint64_t data_rcvd = 0;
+    uint64_t acks_sent = 0;
+    uint64_t bytes_out = 0;
+    uint64_t next_ckpt_ms = 0;
+    // SHA-256 of the output file so far, compared with the one in the FIN.
+    // A resumed file starts with the digest of the part kept.
+    sha256_t digest;
+    int digest_usable = 0;
+    int digest_result = 0;    // 1 match, -1 mismatch
+    // Expanded PKT_FLAG_LZ payloads, one chunk long.
+    uint8_t *plain = NULL;
 
     // Basic receiver: accept in-order packets and send cumulative ACKs.
     // TODO(student): implement GBN/SR receiver logic here:
     //   - GBN: discard out-of-order, ACK last in-order
     //   - SR: buffer out-of-order, ACK each packet
     while (!done) {
-        int timeout_ms = -1;
+        if (stats) {
+            stats_begin(stats);
+            stats->update_ns = clock_now_ns();
+            stats->base = expected;
+            stats->pkts_sent = acks_sent;
+            stats->pkts_recv = data_rcvd;
+            stats->bytes_delivered = bytes_out;
+            stats_end(stats);
+        }
+        if (resume && session_up && clock_now_ms() >= next_ckpt_ms) {
+            uint32_t written = (uint32_t)(writer_written(out) / chunk);
+            if (written != ckpt.done) {
+                ckpt.done = written;
+                checkpoint_save(out_path, &ckpt);
+            }
+            next_ckpt_ms = clock_now_ms() + CHECKPOINT_INTERVAL_MS;
+        }
+        int timeout_ms = resume && session_up ? CHECKPOINT_INTERVAL_MS : -1;
         if (fin_seen) {
-            uint64_t now = now_ms();
+            uint64_t now = clock_now_ms();
             if (now >= fin_deadline_ms) {
                 done = 1;
                 break;
@@ -98,7 +192,7 @@ int main(int argc, char **argv) {
         }
 
         // Receive a packet with optional timeout.
-        ssize_t n = netif_recv(sock, recvbuf, sizeof(recvbuf), timeout_ms);
+        ssize_t n = netif_recv(sock, recvbuf, buf_cap, timeout_ms);
         if (n < 0) {
             perror("recv");
             break;
@@ -115,47 +209,139 @@ int main(int argc, char **argv) {
             continue;
         }
         
-        if (hdr.type == PKT_TYPE_DATA) { 
-            //printf("[RECV] seq=%u expected=%u\n", hdr.seq, expected);
-            //fflush(stdout);
+        if (hdr.type == PKT_TYPE_DATA && session_up) {
+            data_rcvd++;
+            TRACE(TRACE_DATA_RECV, hdr.seq, expected, 0, 0, payload_len, hdr.flags);
             // We received an DATA packet, write it to the output file
-            uint8_t ackbuf[PKT_HDR_LEN + MAX_PAYLOAD];
+            uint8_t ackbuf[PKT_HDR_LEN];
 
-            if(hdr.seq==expected){ //@@@@
+            // Only the packet the file goes on with is expanded; one that
+            // does not expand into a chunk counts as lost.
+            int in_order = hdr.seq == expected;
+            if (in_order && (hdr.flags & PKT_FLAG_LZ)) {
+                ssize_t m = plain ? lz_decompress(payload, payload_len, plain, chunk) : -1;
+                in_order = m >= 0;
+                if (in_order) {
+                    payload = plain;
+                    payload_len = (uint16_t)m;
+                }
+            }
 
-                if(payload_len>0){
-                    fwrite(payload,1,payload_len,out);
+            if(in_order){ //@@@@
+
+                // A full writer ring drops the packet like a loss, so the
+                // ACK below never waits on the disk.
+                int wr = payload_len > 0 ? writer_put(out, payload, payload_len) : 0;
+                if (wr == -1) {
+                    fprintf(stderr, "write failed\n");
+                    break;
                 }
-                
+
                 // expected : recieved data index -> send ack signal with expected val.
-                expected++; 
-                
+                if (wr == 0) {
+                    sha256_update(&digest, payload, payload_len);
+                    TRACE(TRACE_DELIVER, hdr.seq, expected + 1, 0, 0, payload_len, hdr.flags);
+                    expected++;
+                    bytes_out += payload_len;
+                }
             }
             
             // After we receive an DATA packet, we send an ACK
 			// Here we implement an example ACK send call 
             // TODO(student): change ACK policy according to GBN or SR
-            size_t pktlen = pkt_build_ack(ackbuf, sizeof(ackbuf), expected);
-            // printf("[RECV] send ACK=%u\n", expected);
-            // fflush(stdout);
+            // Echo a congestion mark so the sender can back off, and
+            // advertise as many packets past expected as the writer ring
+            // has room for.
+            size_t pktlen = pkt_build_ack_wnd(ackbuf, sizeof(ackbuf), expected, hdr.flags & PKT_FLAG_CE,
+                                              expected + (uint32_t)(writer_room(out) / chunk));
             if (pktlen > 0) {
                 netif_send(sock, ackbuf, pktlen);
+                acks_sent++;
+                TRACE(TRACE_ACK_SEND, hdr.seq, expected, 0, 0, 0, hdr.flags & PKT_FLAG_CE);
             }
         }
         else if (hdr.type == PKT_TYPE_FIN) {
 			// We receive an FIN packet
-            // FIN marks end of file; reply with FINACK.
-            uint8_t finbuf[PKT_HDR_LEN + MAX_PAYLOAD];
-            size_t pktlen = pkt_build_finack(finbuf, sizeof(finbuf), expected);
+            // FIN marks end of file; reply with FINACK. Everything up to
+            // the FIN is written by now, so the digests can be compared.
+            uint8_t finflags = 0;
+            if ((hdr.flags & PKT_FLAG_DIGEST) && payload_len == SHA256_LEN && digest_usable &&
+                hdr.seq == expected) {
+                uint8_t mine[SHA256_LEN];
+                sha256_final(&digest, mine);
+                digest_result = memcmp(mine, payload, SHA256_LEN) == 0 ? 1 : -1;
+                finflags = PKT_FLAG_DIGEST | (digest_result < 0 ? PKT_FLAG_DIGEST_BAD : 0);
+            }
+            uint8_t finbuf[PKT_HDR_LEN];
+            size_t pktlen = pkt_build_finack_wnd(finbuf, sizeof(finbuf), expected, finflags,
+                                                 expected + (uint32_t)(writer_room(out) / chunk));
             if (pktlen > 0) {
                 netif_send(sock, finbuf, pktlen);
             }
             fin_seen = 1;
-            fin_deadline_ms = now_ms() + 1000;
+            fin_deadline_ms = clock_now_ms() + 1000;
+        }
+        else if (hdr.type == PKT_TYPE_SYN) {
+            // Answer every SYN: a lost SYNACK makes the sender resend it.
+            if (session_up) {
+                session_reanswer(sock, payload, payload_len, &established);
+                continue;
+            }
+            // A checkpoint only fits packets of its own payload size.
+            pkt_syn_t local = {ckpt.done ? ckpt.payload : (uint16_t)mss, 0, PKT_ACK_CUMULATIVE,
+                               PKT_FEAT_COMPRESS | (resume ? PKT_FEAT_RESUME : 0), ckpt.start_seq,
+                               ckpt.start_seq + ckpt.done, 0};
+            pkt_syn_t agreed;
+            if (session_accept(sock, payload, payload_len, &local, &agreed) == 0) {
+                established = agreed;
+                expected = agreed.resume_seq;
+                chunk = agreed.payload;
+                uint64_t keep = (uint64_t)(agreed.resume_seq - agreed.start_seq) * chunk;
+                if (keep != kept) {
+                    // Not resuming after all: start the file over.
+                    writer_close(out);
+                    out = writer_open_at(out_path, use_direct, fsync_mb, keep);
+                    if (!out) {
+                        break;
+                    }
+                    kept = keep;
+                }
+                ckpt.payload = agreed.payload;
+                ckpt.start_seq = agreed.start_seq;
+                ckpt.done = agreed.resume_seq - agreed.start_seq;
+                sha256_init(&digest);
+                digest_usable = sha256_path(&digest, out_path, keep) == 0;
+                if (agreed.features & PKT_FEAT_COMPRESS) {
+                    plain = malloc(chunk);
+                    if (!plain) {
+                        perror("malloc");
+                        break;
+                    }
+                }
+                session_up = 1;
+            }
         }
     }
 
-    fclose(out);
+    free(recvbuf);
+    free(plain);
+    int closed = writer_close(out) == 0;
+    if (!closed || digest_result < 0) {
+        done = 0;
+    }
+    if (digest_result) {
+        printf("RECEIVER_DIGEST=%s\n", digest_result > 0 ? "ok" : "mismatch");
+    }
+    printf("RECEIVER_CPU_MS=%llu\n", (unsigned long long)cpu_time_ms());
+    // A finished file needs no checkpoint, and neither does one whose
+    // digest failed; an unfinished one keeps everything that reached it.
+    if (resume && (done || digest_result < 0)) {
+        checkpoint_remove(out_path);
+    } else if (resume && session_up && closed && out) {
+        ckpt.done = (uint32_t)((kept + bytes_out) / chunk);
+        checkpoint_save(out_path, &ckpt);
+    }
+    stats_close(stats);
     close(sock);
     return done ? 0 : 1;
 }
@@ -1,6 +1,17 @@
 #define _POSIX_C_SOURCE 200809L
+#include "checkpoint.h"
+#include "clock.h"
+#include "cpu.h"
+#include "fec.h"
+#include "lz.h"
+#include "mpath.h"
 #include "netif.h"
 #include "protocol.h"
+#include "session.h"
+#include "sha256.h"
+#include "stats.h"
+#include "trace.h"
+#include "writer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,6 +20,7 @@
 #include <unistd.h>
 #include <time.h>
 #include <stdbool.h>
+#include <fcntl.h>
 
 static int32_t is_seq_in_window(uint32_t seq, int32_t *window_seq, int winlen) {
     for(int i=0; i< winlen; i++){
@@ -21,21 +33,243 @@ static int32_t is_seq_in_window(uint32_t seq, int32_t *window_seq, int winlen) {
 
 typedef struct {
         uint32_t seq;
-        uint8_t data[MAX_PAYLOAD];
+        uint8_t *data;
         uint64_t len;
         bool written;
 } PayloadData;
 
+// Window used when neither --win nor the SYN gives one.
+#define SR_DEFAULT_WINDOW 10
+
 static void usage(const char *prog) {
     fprintf(stderr,
-            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT --out FILE\n",
+            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT (--out FILE | --out_dir DIR) [--win N] [--mss BYTES] [--gro] [--odirect] [--fsync MB] [--resume] [--paths N]\n       [--busy_poll US] [--cpu N]\n",
             prog);
 }
 
-static uint64_t now_ms(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)(ts.tv_nsec / 1000000ULL);
+// Hand every buffered payload that is next in order to the writer, adding
+// its length to *bytes. Returns 0, WRITER_FULL if the ring filled up first (the rest stays
+// buffered for a later call), or -1 on a write error.
+static int deliver_in_order(writer_t *out, PayloadData *payload_buffer, int32_t *window_seq,
+                            int winlen, uint32_t *expected, uint64_t *bytes, sha256_t *digest) {
+    int32_t expected_seq_pos = is_seq_in_window(*expected, window_seq, winlen);
+    while(expected_seq_pos != -1){
+        PayloadData *p = &payload_buffer[expected_seq_pos];
+        int wr = writer_put(out, p->data, (size_t)p->len);
+        if (wr != 0) {
+            return wr;
+        }
+        p->written=true;
+        *bytes += p->len;
+        sha256_update(digest, p->data, p->len);
+        TRACE(TRACE_DELIVER, p->seq, *expected, winlen, 0, p->len, 0);
+        (*expected)++;
+        expected_seq_pos = is_seq_in_window(*expected, window_seq, winlen);
+    }
+    return 0;
+}
+
+// Stream mode (--out_dir): per-stream reassembly state. Chunks carry their
+// byte offset, so they are written in place as they arrive and a stream is
+// complete once every byte announced by its OPEN packet is on disk.
+typedef struct {
+    uint32_t id;
+    bool used;
+    bool opened;
+    bool done;
+    int fd;
+    uint64_t size;
+    uint64_t bytes;
+    char *name;
+} StreamOut;
+
+typedef struct {
+    const char *dir;
+    StreamOut *slots;         // open addressing, cap is a power of two
+    size_t cap;
+    size_t used;
+    char **names;             // names claimed this session, same scheme
+    size_t names_cap;
+    size_t names_used;
+    uint64_t completed;
+    uint64_t failed;          // complete, but the rename failed
+} StreamTable;
+
+static size_t stream_slot(const StreamTable *t, uint32_t id) {
+    size_t i = (size_t)(id * 2654435761u) & (t->cap - 1);
+    while (t->slots[i].used && t->slots[i].id != id) {
+        i = (i + 1) & (t->cap - 1);
+    }
+    return i;
+}
+
+static StreamOut *stream_lookup(StreamTable *t, uint32_t id) {
+    if ((t->used + 1) * 2 > t->cap) {
+        StreamTable grown = *t;
+        grown.cap = t->cap ? t->cap * 2 : 1024;
+        grown.slots = calloc(grown.cap, sizeof(StreamOut));
+        if (!grown.slots) {
+            return NULL;
+        }
+        for (size_t i = 0; i < t->cap; i++) {
+            if (t->slots[i].used) {
+                grown.slots[stream_slot(&grown, t->slots[i].id)] = t->slots[i];
+            }
+        }
+        free(t->slots);
+        *t = grown;
+    }
+
+    StreamOut *so = &t->slots[stream_slot(t, id)];
+    if (!so->used) {
+        memset(so, 0, sizeof(*so));
+        so->used = true;
+        so->id = id;
+        so->fd = -1;
+        t->used++;
+    }
+    return so;
+}
+
+static void stream_part_path(const StreamTable *t, uint32_t id, char *path, size_t cap) {
+    snprintf(path, cap, "%s/.stream-%u.part", t->dir, id);
+}
+
+// Stream names become a single path component inside --out_dir. Names
+// of the .stream-<id>.part form are the receiver's own and get a '_'.
+static char *stream_name(const uint8_t *data, size_t n, uint32_t id) {
+    char *name = malloc(n + 32);
+    if (!name) {
+        return NULL;
+    }
+    size_t len = 0;
+    for (size_t i = 0; i < n && data[i] != '\0'; i++) {
+        name[len++] = (data[i] == '/') ? '_' : (char)data[i];
+    }
+    name[len] = '\0';
+    if (len == 0 || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        snprintf(name, n + 32, "stream-%u", id);
+    } else if (strncmp(name, ".stream-", 8) == 0) {
+        name[0] = '_';
+    }
+    return name;
+}
+
+static size_t name_slot(const StreamTable *t, const char *name) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const char *c = name; *c; c++) {
+        h = (h ^ (uint8_t)*c) * 1099511628211ULL;
+    }
+    size_t i = (size_t)h & (t->names_cap - 1);
+    while (t->names[i] && strcmp(t->names[i], name) != 0) {
+        i = (i + 1) & (t->names_cap - 1);
+    }
+    return i;
+}
+
+// Take name for one stream of this session; the table owns it from then
+// on. Returns 1, 0 if another stream already has it, -1 out of memory.
+static int stream_claim(StreamTable *t, char *name) {
+    if ((t->names_used + 1) * 2 > t->names_cap) {
+        StreamTable grown = *t;
+        grown.names_cap = t->names_cap ? t->names_cap * 2 : 1024;
+        grown.names = calloc(grown.names_cap, sizeof(char *));
+        if (!grown.names) {
+            return -1;
+        }
+        for (size_t i = 0; i < t->names_cap; i++) {
+            if (t->names[i]) {
+                grown.names[name_slot(&grown, t->names[i])] = t->names[i];
+            }
+        }
+        free(t->names);
+        t->names = grown.names;
+        t->names_cap = grown.names_cap;
+    }
+    size_t i = name_slot(t, name);
+    if (t->names[i]) {
+        return 0;
+    }
+    t->names[i] = name;
+    t->names_used++;
+    return 1;
+}
+
+// Two streams of a session with one name (a/x.txt and b/x.txt both
+// arrive as x.txt): the later one gets its stream id appended.
+static char *stream_unique_name(StreamTable *t, char *name, uint32_t id) {
+    int claimed = 1;
+    while (name && (claimed = stream_claim(t, name)) == 0) {
+        size_t cap = strlen(name) + 16;
+        char *longer = malloc(cap);
+        if (longer) {
+            snprintf(longer, cap, "%s.%u", name, id);
+        }
+        free(name);
+        name = longer;
+    }
+    if (name && claimed < 0) {
+        free(name);
+        return NULL;
+    }
+    return name;
+}
+
+static int stream_deliver(StreamTable *t, const uint8_t *payload, uint16_t len, uint8_t flags) {
+    pkt_stream_hdr_t sh;
+    if (pkt_get_stream_hdr(payload, len, &sh) != 0) {
+        return -1;
+    }
+    StreamOut *so = stream_lookup(t, sh.stream_id);
+    if (!so) {
+        return -1;
+    }
+    if (so->done) {
+        return 0;
+    }
+
+    char part[4096];
+    stream_part_path(t, so->id, part, sizeof(part));
+    if (so->fd < 0) {
+        so->fd = open(part, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (so->fd < 0) {
+            perror(part);
+            return -1;
+        }
+    }
+
+    const uint8_t *data = payload + PKT_STREAM_HDR_LEN;
+    size_t n = len - PKT_STREAM_HDR_LEN;
+    if (flags & PKT_FLAG_STREAM_OPEN) {
+        so->name = stream_unique_name(t, stream_name(data, n, so->id), so->id);
+        if (!so->name) {
+            return -1;
+        }
+        so->size = sh.offset;
+        so->opened = true;
+    } else if (n > 0) {
+        if (pwrite(so->fd, data, n, (off_t)sh.offset) != (ssize_t)n) {
+            perror("pwrite");
+            return -1;
+        }
+        so->bytes += n;
+    }
+
+    if (so->opened && so->bytes >= so->size) {
+        char final[4096];
+        snprintf(final, sizeof(final), "%s/%s", t->dir, so->name);
+        close(so->fd);
+        so->fd = -1;
+        // A failed rename fails the stream; its data stays in the part file.
+        if (rename(part, final) != 0) {
+            perror(final);
+            t->failed++;
+        } else {
+            t->completed++;
+        }
+        so->done = true;
+    }
+    return 0;
 }
 
 int main(int argc, char **argv) {
@@ -43,7 +277,17 @@ int main(int argc, char **argv) {
     const char *peer_ip = NULL;
     int peer_port = -1;
     const char *out_path = NULL;
-    int win = 10;
+    StreamTable streams;
+    memset(&streams, 0, sizeof(streams));
+    int win = 0;
+    int mss = MAX_PAYLOAD;
+    bool use_gro = false;
+    bool use_direct = false;
+    int fsync_mb = -1;
+    bool resume = false;
+    int npaths = 1;
+    int busy_poll_us = 0;
+    int cpu = -1;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
@@ -54,8 +298,26 @@ int main(int argc, char **argv) {
             peer_port = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
             out_path = argv[++i];
+        } else if (strcmp(argv[i], "--out_dir") == 0 && i + 1 < argc) {
+            streams.dir = argv[++i];
         } else if (strcmp(argv[i], "--win") == 0 && i + 1 < argc) {
             win = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mss") == 0 && i + 1 < argc) {
+            mss = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gro") == 0) {
+            use_gro = true;
+        } else if (strcmp(argv[i], "--odirect") == 0) {
+            use_direct = true;
+        } else if (strcmp(argv[i], "--fsync") == 0 && i + 1 < argc) {
+            fsync_mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            resume = true;
+        } else if (strcmp(argv[i], "--paths") == 0 && i + 1 < argc) {
+            npaths = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--busy_poll") == 0 && i + 1 < argc) {
+            busy_poll_us = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            cpu = atoi(argv[++i]);
         } else {
             usage(argv[0]);
             return 1;
@@ -63,72 +325,186 @@ int main(int argc, char **argv) {
     }
 
     #define WINDOW_N (uint32_t)win
-    printf("The window size is: %d", WINDOW_N);
-    int32_t window_seq[WINDOW_N];
 
-    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || !out_path) {
+    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || (!out_path == !streams.dir) ||
+        win < 0 || win > UINT16_MAX || mss <= 0 || mss > MAX_PAYLOAD || (resume && !out_path) ||
+        npaths < 1 || npaths > MPATH_MAX || busy_poll_us < 0) {
         usage(argv[0]);
         return 1;
     }
 
-    FILE *out = fopen(out_path, "wb");
-    if (!out) {
-        perror("fopen");
-        return 1;
+    // With --resume, keep what an earlier run checkpointed; the SYN
+    // exchange decides whether the sender continues from there. Only the
+    // in-order prefix is on disk, so that is all the checkpoint covers.
+    checkpoint_t ckpt = {0, 0, 0};
+    if (resume && (checkpoint_load(out_path, &ckpt) != 0 || ckpt.payload > mss)) {
+        ckpt.done = 0;
+    }
+    uint64_t kept = (uint64_t)ckpt.done * ckpt.payload;
+
+    // Payloads go to disk on a writer thread; see writer.h.
+    writer_t *out = NULL;
+    if (out_path) {
+        out = writer_open_at(out_path, use_direct, fsync_mb, kept);
+        if (!out) {
+            return 1;
+        }
+        if (use_direct && !writer_direct(out)) {
+            fprintf(stderr, "O_DIRECT unavailable, using buffered writes\n");
+        }
     }
 
     // Create a UDP socket through the netif wrapper (emulator-aware).
     int sock = netif_socket();
     if (sock < 0) {
-        fclose(out);
+        writer_close(out);
         return 1;
     }
 
     // Bind local port for this receiver.
     if (netif_bind(sock, listen_port) != 0) {
-        fclose(out);
+        writer_close(out);
         close(sock);
         return 1;
     }
     // Tell emulator which peer port to forward to.
     if (netif_connect(sock, peer_ip, peer_port) != 0) {
-        fclose(out);
+        writer_close(out);
         close(sock);
         return 1;
     }
+    // --paths N: packets may come in on any path and are answered on the
+    // one they came in on; reassembly does not care which.
+    mpath_t mp;
+    if (mpath_open(&mp, npaths, sock, listen_port, peer_ip, peer_port, 0) != 0) {
+        fprintf(stderr, "cannot open %d paths\n", npaths);
+        writer_close(out);
+        close(sock);
+        return 1;
+    }
+    TRACE_START(listen_port);
+    stats_page_t *stats = stats_open(listen_port, STATS_RECEIVER, "sr");
+
+    // With --gro, netif splits coalesced datagrams back into packets.
+    for (int i = 0; i < mp.n; i++) {
+        if (use_gro && netif_enable_gro(mp.path[i].sock) != 0) {
+            fprintf(stderr, "UDP GRO unavailable, receiving single datagrams\n");
+            break;
+        }
+    }
+    // --busy_poll US: waits for DATA spin before they sleep.
+    for (int i = 0; busy_poll_us > 0 && i < mp.n; i++) {
+        if (netif_enable_busy_poll(mp.path[i].sock, busy_poll_us) != 0 && i == 0) {
+            fprintf(stderr, "SO_BUSY_POLL unavailable, spinning in user space only\n");
+        }
+    }
+    // --cpu N: pin the event loop; the writer thread is already running
+    // and stays free to run elsewhere.
+    if (cpu >= 0 && cpu_pin(cpu) != 0) {
+        fprintf(stderr, "cannot pin to CPU %d\n", cpu);
+    }
 
-    uint8_t recvbuf[PKT_HDR_LEN + MAX_PAYLOAD];
+    // Largest payload we accept; the SYN exchange may settle on less.
+    pkt_set_payload_limit((uint16_t)mss);
+    size_t buf_cap = PKT_HDR_LEN + PKT_FEC_HDR_LEN + (size_t)mss;
+    uint8_t *recvbuf = malloc(buf_cap);
+    // Window state is sized once the SYN fixes the window and payload size.
+    int32_t *window_seq = NULL;
+    PayloadData *payload_buffer = NULL;
+    // Stream mode keeps no payloads, only which seqs of the window arrived.
+    uint8_t *seen = NULL;
+    uint8_t *payload_pool = NULL;
+    bool session_up = false;
+    pkt_syn_t established;          // the answer the session got
+    if (!recvbuf) {
+        perror("malloc");
+        writer_close(out);
+        close(sock);
+        return 1;
+    }
 
     uint32_t expected = 0;
     int done = 0;
     int fin_seen = 0;
     uint64_t fin_deadline_ms = 0;
-    
-    PayloadData payload_buffer[WINDOW_N];
-    for(uint32_t i = 0; i < WINDOW_N; i++){
-        window_seq[i] = -1;
-        payload_buffer[i].written = true;
-    }
-    
+    // In-order payloads are waiting for room in the writer ring.
+    bool stalled = false;
+    // FEC state is set up when the SYN asks for it.
+    fec_dec_t fec;
+    bool fec_on = false;
+    uint8_t *rebuilt = NULL;
+    // Expanded PKT_FLAG_LZ payloads, one agreed payload long.
+    uint8_t *plain = NULL;
+    size_t plain_cap = 0;
+    uint64_t data_rcvd = 0;
+    uint64_t acks_sent = 0;
+    uint64_t bytes_out = 0;
+    uint64_t next_ckpt_ms = 0;
+    // SHA-256 of the payloads handed to the writer, compared with the one
+    // in the FIN. A resumed file starts with the digest of the part kept.
+    sha256_t digest;
+    bool digest_usable = false;
+    int digest_result = 0;    // 1 match, -1 mismatch
 
     // Basic receiver: accept in-order packets and send cumulative ACKs.
     // TODO(student): implement GBN/SR receiver logic here:
     //   - GBN: discard out-of-order, ACK last in-order
     //   - SR: buffer out-of-order, ACK each packet
     while (!done) {
-        int timeout_ms = -1;
+        if (stats) {
+            stats_begin(stats);
+            stats->update_ns = clock_now_ns();
+            stats->base = expected;
+            stats->cwnd = WINDOW_N;
+            stats->pkts_sent = acks_sent;
+            stats->pkts_recv = data_rcvd;
+            stats->bytes_delivered = bytes_out;
+            stats_end(stats);
+        }
+        if (resume && session_up && clock_now_ms() >= next_ckpt_ms) {
+            uint32_t written = (uint32_t)(writer_written(out) / ckpt.payload);
+            if (written != ckpt.done) {
+                ckpt.done = written;
+                checkpoint_save(out_path, &ckpt);
+            }
+            next_ckpt_ms = clock_now_ms() + CHECKPOINT_INTERVAL_MS;
+        }
+        int timeout_ms = resume && session_up ? CHECKPOINT_INTERVAL_MS : -1;
         if (fin_seen) {
-            uint64_t now = now_ms();
+            uint64_t now = clock_now_ms();
             if (now >= fin_deadline_ms) {
                 done = 1;
                 break;
             }
             timeout_ms = 200;
         }
+        if (stalled) {
+            int rc = deliver_in_order(out, payload_buffer, window_seq, WINDOW_N, &expected, &bytes_out, &digest);
+            if (rc == -1) {
+                fprintf(stderr, "write failed\n");
+                break;
+            }
+            stalled = (rc == WRITER_FULL);
+            if (stalled) {
+                timeout_ms = 5;
+            }
+        }
 
-        // Receive a packet with optional timeout.
-        ssize_t n = netif_recv(sock, recvbuf, sizeof(recvbuf), timeout_ms);
-        printf("Received packet of length %zd\n", n);
+        // A packet rebuilt from parity is handled as if it had arrived, with
+        // PKT_FLAG_FEC set so its ACK tells the sender.
+        ssize_t n;
+        int rpath = 0;
+        uint32_t rseq;
+        uint16_t rlen;
+        uint8_t rflags;
+        if (fec_on && fec_dec_recover(&fec, &rseq, rebuilt, &rlen, &rflags)) {
+            n = (ssize_t)pkt_build_data_flags(recvbuf, buf_cap, rseq, rflags | PKT_FLAG_FEC,
+                                              rebuilt, rlen);
+            TRACE(TRACE_FEC_RECOVER, rseq, expected, WINDOW_N, 0, rlen, rflags);
+        } else {
+            // Receive a packet with optional timeout.
+            n = mpath_recv(&mp, recvbuf, buf_cap, timeout_ms, &rpath);
+        }
         if (n < 0) {
             perror("recv");
             break;
@@ -136,6 +512,7 @@ int main(int argc, char **argv) {
         if (n == 0) {
             continue;
         }
+        int rsock = mp.path[rpath].sock;
 
         pkt_hdr_t hdr;
         const uint8_t *payload = NULL;
@@ -145,35 +522,79 @@ int main(int argc, char **argv) {
             continue;
         }
         if (hdr.type == PKT_TYPE_DATA) {
+            data_rcvd++;
+            TRACE(TRACE_DATA_RECV, hdr.seq, expected, WINDOW_N, 0, payload_len, hdr.flags);
+        }
+        if (fec_on && hdr.type == PKT_TYPE_DATA && !(hdr.flags & PKT_FLAG_FEC)) {
+            // The CE mark is the path's, not part of what parity covers.
+            fec_dec_store(&fec, hdr.seq, payload, payload_len, hdr.flags & (uint8_t)~PKT_FLAG_CE);
+        }
+        if (hdr.type == PKT_TYPE_DATA && (hdr.flags & PKT_FLAG_LZ)) {
+            // A payload that does not expand into one chunk is dropped like
+            // a corrupt packet; the sender resends it.
+            ssize_t m = plain ? lz_decompress(payload, payload_len, plain, plain_cap) : -1;
+            if (m < 0) {
+                continue;
+            }
+            payload = plain;
+            payload_len = (uint16_t)m;
+        }
+        if (hdr.type == PKT_TYPE_DATA && (hdr.flags & PKT_FLAG_STREAM)) {
+            if (!streams.dir || !session_up || hdr.seq >= expected + WINDOW_N) {
+                continue;
+            }
+            if (hdr.seq >= expected && !seen[hdr.seq % WINDOW_N]) {
+                // No ACK if the chunk cannot be stored; the sender retries.
+                if (stream_deliver(&streams, payload, payload_len, hdr.flags) != 0) {
+                    continue;
+                }
+                bytes_out += payload_len;
+                seen[hdr.seq % WINDOW_N] = 1;
+                while (seen[expected % WINDOW_N]) {
+                    seen[expected % WINDOW_N] = 0;
+                    expected++;
+                }
+            }
+
+            // Every ACK advertises expected + WINDOW_N as the window edge:
+            // all buffered seqs lie below it, so each seq there has a slot.
+            uint8_t ackbuf[PKT_HDR_LEN];
+            size_t pktlen = pkt_build_ack_wnd(ackbuf, sizeof(ackbuf), hdr.seq, hdr.flags & (PKT_FLAG_FEC | PKT_FLAG_CE),
+                                              expected + WINDOW_N);
+            if (pktlen > 0) {
+                netif_send(rsock, ackbuf, pktlen);
+                acks_sent++;
+                TRACE(TRACE_ACK_SEND, hdr.seq, hdr.seq, WINDOW_N, 0, 0, hdr.flags & (PKT_FLAG_FEC | PKT_FLAG_CE));
+            }
+        } else if (hdr.type == PKT_TYPE_DATA && payload_pool) {
             // We received an DATA packet, write it to the output file
 			if (payload_len > 0) {
 
                 if(hdr.seq < expected ){
-                    uint8_t ackbuf[PKT_HDR_LEN + MAX_PAYLOAD];
+                    uint8_t ackbuf[PKT_HDR_LEN];
                     uint32_t ack_no = hdr.seq;
-                    size_t pktlen = pkt_build_ack(ackbuf, sizeof(ackbuf), ack_no);
+                    size_t pktlen = pkt_build_ack_wnd(ackbuf, sizeof(ackbuf), ack_no, hdr.flags & (PKT_FLAG_FEC | PKT_FLAG_CE),
+                                                      expected + WINDOW_N);
                     if (pktlen > 0) {
-                        netif_send(sock, ackbuf, pktlen);
-                        printf("Sent ACK for seq %u\n", ack_no);
+                        netif_send(rsock, ackbuf, pktlen);
+                        acks_sent++;
+                        TRACE(TRACE_ACK_SEND, ack_no, ack_no, WINDOW_N, 0, 0, hdr.flags & (PKT_FLAG_FEC | PKT_FLAG_CE));
                     }
                     continue;
                 }
 
-                PayloadData pld;
-                pld.seq = hdr.seq;
-                pld.len = payload_len;
-                pld.written = false;
-                memcpy(pld.data, payload, payload_len);
-
                 bool buffered = false;
                 if(is_seq_in_window(hdr.seq, window_seq, WINDOW_N) != -1){
                     buffered = true;
                 }else{
-                    if(pld.seq >= expected && pld.seq < expected + WINDOW_N){
+                    if(hdr.seq >= expected && hdr.seq < expected + WINDOW_N){
                         for(uint32_t j = 0; j<WINDOW_N; j++){
-                            PayloadData p = payload_buffer[j];
-                            if(p.written){
-                                payload_buffer[j] = pld;
+                            PayloadData *p = &payload_buffer[j];
+                            if(p->written){
+                                p->seq = hdr.seq;
+                                p->len = payload_len;
+                                p->written = false;
+                                memcpy(p->data, payload, payload_len);
                                 window_seq[j] = hdr.seq;
                                 buffered = true;
                                 break;
@@ -181,44 +602,203 @@ int main(int argc, char **argv) {
                         }
                     }
                 }
+                // Deliver before the ACK so its window edge counts this
+                // packet; a full writer ring only delays the write.
+                int rc = deliver_in_order(out, payload_buffer, window_seq, WINDOW_N, &expected, &bytes_out, &digest);
+                if (rc == -1) {
+                    fprintf(stderr, "write failed\n");
+                    break;
+                }
+                stalled = (rc == WRITER_FULL);
+
                 if(buffered){
                     // After we receive an DATA packet, we send an ACK
                     // Here we implement an example ACK send call 
                     // TODO(student): change ACK policy according to GBN or SR
 
-                    uint8_t ackbuf[PKT_HDR_LEN + MAX_PAYLOAD];
+                    uint8_t ackbuf[PKT_HDR_LEN];
                     uint32_t ack_no = hdr.seq;
-                    size_t pktlen = pkt_build_ack(ackbuf, sizeof(ackbuf), ack_no);
+                    size_t pktlen = pkt_build_ack_wnd(ackbuf, sizeof(ackbuf), ack_no, hdr.flags & (PKT_FLAG_FEC | PKT_FLAG_CE),
+                                                      expected + WINDOW_N);
                     if (pktlen > 0) {
-                        netif_send(sock, ackbuf, pktlen);
-                        printf("Sent ACK for seq %u\n", ack_no);
+                        netif_send(rsock, ackbuf, pktlen);
+                        acks_sent++;
+                        TRACE(TRACE_ACK_SEND, ack_no, ack_no, WINDOW_N, 0, 0, hdr.flags & (PKT_FLAG_FEC | PKT_FLAG_CE));
                     }
                 }
-
-                int32_t expected_seq_pos = is_seq_in_window(expected, window_seq, WINDOW_N);
-                while(expected_seq_pos != -1){
-                    PayloadData *p = &payload_buffer[expected_seq_pos];
-                    fwrite(p->data, 1, p->len, out);
-                    p->written=true;
-                    printf("Written payload of seq %u to file\n", p->seq);
-                    expected++;
-                    expected_seq_pos = is_seq_in_window(expected, window_seq, WINDOW_N);
-                }
 			}
+        } else if (hdr.type == PKT_TYPE_PARITY) {
+            pkt_fec_t pf;
+            const uint8_t *parity;
+            uint16_t parity_len;
+            if (!fec_on || pkt_parse_parity(&hdr, payload, payload_len, &pf, &parity, &parity_len) != 0) {
+                continue;
+            }
+            fec_dec_parity(&fec, &pf, parity, parity_len);
         } else if (hdr.type == PKT_TYPE_FIN) {
 			// We receive an FIN packet
-            // FIN marks end of file; reply with FINACK.
-            uint8_t finbuf[PKT_HDR_LEN + MAX_PAYLOAD];
-            size_t pktlen = pkt_build_finack(finbuf, sizeof(finbuf), expected);
+            // FIN marks end of file; reply with FINACK. Every packet was
+            // ACKed, but some may still wait for room in the writer ring;
+            // they have to be in the digest before it is compared.
+            uint8_t finflags = 0;
+            if ((hdr.flags & PKT_FLAG_DIGEST) && payload_len == SHA256_LEN && digest_usable) {
+                while (stalled && writer_wait(out, (size_t)mss, 1000)) {
+                    int rc = deliver_in_order(out, payload_buffer, window_seq, WINDOW_N, &expected, &bytes_out,
+                                              &digest);
+                    stalled = (rc == WRITER_FULL);
+                }
+                if (!stalled && hdr.seq == expected) {
+                    uint8_t mine[SHA256_LEN];
+                    sha256_final(&digest, mine);
+                    digest_result = memcmp(mine, payload, SHA256_LEN) == 0 ? 1 : -1;
+                    finflags = PKT_FLAG_DIGEST | (digest_result < 0 ? PKT_FLAG_DIGEST_BAD : 0);
+                }
+            }
+            uint8_t finbuf[PKT_HDR_LEN];
+            size_t pktlen = pkt_build_finack_wnd(finbuf, sizeof(finbuf), expected, finflags,
+                                                 expected + WINDOW_N);
             if (pktlen > 0) {
-                netif_send(sock, finbuf, pktlen);
+                netif_send(rsock, finbuf, pktlen);
             }
             fin_seen = 1;
-            fin_deadline_ms = now_ms() + 1000;
+            fin_deadline_ms = clock_now_ms() + 1000;
+        } else if (hdr.type == PKT_TYPE_SYN) {
+            // Answer every SYN: a lost SYNACK makes the sender resend it.
+            if (session_up) {
+                session_reanswer(rsock, payload, payload_len, &established);
+                continue;
+            }
+            // Without --win we take the sender's window. A checkpoint only
+            // fits packets of its own payload size.
+            pkt_syn_t local = {ckpt.done ? ckpt.payload : (uint16_t)mss, (uint16_t)win,
+                               PKT_ACK_SELECTIVE,
+                               PKT_FEAT_FEC | PKT_FEAT_COMPRESS | (streams.dir ? PKT_FEAT_STREAM : 0) |
+                                   (resume ? PKT_FEAT_RESUME : 0),
+                               ckpt.start_seq, ckpt.start_seq + ckpt.done, 0};
+            pkt_syn_t agreed;
+            if (session_accept(rsock, payload, payload_len, &local, &agreed) != 0) {
+                continue;
+            }
+            established = agreed;
+            win = agreed.window ? agreed.window : SR_DEFAULT_WINDOW;
+            expected = agreed.resume_seq;
+            if (out) {
+                uint64_t keep = (uint64_t)(agreed.resume_seq - agreed.start_seq) * agreed.payload;
+                if (keep != kept) {
+                    // Not resuming after all: start the file over.
+                    writer_close(out);
+                    out = writer_open_at(out_path, use_direct, fsync_mb, keep);
+                    if (!out) {
+                        break;
+                    }
+                    kept = keep;
+                }
+                ckpt.payload = agreed.payload;
+                ckpt.start_seq = agreed.start_seq;
+                ckpt.done = agreed.resume_seq - agreed.start_seq;
+                sha256_init(&digest);
+                digest_usable = sha256_path(&digest, out_path, keep) == 0;
+            }
+            window_seq = malloc(WINDOW_N * sizeof(int32_t));
+            payload_buffer = calloc(WINDOW_N, sizeof(PayloadData));
+            seen = calloc(WINDOW_N, 1);
+            payload_pool = malloc(WINDOW_N * (size_t)agreed.payload);
+            if (!window_seq || !payload_buffer || !seen || !payload_pool) {
+                perror("malloc");
+                break;
+            }
+            for (uint32_t i = 0; i < WINDOW_N; i++) {
+                window_seq[i] = -1;
+                payload_buffer[i].written = true;
+                payload_buffer[i].data = payload_pool + (size_t)i * (size_t)agreed.payload;
+            }
+            if (agreed.features & PKT_FEAT_COMPRESS) {
+                plain_cap = agreed.payload;
+                plain = malloc(plain_cap);
+                if (!plain) {
+                    perror("malloc");
+                    break;
+                }
+            }
+            if (agreed.features & PKT_FEAT_FEC) {
+                // Cache covers the window plus one block on either side.
+                rebuilt = malloc(agreed.payload);
+                if (!rebuilt || fec_dec_init(&fec, 2 * WINDOW_N + FEC_MAX_N, agreed.payload) != 0) {
+                    perror("malloc");
+                    break;
+                }
+                fec_on = true;
+            }
+            session_up = true;
         }
     }
 
-    fclose(out);
+    if (fec_on) {
+        printf("FEC_RECOVERED=%llu\n", (unsigned long long)fec.recovered);
+        fec_dec_free(&fec);
+    }
+    free(rebuilt);
+    free(plain);
+    if (streams.dir) {
+        printf("STREAMS_DONE=%llu\n", (unsigned long long)streams.completed);
+        if (streams.failed) {
+            printf("STREAMS_FAILED=%llu\n", (unsigned long long)streams.failed);
+            done = 0;
+        }
+        // Streams still open at exit stay behind as .part files.
+        for (size_t i = 0; i < streams.cap; i++) {
+            if (streams.slots[i].used && !streams.slots[i].done) {
+                if (streams.slots[i].fd >= 0) {
+                    close(streams.slots[i].fd);
+                }
+                done = 0;
+            }
+        }
+        for (size_t i = 0; i < streams.names_cap; i++) {
+            free(streams.names[i]);
+        }
+        free(streams.names);
+        free(streams.slots);
+    }
+    // Anything still buffered was ACKed, so it must reach the file.
+    while (stalled && writer_wait(out, (size_t)mss, 1000)) {
+        int rc = deliver_in_order(out, payload_buffer, window_seq, WINDOW_N, &expected, &bytes_out, &digest);
+        stalled = (rc == WRITER_FULL);
+        if (rc == -1) {
+            done = 0;
+        }
+    }
+    bool closed = writer_close(out) == 0;
+    if (!closed || stalled || digest_result < 0) {
+        done = 0;
+    }
+    if (digest_result) {
+        printf("RECEIVER_DIGEST=%s\n", digest_result > 0 ? "ok" : "mismatch");
+    }
+    printf("RECEIVER_CPU_MS=%llu\n", (unsigned long long)cpu_time_ms());
+    // A finished file needs no checkpoint, and neither does one whose
+    // digest failed; an unfinished one keeps everything that reached it.
+    if (resume && (done || digest_result < 0)) {
+        checkpoint_remove(out_path);
+    } else if (resume && session_up && closed && out) {
+        ckpt.done = (uint32_t)((kept + bytes_out) / ckpt.payload);
+        checkpoint_save(out_path, &ckpt);
+    }
+    if (stats) {
+        stats_begin(stats);
+        stats->base = expected;
+        stats->pkts_sent = acks_sent;
+        stats->pkts_recv = data_rcvd;
+        stats->bytes_delivered = bytes_out;
+        stats_end(stats);
+    }
+    stats_close(stats);
+    free(seen);
+    free(payload_pool);
+    free(payload_buffer);
+    free(window_seq);
+    free(recvbuf);
+    mpath_close(&mp);
     close(sock);
     return done ? 0 : 1;
 }
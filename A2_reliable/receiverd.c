@@ -0,0 +1,536 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "clock.h"
+#include "cpu.h"
+#include "lz.h"
+#include "netif.h"
+#include "protocol.h"
+#include "session.h"
+#include "sha256.h"
+
+// Long-running receiver for many concurrent senders (sender_sr or
+// sender_gbn) on one port. Worker threads each own a socket of an
+// SO_REUSEPORT group, so the kernel shards senders across them by source
+// address, and each keeps its senders in a hash table keyed by that
+// address; the SYN's session id tells a restarted transfer from a resent
+// SYN. Payloads are written in place at their file offset, so a session
+// holds no payload buffers: only one byte per window slot. The file
+// digest is checked against the FIN by hashing the finished file.
+//
+// Each session goes to DIR/.session-<id>.part and is renamed to
+// DIR/session-<id> once its digest matches. One line per finished,
+// failed or expired session goes to stdout.
+
+// Datagrams per recvmmsg, and the longest a worker sleeps between sweeps.
+#define RD_BATCH 32
+#define RD_TICK_MS 100
+// A finished session answers resent FINs this long, as the receivers do.
+#define RD_LINGER_MS 1000
+// Window used when neither --win nor the SYN gives one.
+#define RD_DEFAULT_WINDOW 10
+
+typedef struct {
+    struct sockaddr_in addr;   // key; used when addr.sin_family is set
+    uint32_t id;               // SYN session id
+    pkt_syn_t agreed;
+    int fd;                    // output file, -1 once closed
+    uint32_t expected;         // first seq not yet written
+    uint8_t *seen;             // per window slot: written, ahead of expected
+    uint64_t end;              // file size so far
+    uint64_t bytes;            // payload bytes written, duplicates excluded
+    uint64_t start_ms;
+    uint64_t last_ms;          // last packet, for --idle_ms
+    bool fin;                  // FINACK sent; lingers for resent FINs
+    uint8_t finflags;
+} rd_session_t;
+
+// Open addressing on the source address, linear probing, at most half
+// full; removal shifts the rest of the probe run back.
+typedef struct {
+    rd_session_t *slots;
+    size_t cap;                // power of two
+    size_t used;
+} rd_table_t;
+
+typedef struct {
+    const char *dir;
+    uint16_t mss;
+    uint16_t win;
+    int idle_ms;
+    int max_sessions;
+    int exit_after;
+} rd_cfg_t;
+
+typedef struct {
+    pthread_t thread;
+    int sock;
+    const rd_cfg_t *cfg;
+    rd_table_t table;
+    uint8_t *plain;            // expanded PKT_FLAG_LZ payload
+} rd_worker_t;
+
+static atomic_int stop;
+static atomic_int active;
+static atomic_int peak;
+static atomic_int finished;    // done, failed or expired
+static atomic_ullong n_done;
+static atomic_ullong n_failed;
+static atomic_ullong n_expired;
+static atomic_ullong n_refused;   // SYNs past --max_sessions
+static atomic_ullong bytes_total;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s --listen PORT --out_dir DIR [--workers N] [--win N] [--mss BYTES]\n"
+            "       [--max_sessions N] [--idle_ms MS] [--exit_after N]\n",
+            prog);
+}
+
+static size_t addr_slot(const rd_table_t *t, const struct sockaddr_in *addr) {
+    uint32_t h = addr->sin_addr.s_addr * 2654435761u ^ addr->sin_port * 40503u;
+    return (size_t)(h ^ h >> 16) & (t->cap - 1);
+}
+
+static bool same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr;
+}
+
+static rd_session_t *table_find(rd_table_t *t, const struct sockaddr_in *addr) {
+    if (t->cap == 0) {
+        return NULL;
+    }
+    for (size_t i = addr_slot(t, addr); t->slots[i].addr.sin_family; i = (i + 1) & (t->cap - 1)) {
+        if (same_addr(&t->slots[i].addr, addr)) {
+            return &t->slots[i];
+        }
+    }
+    return NULL;
+}
+
+static rd_session_t *table_insert(rd_table_t *t, const struct sockaddr_in *addr) {
+    if ((t->used + 1) * 2 > t->cap) {
+        rd_table_t grown = {NULL, t->cap ? t->cap * 2 : 1024, t->used};
+        grown.slots = calloc(grown.cap, sizeof(rd_session_t));
+        if (!grown.slots) {
+            return NULL;
+        }
+        for (size_t i = 0; i < t->cap; i++) {
+            if (t->slots[i].addr.sin_family) {
+                size_t j = addr_slot(&grown, &t->slots[i].addr);
+                while (grown.slots[j].addr.sin_family) {
+                    j = (j + 1) & (grown.cap - 1);
+                }
+                grown.slots[j] = t->slots[i];
+            }
+        }
+        free(t->slots);
+        *t = grown;
+    }
+    size_t i = addr_slot(t, addr);
+    while (t->slots[i].addr.sin_family) {
+        i = (i + 1) & (t->cap - 1);
+    }
+    rd_session_t *ss = &t->slots[i];
+    memset(ss, 0, sizeof(*ss));
+    ss->addr = *addr;
+    ss->fd = -1;
+    t->used++;
+    return ss;
+}
+
+static void table_remove(rd_table_t *t, rd_session_t *ss) {
+    size_t i = (size_t)(ss - t->slots);
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & (t->cap - 1);
+        if (!t->slots[j].addr.sin_family) {
+            break;
+        }
+        // Move j into the hole unless its home slot lies in (i, j].
+        size_t home = addr_slot(t, &t->slots[j].addr);
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) {
+            continue;
+        }
+        t->slots[i] = t->slots[j];
+        i = j;
+    }
+    memset(&t->slots[i], 0, sizeof(t->slots[i]));
+    t->used--;
+}
+
+static void part_path(const rd_cfg_t *cfg, uint32_t id, char *path, size_t cap) {
+    snprintf(path, cap, "%s/.session-%08x.part", cfg->dir, id);
+}
+
+static void report(const rd_session_t *ss, const char *result, uint64_t now) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &ss->addr.sin_addr, ip, sizeof(ip));
+    printf("SESSION id=%08x peer=%s:%u bytes=%llu ms=%llu result=%s\n", ss->id, ip,
+           (unsigned)ntohs(ss->addr.sin_port), (unsigned long long)ss->bytes,
+           (unsigned long long)(now - ss->start_ms), result);
+    fflush(stdout);
+}
+
+// Close the session's file and drop it; unfinished files stay as .part.
+static void session_drop(rd_worker_t *w, rd_session_t *ss) {
+    if (ss->fd >= 0) {
+        close(ss->fd);
+    }
+    free(ss->seen);
+    atomic_fetch_sub(&active, 1);
+    table_remove(&w->table, ss);
+}
+
+static void session_expire(rd_worker_t *w, rd_session_t *ss, const char *why, uint64_t now) {
+    report(ss, why, now);
+    atomic_fetch_add(&n_expired, 1);
+    atomic_fetch_add(&finished, 1);
+    session_drop(w, ss);
+}
+
+static void send_to(rd_worker_t *w, const rd_session_t *ss, const uint8_t *buf, size_t len) {
+    if (len > 0) {
+        netif_send_addr(w->sock, &ss->addr, buf, len);
+    }
+}
+
+static void on_syn(rd_worker_t *w, const struct sockaddr_in *src, const uint8_t *payload,
+                   uint16_t len, uint64_t now) {
+    pkt_syn_t syn;
+    if (pkt_parse_syn(payload, len, &syn) != 0) {
+        return;
+    }
+    rd_session_t *ss = table_find(&w->table, src);
+    if (ss && ss->id != syn.session) {
+        // The sender started over from the same address.
+        session_expire(w, ss, "replaced", now);
+        ss = NULL;
+    }
+    if (!ss) {
+        // No answer past the limit: the sender's handshake times out.
+        if (atomic_load(&active) >= w->cfg->max_sessions) {
+            atomic_fetch_add(&n_refused, 1);
+            return;
+        }
+        pkt_syn_t local = {w->cfg->mss, w->cfg->win,
+                           syn.ack_mode ? syn.ack_mode : PKT_ACK_SELECTIVE, PKT_FEAT_COMPRESS,
+                           0, 0, 0};
+        pkt_syn_t agreed;
+        session_answer(&syn, &local, &agreed);
+        if (agreed.window == 0) {
+            agreed.window = RD_DEFAULT_WINDOW;
+        }
+        char part[4096];
+        part_path(w->cfg, syn.session, part, sizeof(part));
+        ss = table_insert(&w->table, src);
+        if (!ss) {
+            return;
+        }
+        ss->id = syn.session;
+        ss->agreed = agreed;
+        ss->expected = agreed.resume_seq;
+        ss->start_ms = now;
+        ss->last_ms = now;
+        ss->seen = calloc(agreed.window, 1);
+        ss->fd = open(part, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        int n = atomic_fetch_add(&active, 1) + 1;
+        for (int p = atomic_load(&peak); n > p && !atomic_compare_exchange_weak(&peak, &p, n);) {
+        }
+        if (!ss->seen || ss->fd < 0) {
+            perror(part);
+            session_drop(w, ss);
+            return;
+        }
+    }
+    // A resent SYN gets the same answer.
+    uint8_t buf[PKT_HDR_LEN + PKT_SYN_LEN];
+    send_to(w, ss, buf, pkt_build_synack(buf, sizeof(buf), &ss->agreed));
+}
+
+static void on_data(rd_worker_t *w, rd_session_t *ss, const pkt_hdr_t *hdr,
+                    const uint8_t *payload, uint16_t len, uint64_t now) {
+    uint32_t win = ss->agreed.window;
+    uint32_t ahead = hdr->seq - ss->expected;
+    if (ss->fin || ((int32_t)ahead >= 0 && ahead >= win)) {
+        return;
+    }
+    ss->last_ms = now;
+    if ((int32_t)ahead >= 0 && !ss->seen[hdr->seq % win]) {
+        if (hdr->flags & PKT_FLAG_LZ) {
+            ssize_t m = lz_decompress(payload, len, w->plain, ss->agreed.payload);
+            if (m < 0) {
+                return;
+            }
+            payload = w->plain;
+            len = (uint16_t)m;
+        }
+        // No ACK if the chunk cannot be stored; the sender retries.
+        uint64_t at = (uint64_t)(hdr->seq - ss->agreed.start_seq) * ss->agreed.payload;
+        if (len > ss->agreed.payload || pwrite(ss->fd, payload, len, (off_t)at) != (ssize_t)len) {
+            return;
+        }
+        ss->seen[hdr->seq % win] = 1;
+        ss->bytes += len;
+        if (at + len > ss->end) {
+            ss->end = at + len;
+        }
+        while (ss->seen[ss->expected % win]) {
+            ss->seen[ss->expected % win] = 0;
+            ss->expected++;
+        }
+    }
+    uint32_t ack = ss->agreed.ack_mode == PKT_ACK_CUMULATIVE ? ss->expected : hdr->seq;
+    uint8_t buf[PKT_HDR_LEN];
+    send_to(w, ss, buf,
+            pkt_build_ack_wnd(buf, sizeof(buf), ack, hdr->flags & PKT_FLAG_CE, ss->expected + win));
+}
+
+// The first FIN in order ends the session: compare digests, then rename
+// the file into place. Later FINs get the same answer.
+static void on_fin(rd_worker_t *w, rd_session_t *ss, const pkt_hdr_t *hdr,
+                   const uint8_t *payload, uint16_t len, uint64_t now) {
+    if (!ss->fin && hdr->seq == ss->expected) {
+        bool ok = true;
+        if ((hdr->flags & PKT_FLAG_DIGEST) && len == SHA256_LEN) {
+            sha256_t digest;
+            uint8_t mine[SHA256_LEN];
+            sha256_init(&digest);
+            ok = sha256_fd(&digest, ss->fd, ss->end) == 0;
+            sha256_final(&digest, mine);
+            ok = ok && memcmp(mine, payload, SHA256_LEN) == 0;
+            ss->finflags = PKT_FLAG_DIGEST | (ok ? 0 : PKT_FLAG_DIGEST_BAD);
+        }
+        ok = close(ss->fd) == 0 && ok;
+        ss->fd = -1;
+        char part[4096];
+        char final[4096];
+        part_path(w->cfg, ss->id, part, sizeof(part));
+        snprintf(final, sizeof(final), "%s/session-%08x", w->cfg->dir, ss->id);
+        if (ok && rename(part, final) != 0) {
+            perror(final);
+            ok = false;
+        }
+        ss->fin = true;
+        ss->last_ms = now;
+        report(ss, ok ? "ok" : "failed", now);
+        atomic_fetch_add(ok ? &n_done : &n_failed, 1);
+        atomic_fetch_add(&bytes_total, ss->bytes);
+        atomic_fetch_add(&finished, 1);
+    }
+    uint8_t buf[PKT_HDR_LEN];
+    send_to(w, ss, buf,
+            pkt_build_finack_wnd(buf, sizeof(buf), ss->expected, ss->finflags,
+                                 ss->expected + ss->agreed.window));
+}
+
+static void on_packet(rd_worker_t *w, const netif_dgram_t *d, uint64_t now) {
+    pkt_hdr_t hdr;
+    const uint8_t *payload = NULL;
+    uint16_t len = 0;
+    if (pkt_parse(d->buf, d->len, &hdr, &payload, &len) != 0) {
+        return;
+    }
+    if (hdr.type == PKT_TYPE_SYN) {
+        on_syn(w, &d->addr, payload, len, now);
+        return;
+    }
+    rd_session_t *ss = table_find(&w->table, &d->addr);
+    if (!ss) {
+        return;
+    }
+    if (hdr.type == PKT_TYPE_DATA) {
+        on_data(w, ss, &hdr, payload, len, now);
+    } else if (hdr.type == PKT_TYPE_FIN) {
+        on_fin(w, ss, &hdr, payload, len, now);
+    }
+}
+
+// Drop finished sessions after their linger time and idle ones after
+// --idle_ms. A removal may shift a later entry into slot i, so i is
+// looked at again.
+static void sweep(rd_worker_t *w, uint64_t now) {
+    rd_table_t *t = &w->table;
+    for (size_t i = 0; i < t->cap;) {
+        rd_session_t *ss = &t->slots[i];
+        if (ss->addr.sin_family && ss->fin && now - ss->last_ms >= RD_LINGER_MS) {
+            session_drop(w, ss);
+        } else if (ss->addr.sin_family && !ss->fin && now - ss->last_ms >= (uint64_t)w->cfg->idle_ms) {
+            session_expire(w, ss, "expired", now);
+        } else {
+            i++;
+        }
+    }
+}
+
+static void *worker_main(void *arg) {
+    rd_worker_t *w = arg;
+    size_t cap = PKT_HDR_LEN + PKT_FEC_HDR_LEN + w->cfg->mss;
+    uint8_t *bufs = malloc(RD_BATCH * cap);
+    w->plain = malloc(w->cfg->mss);
+    if (!bufs || !w->plain) {
+        perror("malloc");
+        atomic_store(&stop, 1);
+        free(bufs);
+        return NULL;
+    }
+    netif_dgram_t d[RD_BATCH];
+    for (int i = 0; i < RD_BATCH; i++) {
+        d[i].buf = bufs + (size_t)i * cap;
+        d[i].cap = cap;
+    }
+    pkt_set_payload_limit(w->cfg->mss);
+
+    uint64_t next_sweep = clock_now_ms() + RD_TICK_MS;
+    while (!atomic_load(&stop)) {
+        int n = netif_recv_batch(w->sock, d, RD_BATCH, RD_TICK_MS);
+        if (n < 0) {
+            perror("recv");
+            atomic_store(&stop, 1);
+            break;
+        }
+        uint64_t now = clock_now_ms();
+        for (int i = 0; i < n; i++) {
+            on_packet(w, &d[i], now);
+        }
+        if (now >= next_sweep) {
+            sweep(w, now);
+            next_sweep = now + RD_TICK_MS;
+        }
+    }
+
+    // Whatever is still open at shutdown stays behind as .part files.
+    for (size_t i = 0; i < w->table.cap; i++) {
+        rd_session_t *ss = &w->table.slots[i];
+        if (ss->addr.sin_family) {
+            if (ss->fd >= 0) {
+                close(ss->fd);
+            }
+            free(ss->seen);
+        }
+    }
+    free(w->table.slots);
+    free(w->plain);
+    free(bufs);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    int listen_port = -1;
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int win = 0;
+    int mss = MAX_PAYLOAD;
+    rd_cfg_t cfg = {NULL, 0, 0, 30000, 4096, 0};
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            listen_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--out_dir") == 0 && i + 1 < argc) {
+            cfg.dir = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--win") == 0 && i + 1 < argc) {
+            win = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mss") == 0 && i + 1 < argc) {
+            mss = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max_sessions") == 0 && i + 1 < argc) {
+            cfg.max_sessions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--idle_ms") == 0 && i + 1 < argc) {
+            cfg.idle_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--exit_after") == 0 && i + 1 < argc) {
+            cfg.exit_after = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (workers < 1) {
+        workers = 1;
+    }
+    if (listen_port <= 0 || !cfg.dir || workers > 256 || win < 0 || win > UINT16_MAX ||
+        mss <= 0 || mss > MAX_PAYLOAD || cfg.max_sessions < 1 || cfg.idle_ms <= 0 ||
+        cfg.exit_after < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.mss = (uint16_t)mss;
+    cfg.win = (uint16_t)win;
+
+    // One socket per worker in an SO_REUSEPORT group; the emulator gives
+    // every sender its own proxy address, so senders spread over them.
+    rd_worker_t *w = calloc((size_t)workers, sizeof(rd_worker_t));
+    if (!w) {
+        perror("calloc");
+        return 1;
+    }
+    for (int i = 0; i < workers; i++) {
+        w[i].cfg = &cfg;
+        w[i].sock = netif_socket();
+        if (w[i].sock < 0 || netif_enable_reuseport(w[i].sock) != 0 ||
+            netif_bind(w[i].sock, listen_port) != 0) {
+            fprintf(stderr, "cannot bind worker %d to port %d\n", i, listen_port);
+            return 1;
+        }
+        // Windows from many senders arrive at once.
+        int bufsz = 4 << 20;
+        setsockopt(w[i].sock, SOL_SOCKET, SO_RCVBUF, &bufsz, sizeof(bufsz));
+    }
+    // All workers share one address, so one registration covers them.
+    if (netif_listen(w[0].sock) != 0) {
+        fprintf(stderr, "cannot register with the emulator\n");
+        return 1;
+    }
+
+    // Workers never see the stop signals; main waits for them.
+    sigset_t stop_set;
+    sigemptyset(&stop_set);
+    sigaddset(&stop_set, SIGINT);
+    sigaddset(&stop_set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_set, NULL);
+    int started = 0;
+    for (; started < workers; started++) {
+        if (pthread_create(&w[started].thread, NULL, worker_main, &w[started]) != 0) {
+            perror("pthread_create");
+            atomic_store(&stop, 1);
+            break;
+        }
+    }
+    struct timespec tick = {0, RD_TICK_MS * 1000000L};
+    while (!atomic_load(&stop)) {
+        if (sigtimedwait(&stop_set, NULL, &tick) > 0) {
+            break;
+        }
+        if (cfg.exit_after && atomic_load(&finished) >= cfg.exit_after) {
+            break;
+        }
+    }
+    atomic_store(&stop, 1);
+    for (int i = 0; i < started; i++) {
+        pthread_join(w[i].thread, NULL);
+        close(w[i].sock);
+    }
+    free(w);
+
+    printf("SESSIONS_DONE=%llu\n", (unsigned long long)atomic_load(&n_done));
+    printf("SESSIONS_FAILED=%llu\n", (unsigned long long)atomic_load(&n_failed));
+    printf("SESSIONS_EXPIRED=%llu\n", (unsigned long long)atomic_load(&n_expired));
+    printf("REFUSED_SYNS=%llu\n", (unsigned long long)atomic_load(&n_refused));
+    printf("SESSIONS_PEAK=%d\n", atomic_load(&peak));
+    printf("BYTES=%llu\n", (unsigned long long)atomic_load(&bytes_total));
+    printf("CPU_MS=%llu\n", (unsigned long long)cpu_time_ms());
+    return started == workers && atomic_load(&n_failed) == 0 ? 0 : 1;
+}
@@ -0,0 +1,276 @@
+-- Wireshark dissector for the reliable transport (include/protocol.h).
+--
+-- Load it with `wireshark -X lua_script:scripts/rdt.lua capture.pcap`, or
+-- copy it to the personal Lua plugins folder. It picks up any UDP
+-- datagram that starts with the magic 0xCCAA and whose len field matches,
+-- plus the emulator's "HELLO <port>" registrations. Files written with
+-- RDT_PCAP (see README) open as they are.
+--
+-- Display filters: rdt.type == 0 (DATA), rdt.seq, rdt.flags.ce, ...
+-- rdt.analysis.retransmission marks a DATA or PARITY packet already seen
+-- in the same direction, rdt.analysis.dup_ack an ACK equal to the one
+-- before it. The CRC is shown but not checked.
+
+local rdt = Proto("rdt", "Reliable Transport")
+
+local MAGIC = 0xCCAA
+local HDR_LEN = 18
+
+local types = {
+    [0] = "DATA", [1] = "ACK", [2] = "FIN", [3] = "FINACK",
+    [4] = "SYN", [5] = "SYNACK", [6] = "PARITY",
+}
+local ack_modes = { [0] = "either", [1] = "cumulative", [2] = "selective" }
+
+local f = rdt.fields
+f.magic = ProtoField.uint16("rdt.magic", "Magic", base.HEX)
+f.type = ProtoField.uint8("rdt.type", "Type", base.DEC, types)
+f.flags = ProtoField.uint8("rdt.flags", "Flags", base.HEX)
+f.flag_stream = ProtoField.bool("rdt.flags.stream", "STREAM", 8, nil, 0x01)
+f.flag_stream_open = ProtoField.bool("rdt.flags.stream_open", "STREAM_OPEN", 8, nil, 0x02)
+f.flag_fec = ProtoField.bool("rdt.flags.fec", "FEC", 8, nil, 0x04)
+f.flag_ce = ProtoField.bool("rdt.flags.ce", "CE", 8, nil, 0x08)
+f.flag_rwnd = ProtoField.bool("rdt.flags.rwnd", "RWND", 8, nil, 0x10)
+f.flag_digest = ProtoField.bool("rdt.flags.digest", "DIGEST", 8, nil, 0x20)
+f.flag_digest_bad = ProtoField.bool("rdt.flags.digest_bad", "DIGEST_BAD", 8, nil, 0x40)
+f.flag_lz = ProtoField.bool("rdt.flags.lz", "LZ", 8, nil, 0x80)
+f.seq = ProtoField.uint32("rdt.seq", "Seq", base.DEC)
+f.ack = ProtoField.uint32("rdt.ack", "Ack", base.DEC)
+f.len = ProtoField.uint16("rdt.len", "Payload length", base.DEC)
+f.crc = ProtoField.uint32("rdt.crc32", "CRC-32", base.HEX)
+f.payload = ProtoField.bytes("rdt.payload", "Payload")
+
+f.syn_payload = ProtoField.uint16("rdt.syn.payload", "Payload size", base.DEC)
+f.syn_window = ProtoField.uint16("rdt.syn.window", "Window", base.DEC)
+f.syn_ack_mode = ProtoField.uint8("rdt.syn.ack_mode", "ACK mode", base.DEC, ack_modes)
+f.syn_features = ProtoField.uint8("rdt.syn.features", "Features", base.HEX)
+f.feat_stream = ProtoField.bool("rdt.syn.features.stream", "STREAM", 8, nil, 0x01)
+f.feat_fec = ProtoField.bool("rdt.syn.features.fec", "FEC", 8, nil, 0x02)
+f.feat_resume = ProtoField.bool("rdt.syn.features.resume", "RESUME", 8, nil, 0x04)
+f.feat_compress = ProtoField.bool("rdt.syn.features.compress", "COMPRESS", 8, nil, 0x08)
+f.feat_zero_rtt = ProtoField.bool("rdt.syn.features.zero_rtt", "ZERO_RTT", 8, nil, 0x80)
+f.syn_start_seq = ProtoField.uint32("rdt.syn.start_seq", "Start seq", base.DEC)
+f.syn_resume_seq = ProtoField.uint32("rdt.syn.resume_seq", "Resume seq", base.DEC)
+f.syn_session = ProtoField.uint32("rdt.syn.session", "Session", base.HEX)
+
+f.stream_id = ProtoField.uint32("rdt.stream.id", "Stream id", base.DEC)
+f.stream_offset = ProtoField.uint64("rdt.stream.offset", "Stream offset", base.DEC)
+
+f.fec_n = ProtoField.uint8("rdt.fec.n", "Block packets", base.DEC)
+f.fec_k = ProtoField.uint8("rdt.fec.k", "Parity groups", base.DEC)
+f.fec_index = ProtoField.uint8("rdt.fec.index", "Group", base.DEC)
+f.fec_flags_xor = ProtoField.uint8("rdt.fec.flags_xor", "Flags XOR", base.HEX)
+f.fec_len_xor = ProtoField.uint16("rdt.fec.len_xor", "Length XOR", base.HEX)
+
+f.digest = ProtoField.bytes("rdt.digest", "SHA-256")
+f.hello = ProtoField.uint16("rdt.hello", "HELLO peer port", base.DEC)
+
+f.retx = ProtoField.framenum("rdt.analysis.retransmission", "Retransmission of frame")
+f.dup_ack = ProtoField.framenum("rdt.analysis.dup_ack", "Duplicate of ACK in frame")
+
+local ef_retx = ProtoExpert.new("rdt.analysis.retransmission.expert", "Retransmission",
+                                expert.group.SEQUENCE, expert.severity.NOTE)
+local ef_dup_ack = ProtoExpert.new("rdt.analysis.dup_ack.expert", "Duplicate ACK",
+                                   expert.group.SEQUENCE, expert.severity.NOTE)
+local ef_digest_bad = ProtoExpert.new("rdt.digest_bad.expert", "Receiver digest mismatch",
+                                      expert.group.PROTOCOL, expert.severity.ERROR)
+rdt.experts = { ef_retx, ef_dup_ack, ef_digest_bad }
+
+-- Per-direction state, filled on the first pass: the first frame of each
+-- DATA/PARITY seq and the last ACK. Results are kept per frame so later
+-- passes show the same thing.
+local first_seen = {}
+local last_ack = {}
+local analysis = {}
+
+function rdt.init()
+    first_seen = {}
+    last_ack = {}
+    analysis = {}
+end
+
+local function direction(pinfo)
+    return tostring(pinfo.src) .. ":" .. pinfo.src_port .. ">" ..
+           tostring(pinfo.dst) .. ":" .. pinfo.dst_port
+end
+
+local function analyze(pinfo, ptype, seq, ack)
+    local a = analysis[pinfo.number]
+    if a or pinfo.visited then
+        return a
+    end
+    a = {}
+    local dir = direction(pinfo)
+    if ptype == 0 or ptype == 6 then
+        -- The parity packets of one block share seq; ack tells them apart.
+        local key = dir .. "/" .. ptype .. "/" .. seq .. (ptype == 6 and "/" .. ack or "")
+        if first_seen[key] then
+            a.retx = first_seen[key]
+        else
+            first_seen[key] = pinfo.number
+        end
+    elseif ptype == 1 then
+        local prev = last_ack[dir]
+        if prev and prev.ack == ack then
+            a.dup_ack = prev.frame
+        else
+            last_ack[dir] = { ack = ack, frame = pinfo.number }
+        end
+    end
+    analysis[pinfo.number] = a
+    return a
+end
+
+-- Single-bit test that needs no bit library (Lua 5.1 to 5.4).
+local function has(flags, mask)
+    return math.floor(flags / mask) % 2 == 1
+end
+
+local function add_flags(tree, buf)
+    local ft = tree:add(f.flags, buf)
+    ft:add(f.flag_stream, buf)
+    ft:add(f.flag_stream_open, buf)
+    ft:add(f.flag_fec, buf)
+    ft:add(f.flag_ce, buf)
+    ft:add(f.flag_rwnd, buf)
+    ft:add(f.flag_digest, buf)
+    ft:add(f.flag_digest_bad, buf)
+    ft:add(f.flag_lz, buf)
+end
+
+local function dissect_syn(tree, body)
+    local n = body:len()
+    tree:add(f.syn_payload, body(0, 2))
+    if n >= 10 then
+        tree:add(f.syn_window, body(2, 2))
+        tree:add(f.syn_ack_mode, body(4, 1))
+        local ft = tree:add(f.syn_features, body(5, 1))
+        ft:add(f.feat_stream, body(5, 1))
+        ft:add(f.feat_fec, body(5, 1))
+        ft:add(f.feat_resume, body(5, 1))
+        ft:add(f.feat_compress, body(5, 1))
+        ft:add(f.feat_zero_rtt, body(5, 1))
+        tree:add(f.syn_start_seq, body(6, 4))
+    end
+    if n >= 14 then
+        tree:add(f.syn_resume_seq, body(10, 4))
+    end
+    if n >= 18 then
+        tree:add(f.syn_session, body(14, 4))
+    end
+end
+
+local function dissect_hello(buf, pinfo, tree)
+    local text = buf:raw(6)
+    local port = tonumber(text:match("^%s*(%d+)%s*$"))
+    if not port then
+        return 0
+    end
+    pinfo.cols.protocol = "RDT"
+    pinfo.cols.info = "HELLO " .. port .. (port == 0 and " (listener)" or "")
+    local t = tree:add(rdt, buf(), "Reliable Transport, HELLO")
+    t:add(f.hello, buf(6), port)
+    return buf:len()
+end
+
+function rdt.dissector(buf, pinfo, tree)
+    local n = buf:len()
+    if n > 6 and buf:raw(0, 6) == "HELLO " then
+        return dissect_hello(buf, pinfo, tree)
+    end
+    if n < HDR_LEN or buf(0, 2):uint() ~= MAGIC or buf(12, 2):uint() + HDR_LEN ~= n then
+        return 0
+    end
+    local ptype = buf(2, 1):uint()
+    local flags = buf(3, 1):uint()
+    local seq = buf(4, 4):uint()
+    local ack = buf(8, 4):uint()
+    local len = buf(12, 2):uint()
+    local name = types[ptype] or ("TYPE" .. ptype)
+
+    pinfo.cols.protocol = "RDT"
+    local t = tree:add(rdt, buf(), "Reliable Transport, " .. name)
+    t:add(f.magic, buf(0, 2))
+    t:add(f.type, buf(2, 1))
+    add_flags(t, buf(3, 1))
+    t:add(f.seq, buf(4, 4))
+    t:add(f.ack, buf(8, 4))
+    t:add(f.len, buf(12, 2))
+    t:add(f.crc, buf(14, 4))
+    local body = len > 0 and buf(HDR_LEN, len) or nil
+
+    local info
+    if ptype == 0 then
+        info = string.format("DATA seq=%u len=%u", seq, len)
+        if body and has(flags, 0x01) and len >= 12 then
+            t:add(f.stream_id, body(0, 4))
+            t:add(f.stream_offset, body(4, 8))
+        end
+    elseif ptype == 1 then
+        info = string.format("ACK ack=%u", ack)
+        if has(flags, 0x10) then
+            info = info .. string.format(" wnd_edge=%u", seq)
+        end
+    elseif ptype == 2 then
+        info = string.format("FIN seq=%u", seq)
+        if body and has(flags, 0x20) and len == 32 then
+            t:add(f.digest, body)
+            body = nil
+        end
+    elseif ptype == 3 then
+        info = string.format("FINACK ack=%u", ack)
+        if has(flags, 0x40) then
+            t:add_proto_expert_info(ef_digest_bad)
+        end
+    elseif ptype == 4 or ptype == 5 then
+        info = name
+        if body and len >= 2 then
+            dissect_syn(t, body)
+            if len >= 18 then
+                info = info .. string.format(" session=%08x", body(14, 4):uint())
+            end
+            body = nil
+        end
+    elseif ptype == 6 then
+        info = string.format("PARITY base=%u", seq)
+        t:add(f.fec_n, buf(8, 1))
+        t:add(f.fec_k, buf(9, 1))
+        t:add(f.fec_index, buf(10, 1))
+        t:add(f.fec_flags_xor, buf(11, 1))
+        if body and len >= 2 then
+            t:add(f.fec_len_xor, body(0, 2))
+        end
+    else
+        info = name
+    end
+    if has(flags, 0x08) then
+        info = info .. " CE"
+    end
+    if has(flags, 0x80) then
+        info = info .. " LZ"
+    end
+    if body then
+        t:add(f.payload, body)
+    end
+
+    local a = analyze(pinfo, ptype, seq, ack)
+    if a and a.retx then
+        t:add(f.retx, a.retx):set_generated()
+        t:add_proto_expert_info(ef_retx)
+        info = "[RETX] " .. info
+    elseif a and a.dup_ack then
+        t:add(f.dup_ack, a.dup_ack):set_generated()
+        t:add_proto_expert_info(ef_dup_ack)
+        info = "[DUP ACK] " .. info
+    end
+    pinfo.cols.info = info
+    return n
+end
+
+local function heuristic(buf, pinfo, tree)
+    return rdt.dissector(buf, pinfo, tree) > 0
+end
+
+rdt:register_heuristic("udp", heuristic)
+-- The emulator's default port, so "Decode As" lists the protocol.
+DissectorTable.get("udp.port"):add(11000, rdt)
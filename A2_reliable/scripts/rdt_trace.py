@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+import argparse
+import csv
+import heapq
+import json
+import struct
+import sys
+
+
+# Layout of include/trace.h: trace_file_hdr_t, then trace_rec_t records.
+MAGIC = b"RDTTRC1\0"
+FILE_HDR = struct.Struct("<8sII")
+REC = struct.Struct("<QIIIIHHBB2x")
+
+EVENTS = {
+    1: "data_send",
+    2: "data_retx",
+    3: "ack_recv",
+    4: "timeout",
+    5: "data_recv",
+    6: "ack_send",
+    7: "deliver",
+    8: "fec_recover",
+}
+
+FIELDS = ["t_ms", "port", "event", "seq", "ack", "cwnd", "rto_ms", "len", "flags"]
+
+
+def read_trace(path):
+    with open(path, "rb") as f:
+        head = f.read(FILE_HDR.size)
+        if len(head) < FILE_HDR.size:
+            raise ValueError(f"{path}: not a trace file")
+        magic, rec_size, _port = FILE_HDR.unpack(head)
+        if magic != MAGIC or rec_size != REC.size:
+            raise ValueError(f"{path}: not a trace file")
+        data = f.read()
+    # A truncated last record (the writer was killed) is dropped.
+    for off in range(0, len(data) - REC.size + 1, REC.size):
+        ts, seq, ack, cwnd, rto, length, port, typ, flags = REC.unpack_from(data, off)
+        yield ts, {
+            "port": port,
+            "event": EVENTS.get(typ, str(typ)),
+            "seq": seq,
+            "ack": ack,
+            "cwnd": cwnd,
+            "rto_ms": rto,
+            "len": length,
+            "flags": flags,
+        }
+
+
+def main():
+    p = argparse.ArgumentParser(description="Decode binary event traces (make TRACE=1, RDT_TRACE=prefix)")
+    p.add_argument("files", nargs="+", help="trace files; several are merged by timestamp")
+    p.add_argument("--json", action="store_true", help="one JSON object per line instead of CSV")
+    args = p.parse_args()
+
+    try:
+        # Each file is in time order already, so a merge keeps it cheap.
+        merged = heapq.merge(*(read_trace(path) for path in args.files), key=lambda r: r[0])
+        t0 = None
+        out = None
+        if not args.json:
+            out = csv.DictWriter(sys.stdout, fieldnames=FIELDS)
+            out.writeheader()
+        for ts, rec in merged:
+            if t0 is None:
+                t0 = ts
+            row = {"t_ms": round((ts - t0) / 1e6, 3), **rec}
+            if args.json:
+                print(json.dumps(row))
+            else:
+                out.writerow(row)
+    except (OSError, ValueError) as e:
+        print(e, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
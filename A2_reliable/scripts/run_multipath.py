@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+import argparse
+import hashlib
+import json
+import os
+import signal
+import subprocess
+import sys
+import time
+
+
+ROOT_DIR = os.path.abspath(os.path.join(os.path.dirname(__file__), ".."))
+TMP_DIR = os.path.join(ROOT_DIR, "tmp_reliable")
+
+FILE_SIZE_BYTES = 2 * 1024 * 1024
+TIMEOUT_MS = 200
+SENDER_TIMEOUT_SEC = 120
+RECEIVER_TIMEOUT_SEC = 120
+EMU_PORT = 11100
+# Path i: sender BASE_PORT + i, receiver BASE_PORT + 20 + i, emulator EMU_PORT + i.
+BASE_PORT = 10100
+RECV_OFFSET = 20
+
+
+def write_random_file(path, size_bytes):
+    with open(path, "wb") as f:
+        f.write(os.urandom(size_bytes))
+
+
+def sha256_file(path):
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for chunk in iter(lambda: f.read(1024 * 1024), b""):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def parse_kv(text):
+    out = {}
+    for line in text.splitlines():
+        if "=" not in line or line.startswith("FLOW "):
+            continue
+        key, val = line.split("=", 1)
+        out[key.strip()] = val.strip()
+    return out
+
+
+def parse_path(spec):
+    # "rate_kbps:delay_ms:loss"; a rate of 0 leaves the path unlimited.
+    parts = spec.split(":")
+    if len(parts) != 3:
+        raise argparse.ArgumentTypeError(f"bad path '{spec}', want rate_kbps:delay_ms:loss")
+    return {"rate_kbps": float(parts[0]), "delay_ms": float(parts[1]), "loss": float(parts[2])}
+
+
+def main():
+    p = argparse.ArgumentParser(description="Run one SR transfer over several emulated paths")
+    p.add_argument("--path", type=parse_path, action="append",
+                   help="rate_kbps:delay_ms:loss of one path, repeated per path (default: two paths)")
+    p.add_argument("--win", type=int, default=256)
+    p.add_argument("--size_kb", type=int, default=FILE_SIZE_BYTES // 1024)
+    args = p.parse_args()
+    paths = args.path or [parse_path("8000:20:0"), parse_path("4000:40:0")]
+    if len(paths) > 8:
+        p.error("at most 8 paths")
+
+    subprocess.run(["make", "-s"], cwd=ROOT_DIR, check=True)
+
+    run_dir = os.path.join(TMP_DIR, "multipath")
+    os.makedirs(run_dir, exist_ok=True)
+    input_file = os.path.join(run_dir, "input.bin")
+    out_file = os.path.join(run_dir, "output.bin")
+    write_random_file(input_file, args.size_kb * 1024)
+    if os.path.exists(out_file):
+        os.remove(out_file)
+
+    emulators = []
+    for i, path in enumerate(paths):
+        cmd = [os.path.join(ROOT_DIR, "emulator"),
+               "--port", str(EMU_PORT + i),
+               "--loss", str(path["loss"]),
+               "--delay_ms", str(path["delay_ms"]),
+               "--seed", str(i + 1)]
+        if path["rate_kbps"] > 0:
+            cmd += ["--rate_kbps", str(path["rate_kbps"])]
+        emulators.append(subprocess.Popen(cmd, stdout=subprocess.DEVNULL,
+                                          stderr=subprocess.DEVNULL))
+    time.sleep(0.2)
+
+    env = dict(os.environ, RELIABLE_EMU_PORT=str(EMU_PORT),
+               RELIABLE_EMU_PORTS=",".join(str(EMU_PORT + i) for i in range(len(paths))))
+    npaths = str(len(paths))
+    receiver = subprocess.Popen(
+        [os.path.join(ROOT_DIR, "receiver_sr"),
+         "--listen", str(BASE_PORT + RECV_OFFSET), "--peer_ip", "127.0.0.1",
+         "--peer_port", str(BASE_PORT), "--out", out_file, "--paths", npaths],
+        env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    time.sleep(0.1)
+    sender = subprocess.Popen(
+        [os.path.join(ROOT_DIR, "sender_sr"),
+         "--listen", str(BASE_PORT), "--peer_ip", "127.0.0.1",
+         "--peer_port", str(BASE_PORT + RECV_OFFSET), "--in", input_file,
+         "--win", str(args.win), "--timeout", str(TIMEOUT_MS), "--paths", npaths],
+        env=env, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+
+    try:
+        out, _ = sender.communicate(timeout=SENDER_TIMEOUT_SEC)
+        sender_rc = sender.returncode
+    except subprocess.TimeoutExpired:
+        sender.kill()
+        out, _ = sender.communicate()
+        sender_rc = 124
+    try:
+        receiver.wait(timeout=RECEIVER_TIMEOUT_SEC)
+    except subprocess.TimeoutExpired:
+        receiver.kill()
+        receiver.wait()
+    for emulator in emulators:
+        emulator.send_signal(signal.SIGTERM)
+        emulator.wait()
+
+    stats = parse_kv(out)
+    for i, path in enumerate(paths):
+        print(json.dumps({
+            "path": i,
+            "rate_kbps": path["rate_kbps"],
+            "delay_ms": path["delay_ms"],
+            "loss": path["loss"],
+            "pkts": int(stats.get(f"PATH{i}_PKTS", "0") or 0),
+            "lost": int(stats.get(f"PATH{i}_LOST", "0") or 0),
+            "srtt_ms": float(stats.get(f"PATH{i}_SRTT_MS", "0") or 0),
+            "rate_pps": float(stats.get(f"PATH{i}_RATE_PPS", "0") or 0),
+        }))
+    hash_ok = int(os.path.exists(out_file) and sha256_file(out_file) == sha256_file(input_file))
+    print(json.dumps({
+        "paths": len(paths),
+        "hash_ok": hash_ok,
+        "sender_rc": sender_rc,
+        "goodput_kbps": float(stats.get("GOODPUT_KBPS", "0") or 0),
+        "data_retx": int(stats.get("DATA_RETX_PKTS", "0") or 0),
+    }))
+    return 0 if hash_ok and sender_rc == 0 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+import argparse
+import hashlib
+import json
+import os
+import resource
+import shutil
+import signal
+import subprocess
+import sys
+import time
+
+
+ROOT_DIR = os.path.abspath(os.path.join(os.path.dirname(__file__), ".."))
+TMP_DIR = os.path.join(ROOT_DIR, "tmp_reliable")
+
+TIMEOUT_MS = 200
+SENDER_TIMEOUT_SEC = 300
+EMU_PORT = 11200
+# Sender i listens on SENDER_BASE_PORT + i; the daemon on DAEMON_PORT.
+DAEMON_PORT = 10200
+SENDER_BASE_PORT = 20000
+
+
+def sha256_file(path):
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for chunk in iter(lambda: f.read(1024 * 1024), b""):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def parse_kv(text):
+    out = {}
+    for line in text.splitlines():
+        if "=" not in line or line.startswith("SESSION "):
+            continue
+        key, val = line.split("=", 1)
+        out[key.strip()] = val.strip()
+    return out
+
+
+def main():
+    p = argparse.ArgumentParser(description="Run many concurrent transfers into one receiverd")
+    p.add_argument("--senders", type=int, default=100)
+    p.add_argument("--mode", choices=["sr", "gbn", "mix"], default="mix")
+    p.add_argument("--workers", type=int, default=0, help="receiverd --workers (default: its own)")
+    p.add_argument("--win", type=int, default=32)
+    p.add_argument("--size_kb", type=int, default=100)
+    p.add_argument("--loss", type=float, default=0.01)
+    p.add_argument("--delay_ms", type=float, default=10)
+    p.add_argument("--rate_kbps", type=float, default=2000, help="per-sender link rate")
+    args = p.parse_args()
+    if args.senders < 1 or SENDER_BASE_PORT + args.senders > 32768:
+        p.error("--senders must be between 1 and %d" % (32768 - SENDER_BASE_PORT))
+
+    # Every sender is a process and the emulator holds a socket per sender.
+    _, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+    subprocess.run(["make", "-s"], cwd=ROOT_DIR, check=True)
+
+    run_dir = os.path.join(TMP_DIR, "receiverd")
+    out_dir = os.path.join(run_dir, "out")
+    shutil.rmtree(run_dir, ignore_errors=True)
+    os.makedirs(out_dir)
+    inputs = []
+    for i in range(args.senders):
+        # Sizes differ a little so a session written to the wrong file shows.
+        path = os.path.join(run_dir, f"input{i}.bin")
+        with open(path, "wb") as f:
+            f.write(os.urandom(args.size_kb * 1024 - i % 1000))
+        inputs.append(path)
+
+    emulator = subprocess.Popen(
+        [os.path.join(ROOT_DIR, "emulator"), "--port", str(EMU_PORT),
+         "--loss", str(args.loss), "--delay_ms", str(args.delay_ms),
+         "--rate_kbps", str(args.rate_kbps)],
+        stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    time.sleep(0.2)
+
+    env = dict(os.environ, RELIABLE_EMU_PORT=str(EMU_PORT))
+    cmd = [os.path.join(ROOT_DIR, "receiverd"), "--listen", str(DAEMON_PORT),
+           "--out_dir", out_dir, "--exit_after", str(args.senders)]
+    if args.workers > 0:
+        cmd += ["--workers", str(args.workers)]
+    daemon = subprocess.Popen(cmd, env=env, stdout=subprocess.PIPE,
+                              stderr=subprocess.DEVNULL, text=True)
+    time.sleep(0.2)
+
+    start = time.time()
+    senders = []
+    for i, path in enumerate(inputs):
+        mode = args.mode if args.mode != "mix" else ("sr", "gbn")[i % 2]
+        senders.append(subprocess.Popen(
+            [os.path.join(ROOT_DIR, f"sender_{mode}"),
+             "--listen", str(SENDER_BASE_PORT + i), "--peer_ip", "127.0.0.1",
+             "--peer_port", str(DAEMON_PORT), "--in", path, "--win", str(args.win),
+             "--timeout", str(TIMEOUT_MS), "--session", str(i + 1)],
+            env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL))
+    deadline = time.time() + SENDER_TIMEOUT_SEC
+    failed = 0
+    for sender in senders:
+        try:
+            rc = sender.wait(timeout=max(deadline - time.time(), 1))
+        except subprocess.TimeoutExpired:
+            sender.kill()
+            rc = sender.wait()
+        failed += rc != 0
+    elapsed = time.time() - start
+
+    try:
+        out, _ = daemon.communicate(timeout=5)
+    except subprocess.TimeoutExpired:
+        daemon.send_signal(signal.SIGTERM)
+        out, _ = daemon.communicate()
+    emulator.send_signal(signal.SIGTERM)
+    emulator.wait()
+
+    hash_ok = 0
+    for i, path in enumerate(inputs):
+        got = os.path.join(out_dir, "session-%08x" % (i + 1))
+        hash_ok += os.path.exists(got) and sha256_file(got) == sha256_file(path)
+    stats = parse_kv(out)
+    print(json.dumps({
+        "senders": args.senders,
+        "mode": args.mode,
+        "failed_senders": failed,
+        "hash_ok": hash_ok,
+        "seconds": round(elapsed, 2),
+        "sessions_done": int(stats.get("SESSIONS_DONE", "0") or 0),
+        "sessions_peak": int(stats.get("SESSIONS_PEAK", "0") or 0),
+        "refused_syns": int(stats.get("REFUSED_SYNS", "0") or 0),
+        "daemon_cpu_ms": int(stats.get("CPU_MS", "0") or 0),
+    }))
+    return 0 if hash_ok == args.senders else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -3,9 +3,12 @@ import argparse
 import hashlib
 import json
 import os
+import queue
 import subprocess
 import sys
+import threading
 import time
+from concurrent.futures import ThreadPoolExecutor
 
 
 ROOT_DIR = os.path.abspath(os.path.join(os.path.dirname(__file__), ".."))
@@ -15,6 +18,9 @@ TIMEOUT_MS = 500
 SENDER_TIMEOUT_SEC = 60
 RECEIVER_TIMEOUT_SEC = 60
 RATE_KBPS = 1500
+# Worker slot i runs its sender, receiver and emulator on PORT_BASE + 3i,
+# + 3i + 1 and + 3i + 2, so concurrent cases never share a port.
+PORT_BASE = 12000
 
 LOSS_VALUES = [0.00, 0.02, 0.04, 0.06, 0.08, 0.10]
 DELAY_VALUES = [0, 25, 50, 75, 100, 125]
@@ -40,6 +46,15 @@ def sha256_file(path):
     return h.hexdigest()
 
 
+def emulator_cmd():
+    # The C emulator (make emulator) keeps up with fast senders; fall back
+    # to emulator.py when it has not been built.
+    native = os.path.join(ROOT_DIR, "emulator")
+    if os.access(native, os.X_OK):
+        return [native]
+    return [sys.executable, os.path.join(ROOT_DIR, "emulator.py")]
+
+
 def parse_sender_stdout(stdout_text):
     out = {}
     for line in stdout_text.splitlines():
@@ -50,7 +65,13 @@ def parse_sender_stdout(stdout_text):
     return out
 
 
-def run_case(mode, sender_bin, receiver_bin, scenario, loss, delay_ms, reorder, win, input_file, tmp_dir):
+def run_case(mode, sender_bin, receiver_bin, scenario, loss, delay_ms, reorder, win, input_file, tmp_dir,
+             slot=0, interrupt_s=0, verify_files=False, compress=False):
+    started = time.monotonic()
+    sport = PORT_BASE + 3 * slot
+    rport = sport + 1
+    emu_port = sport + 2
+    env = dict(os.environ, RELIABLE_EMU_PORT=str(emu_port))
     label = f"{scenario}_l{loss}_d{delay_ms}_r{reorder}_w{win}"
     out_dir = os.path.join(tmp_dir, "outputs")
     log_dir = os.path.join(tmp_dir, "logs")
@@ -60,8 +81,10 @@ def run_case(mode, sender_bin, receiver_bin, scenario, loss, delay_ms, reorder,
     sender_log = os.path.join(log_dir, f"sender_{label}.log")
     sender_err = os.path.join(log_dir, f"sender_{label}.err")
 
+    emu = emulator_cmd()
     emulator = subprocess.Popen(
-        [sys.executable, os.path.join(ROOT_DIR, "emulator.py"),
+        emu + [
+         "--port", str(emu_port),
          "--loss", str(loss),
          "--delay_ms", str(delay_ms),
          "--reorder", str(reorder),
@@ -70,39 +93,62 @@ def run_case(mode, sender_bin, receiver_bin, scenario, loss, delay_ms, reorder,
         stdout=subprocess.DEVNULL,
         stderr=subprocess.DEVNULL,
     )
-    time.sleep(1)
+    # emulator.py needs longer than the C emulator to start listening.
+    time.sleep(0.3 if len(emu) == 1 else 1)
 
-    receiver = subprocess.Popen(
-        [receiver_bin,
-         "--listen", "10001",
-         "--peer_ip", "127.0.0.1",
-         "--peer_port", "10000",
-         "--out", out_file,
-         "--win", str(win)] if receiver_bin.endswith("_sr") else
-        [receiver_bin,
-         "--listen", "10001",
-         "--peer_ip", "127.0.0.1",
-         "--peer_port", "10000",
-         "--out", out_file],
-        stdout=subprocess.DEVNULL,
-        stderr=subprocess.DEVNULL,
-    )
-    time.sleep(0.1)
+    receiver_cmd = [
+        receiver_bin,
+        "--listen", str(rport),
+        "--peer_ip", "127.0.0.1",
+        "--peer_port", str(sport),
+        "--out", out_file,
+    ]
+    if receiver_bin.endswith("_sr"):
+        receiver_cmd += ["--win", str(win)]
+    if interrupt_s > 0:
+        receiver_cmd.append("--resume")
+        for stale in (out_file, out_file + ".ckpt"):
+            if os.path.exists(stale):
+                os.remove(stale)
 
     sender_cmd = [
         sender_bin,
-        "--listen", "10000",
+        "--listen", str(sport),
         "--peer_ip", "127.0.0.1",
-        "--peer_port", "10001",
+        "--peer_port", str(rport),
         "--in", input_file,
         "--win", str(win),
         "--timeout", str(TIMEOUT_MS),
     ]
     if mode == "sr_fast":
         sender_cmd.append("--fast_retx")
+    if compress:
+        sender_cmd.append("--compress")
+
+    if interrupt_s > 0:
+        # Kill both ends mid-transfer. The run below must pick up from the
+        # receiver's checkpoint and still produce an identical file.
+        first_r = subprocess.Popen(receiver_cmd, env=env,
+                                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        time.sleep(0.1)
+        first_s = subprocess.Popen(sender_cmd, env=env,
+                                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        time.sleep(interrupt_s)
+        for proc in (first_s, first_r):
+            proc.kill()
+            proc.wait()
+
+    receiver = subprocess.Popen(
+        receiver_cmd,
+        env=env,
+        stdout=subprocess.DEVNULL,
+        stderr=subprocess.DEVNULL,
+    )
+    time.sleep(0.1)
 
     sender = subprocess.Popen(
         sender_cmd,
+        env=env,
         stdout=subprocess.PIPE,
         stderr=subprocess.PIPE,
         text=True,
@@ -135,14 +181,19 @@ def run_case(mode, sender_bin, receiver_bin, scenario, loss, delay_ms, reorder,
     emulator.kill()
     emulator.wait()
 
+    stats = parse_sender_stdout(sender_out)
+    # The FIN exchange already compared SHA-256 digests; only read both
+    # files again when it did not (basic mode) or when asked to.
+    digest = stats.get("DIGEST", "")
     hash_ok = 0
-    if os.path.exists(out_file):
+    if digest in ("ok", "mismatch") and not verify_files:
+        hash_ok = int(digest == "ok")
+    elif os.path.exists(out_file):
         h1 = sha256_file(input_file)
         h2 = sha256_file(out_file)
         if h1 == h2:
             hash_ok = 1
 
-    stats = parse_sender_stdout(sender_out)
     data_sent = int(stats.get("DATA_SENT_PKTS", "0") or 0)
     data_retx = int(stats.get("DATA_RETX_PKTS", "0") or 0)
     retx_rate = (data_retx / data_sent) if data_sent > 0 else 0.0
@@ -154,7 +205,7 @@ def run_case(mode, sender_bin, receiver_bin, scenario, loss, delay_ms, reorder,
         "reorder": reorder,
         "win": win,
         "timeout_ms": TIMEOUT_MS,
-        "file_bytes": FILE_SIZE_BYTES,
+        "file_bytes": os.path.getsize(input_file),
         "rate_kbps": RATE_KBPS,
         "hash_ok": hash_ok,
         "goodput_kbps": float(stats.get("GOODPUT_KBPS", "0") or 0),
@@ -163,11 +214,106 @@ def run_case(mode, sender_bin, receiver_bin, scenario, loss, delay_ms, reorder,
         "retx_rate": retx_rate,
         "ack_rcvd": int(stats.get("ACK_RCVD_PKTS", "0") or 0),
         "elapsed_ms": int(float(stats.get("ELAPSED_MS", "0") or 0)),
+        "resumed_bytes": int(stats.get("RESUMED_BYTES", "0") or 0),
+        "digest": digest,
+        "compress_ratio": float(stats.get("COMPRESS_RATIO", "1") or 1),
         "sender_rc": sender_rc,
         "receiver_rc": receiver_rc,
+        "wall_s": round(time.monotonic() - started, 3),
     }
 
 
+def run_cases_parallel(mode, sender_bin, receiver_bin, cases, input_file, tmp_dir, jobs, interrupt_s=0,
+                       verify_files=False, compress=False):
+    # Each worker holds a port slot for the duration of a case; records
+    # come back in case order whatever order the cases finish in.
+    slots = queue.Queue()
+    for i in range(jobs):
+        slots.put(i)
+    total = len(cases)
+    done = [0]
+    lock = threading.Lock()
+
+    def one(case):
+        scenario, loss, delay_ms, reorder, win = case
+        slot = slots.get()
+        try:
+            rec = run_case(mode, sender_bin, receiver_bin, scenario, loss, delay_ms, reorder, win,
+                           input_file, tmp_dir, slot, interrupt_s, verify_files, compress)
+        finally:
+            slots.put(slot)
+        with lock:
+            done[0] += 1
+            print(f"[{done[0]}/{total}] {scenario} loss={loss} delay={delay_ms} "
+                  f"reorder={reorder} win={win} hash_ok={rec['hash_ok']} wall={rec['wall_s']}s",
+                  flush=True)
+        return rec
+
+    # Start the slowest cases first (small windows, long RTTs, high loss)
+    # so that one of them does not finish alone at the end.
+    def cost(case):
+        _, loss, delay_ms, _, win = case
+        return (2 * delay_ms + 10) * (1 + 10 * loss) / win
+
+    order = sorted(range(total), key=lambda i: -cost(cases[i]))
+    with ThreadPoolExecutor(max_workers=jobs) as pool:
+        futures = {i: pool.submit(one, cases[i]) for i in order}
+        return [futures[i].result() for i in range(total)]
+
+
+def run_cases_sim(mode, cases, jobs):
+    # All cases in one ./sim batch: virtual time, one seed, same records.
+    sim_mode = "sr" if mode == "sr_fast" else mode
+    lines = []
+    for scenario, loss, delay_ms, reorder, win in cases:
+        line = (f"--mode {sim_mode} --loss {loss} --delay_ms {delay_ms} "
+                f"--reorder {reorder} --win {win}")
+        if mode == "sr_fast":
+            line += ' --sender_args "--fast_retx"'
+        lines.append(line)
+    proc = subprocess.run(
+        [os.path.join(ROOT_DIR, "sim"),
+         "--rate_kbps", str(RATE_KBPS),
+         "--timeout", str(TIMEOUT_MS),
+         "--size_kb", str(FILE_SIZE_BYTES // 1024),
+         "--seed", "1",
+         "--jobs", str(jobs),
+         "--batch", "-"],
+        input="\n".join(lines) + "\n",
+        stdout=subprocess.PIPE,
+        text=True,
+        check=True,
+    )
+
+    records = []
+    for (scenario, loss, delay_ms, reorder, win), line in zip(cases, proc.stdout.splitlines()):
+        stats = dict(kv.split("=", 1) for kv in line.split())
+        data_sent = int(stats.get("DATA_SENT_PKTS", "0") or 0)
+        data_retx = int(stats.get("DATA_RETX_PKTS", "0") or 0)
+        records.append({
+            "mode": mode,
+            "scenario": scenario,
+            "loss": loss,
+            "delay_ms": delay_ms,
+            "reorder": reorder,
+            "win": win,
+            "timeout_ms": TIMEOUT_MS,
+            "file_bytes": FILE_SIZE_BYTES,
+            "rate_kbps": RATE_KBPS,
+            "hash_ok": int(stats.get("HASH_OK", "0")),
+            "goodput_kbps": float(stats.get("GOODPUT_KBPS", "0") or 0),
+            "data_sent": data_sent,
+            "data_retx": data_retx,
+            "retx_rate": (data_retx / data_sent) if data_sent > 0 else 0.0,
+            "ack_rcvd": int(stats.get("ACK_RCVD_PKTS", "0") or 0),
+            "elapsed_ms": int(float(stats.get("ELAPSED_MS", "0") or 0)),
+            "sender_rc": int(stats.get("SENDER_RC", "124")),
+            "receiver_rc": int(stats.get("RECEIVER_RC", "124")),
+            "sim": 1,
+        })
+    return records
+
+
 def write_jsonl(path, records):
     with open(path, "w", encoding="utf-8") as f:
         for rec in records:
@@ -177,7 +323,25 @@ def write_jsonl(path, records):
 def main():
     p = argparse.ArgumentParser(description="Run GBN/SR tests and write JSONL")
     p.add_argument("--mode", choices=["gbn", "sr", "sr_fast", "basic"], default="gbn")
+    p.add_argument("--sim", action="store_true",
+                   help="run every case in the virtual-time simulator (./sim) instead of real time")
+    p.add_argument("--jobs", type=int, default=os.cpu_count() or 1,
+                   help="cases run at once, each on its own ports (default: number of CPUs)")
+    p.add_argument("--interrupt_s", type=float, default=0,
+                   help="kill each transfer after this many seconds, then resume it (real time, gbn/sr)")
+    p.add_argument("--verify_files", action="store_true",
+                   help="compare the files with sha256 even when the transfer checked its digest")
+    p.add_argument("--compress", action="store_true",
+                   help="let the sender compress DATA payloads (real time, gbn/sr)")
+    p.add_argument("--input",
+                   help="send this file instead of random bytes (real time), e.g. logs for --compress")
     args = p.parse_args()
+    if args.interrupt_s > 0 and (args.sim or args.mode == "basic"):
+        p.error("--interrupt_s needs a real-time gbn or sr run")
+    if args.compress and (args.sim or args.mode == "basic"):
+        p.error("--compress needs a real-time gbn or sr run")
+    if args.input and args.sim:
+        p.error("--input needs a real-time run")
 
     subprocess.run(["make", "-s"], cwd=ROOT_DIR, check=True)
 
@@ -196,8 +360,11 @@ def main():
     os.makedirs(tmp_dir, exist_ok=True)
     os.makedirs(os.path.join(tmp_dir, "outputs"), exist_ok=True)
     os.makedirs(os.path.join(tmp_dir, "logs"), exist_ok=True)
-    input_file = os.path.join(tmp_dir, "input.bin")
-    write_random_file(input_file, FILE_SIZE_BYTES)
+    if args.input:
+        input_file = os.path.abspath(args.input)
+    else:
+        input_file = os.path.join(tmp_dir, "input.bin")
+        write_random_file(input_file, FILE_SIZE_BYTES)
 
     cases = []
     for loss in LOSS_VALUES:
@@ -209,25 +376,22 @@ def main():
     for win in WIN_VALUES:
         cases.append(("window", BASE_LOSS, BASE_DELAY, BASE_REORDER, win))
 
-    records = []
-    total = len(cases)
-    for idx, (scenario, loss, delay_ms, reorder, win) in enumerate(cases, start=1):
-        print(
-            f"[{idx}/{total}] {scenario} "
-            f"loss={loss} delay={delay_ms} reorder={reorder} win={win}"
-        )
-        records.append(
-            run_case(
-                args.mode, sender_bin, receiver_bin, scenario,
-                loss, delay_ms, reorder, win,
-                input_file, tmp_dir
-            )
-        )
+    if args.sim:
+        records = run_cases_sim(args.mode, cases, args.jobs)
+        results_jsonl = os.path.join(tmp_dir, "results.jsonl")
+        write_jsonl(results_jsonl, records)
+        print(f"Mode: {args.mode} (simulated)")
+        print(f"JSONL results: {results_jsonl}")
+        return
+
+    started = time.monotonic()
+    records = run_cases_parallel(args.mode, sender_bin, receiver_bin, cases, input_file, tmp_dir,
+                                 max(1, args.jobs), args.interrupt_s, args.verify_files, args.compress)
 
     results_jsonl = os.path.join(tmp_dir, "results.jsonl")
     write_jsonl(results_jsonl, records)
 
-    print(f"Mode: {args.mode}")
+    print(f"Mode: {args.mode}, {len(records)} cases in {time.monotonic() - started:.1f} s")
     print(f"JSONL results: {results_jsonl}")
     print(f"Logs and outputs: {tmp_dir}")
 
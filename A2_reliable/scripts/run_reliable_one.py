@@ -36,6 +36,15 @@ def sha256_file(path):
     return h.hexdigest()
 
 
+def emulator_cmd():
+    # The C emulator (make emulator) keeps up with fast senders; fall back
+    # to emulator.py when it has not been built.
+    native = os.path.join(ROOT_DIR, "emulator")
+    if os.access(native, os.X_OK):
+        return [native]
+    return [sys.executable, os.path.join(ROOT_DIR, "emulator.py")]
+
+
 def parse_sender_stdout(stdout_text):
     out = {}
     for line in stdout_text.splitlines():
@@ -57,7 +66,7 @@ def run_case(mode, sender_bin, receiver_bin, loss, delay_ms, reorder, win, input
     sender_err = os.path.join(log_dir, f"sender_{label}.err")
 
     emulator = subprocess.Popen(
-        [sys.executable, os.path.join(ROOT_DIR, "emulator.py"),
+        emulator_cmd() + [
          "--loss", str(loss),
          "--delay_ms", str(delay_ms),
          "--reorder", str(reorder),
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+import argparse
+import hashlib
+import json
+import os
+import signal
+import subprocess
+import sys
+import time
+
+
+ROOT_DIR = os.path.abspath(os.path.join(os.path.dirname(__file__), ".."))
+TMP_DIR = os.path.join(ROOT_DIR, "tmp_reliable")
+
+FILE_SIZE_BYTES = 307200
+TIMEOUT_MS = 500
+SENDER_TIMEOUT_SEC = 120
+RECEIVER_TIMEOUT_SEC = 120
+EMU_PORT = 11000
+BASE_PORT = 10000
+
+
+def write_random_file(path, size_bytes):
+    with open(path, "wb") as f:
+        f.write(os.urandom(size_bytes))
+
+
+def sha256_file(path):
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for chunk in iter(lambda: f.read(1024 * 1024), b""):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def parse_kv(text):
+    out = {}
+    for line in text.splitlines():
+        if "=" not in line or line.startswith("FLOW "):
+            continue
+        key, val = line.split("=", 1)
+        out[key.strip()] = val.strip()
+    return out
+
+
+def parse_flows(text):
+    # "FLOW ip:port -> ip:port KEY=VAL ..." lines of the emulator report.
+    flows = {}
+    for line in text.splitlines():
+        if not line.startswith("FLOW "):
+            continue
+        parts = line.split()
+        port = int(parts[1].rsplit(":", 1)[1])
+        flows[port] = {k.lower(): float(v) for k, v in (p.split("=", 1) for p in parts[4:])}
+    return flows
+
+
+def main():
+    p = argparse.ArgumentParser(description="Run several transfers through one shared bottleneck")
+    p.add_argument("--flows", default="sr,sr", help="comma-separated modes, one transfer each (gbn, sr, basic)")
+    p.add_argument("--rate_kbps", type=float, default=10000)
+    p.add_argument("--delay_ms", type=float, default=20)
+    p.add_argument("--loss", type=float, default=0.0)
+    p.add_argument("--aqm", choices=["droptail", "red", "codel"], default="droptail")
+    p.add_argument("--queue_bytes", type=int, default=150000)
+    p.add_argument("--ecn_ms", type=float, default=0, help="CE-mark past this queue delay (0: off)")
+    p.add_argument("--win", type=int, default=20)
+    p.add_argument("--size_kb", type=int, default=FILE_SIZE_BYTES // 1024)
+    args = p.parse_args()
+
+    subprocess.run(["make", "-s"], cwd=ROOT_DIR, check=True)
+
+    modes = [m.strip() for m in args.flows.split(",") if m.strip()]
+    run_dir = os.path.join(TMP_DIR, "shared")
+    os.makedirs(run_dir, exist_ok=True)
+    input_file = os.path.join(run_dir, "input.bin")
+    write_random_file(input_file, args.size_kb * 1024)
+
+    env = dict(os.environ, RELIABLE_EMU_PORT=str(EMU_PORT))
+    emulator = subprocess.Popen(
+        [os.path.join(ROOT_DIR, "emulator"),
+         "--port", str(EMU_PORT),
+         "--loss", str(args.loss),
+         "--delay_ms", str(args.delay_ms),
+         "--rate_kbps", str(args.rate_kbps),
+         "--bottleneck",
+         "--aqm", args.aqm,
+         "--queue_bytes", str(args.queue_bytes),
+         "--ecn_ms", str(args.ecn_ms),
+         "--seed", "1"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.DEVNULL,
+        text=True,
+    )
+    time.sleep(0.2)
+
+    # Flow i: sender on BASE_PORT + 2i, receiver on BASE_PORT + 2i + 1.
+    runs = []
+    for i, mode in enumerate(modes):
+        sport = BASE_PORT + 2 * i
+        rport = sport + 1
+        out_file = os.path.join(run_dir, f"out_{i}_{mode}.bin")
+        receiver_cmd = [os.path.join(ROOT_DIR, f"receiver_{mode}"),
+                        "--listen", str(rport), "--peer_ip", "127.0.0.1",
+                        "--peer_port", str(sport), "--out", out_file]
+        receiver = subprocess.Popen(receiver_cmd, env=env,
+                                    stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        runs.append({"mode": mode, "port": sport, "out": out_file, "receiver": receiver})
+    time.sleep(0.1)
+    for run in runs:
+        run["sender"] = subprocess.Popen(
+            [os.path.join(ROOT_DIR, f"sender_{run['mode']}"),
+             "--listen", str(run["port"]), "--peer_ip", "127.0.0.1",
+             "--peer_port", str(run["port"] + 1), "--in", input_file,
+             "--win", str(args.win), "--timeout", str(TIMEOUT_MS)],
+            env=env, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+
+    for run in runs:
+        try:
+            out, _ = run["sender"].communicate(timeout=SENDER_TIMEOUT_SEC)
+            run["sender_rc"] = run["sender"].returncode
+        except subprocess.TimeoutExpired:
+            run["sender"].kill()
+            out, _ = run["sender"].communicate()
+            run["sender_rc"] = 124
+        run["stats"] = parse_kv(out)
+        try:
+            run["receiver"].wait(timeout=RECEIVER_TIMEOUT_SEC)
+        except subprocess.TimeoutExpired:
+            run["receiver"].kill()
+            run["receiver"].wait()
+
+    # SIGTERM makes the emulator print its per-flow report.
+    emulator.send_signal(signal.SIGTERM)
+    emu_out, _ = emulator.communicate()
+    emu_stats = parse_kv(emu_out)
+    flows = parse_flows(emu_out)
+
+    h_in = sha256_file(input_file)
+    for run in runs:
+        flow = flows.get(run["port"], {})
+        hash_ok = int(os.path.exists(run["out"]) and sha256_file(run["out"]) == h_in)
+        print(json.dumps({
+            "mode": run["mode"],
+            "port": run["port"],
+            "hash_ok": hash_ok,
+            "sender_rc": run["sender_rc"],
+            "goodput_kbps": float(run["stats"].get("GOODPUT_KBPS", "0") or 0),
+            "link_goodput_kbps": flow.get("goodput_kbps", 0.0),
+            "queue_drops": int(flow.get("queue_drops", 0)),
+            "ce_marks": int(flow.get("ce_marks", 0)),
+            "data_retx": int(run["stats"].get("DATA_RETX_PKTS", "0") or 0),
+        }))
+    print(json.dumps({
+        "aqm": args.aqm,
+        "rate_kbps": args.rate_kbps,
+        "queue_bytes": args.queue_bytes,
+        "ecn_ms": args.ecn_ms,
+        "flows": len(runs),
+        "jain_index": float(emu_stats.get("JAIN_INDEX", "0") or 0),
+        "queue_drops": int(emu_stats.get("QUEUE_DROPS", "0") or 0),
+    }))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,6 +1,9 @@
 #define _POSIX_C_SOURCE 200809L
+#include "clock.h"
 #include "netif.h"
 #include "protocol.h"
+#include "reader.h"
+#include "session.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,16 +15,10 @@
 
 static void usage(const char *prog) {
     fprintf(stderr,
-            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT --in FILE --win N --timeout MS\n",
+            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT --in FILE --win N --timeout MS [--mss BYTES]\n",
             prog);
 }
 
-static uint64_t now_ms(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)(ts.tv_nsec / 1000000ULL);
-}
-
 int main(int argc, char **argv) {
     int listen_port = -1;
     const char *peer_ip = NULL;
@@ -29,6 +26,7 @@ int main(int argc, char **argv) {
     const char *in_path = NULL;
     int win = -1;
     int rto_ms = -1;
+    int mss = DEFAULT_PAYLOAD;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
@@ -43,13 +41,16 @@ int main(int argc, char **argv) {
             win = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
             rto_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mss") == 0 && i + 1 < argc) {
+            mss = atoi(argv[++i]);
         } else {
             usage(argv[0]);
             return 1;
         }
     }
 
-    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || !in_path || win <= 0 || rto_ms <= 0) {
+    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || !in_path || win <= 0 || win > UINT16_MAX || rto_ms <= 0 ||
+        mss <= 0 || mss > MAX_PAYLOAD) {
         usage(argv[0]);
         return 1;
     }
@@ -88,9 +89,27 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    uint8_t buf[PKT_HDR_LEN + MAX_PAYLOAD];
-    uint8_t recvbuf[PKT_HDR_LEN + MAX_PAYLOAD];
-    uint32_t seq = 0;
+    // Agree on the payload size with the receiver before sending data.
+    pkt_syn_t offer = {(uint16_t)mss, (uint16_t)win, 0, 0, 0, 0, session_new_id()};
+    pkt_syn_t agreed;
+    if (session_connect(sock, &offer, rto_ms, &agreed) != 0) {
+        fprintf(stderr, "handshake failed\n");
+        fclose(in);
+        close(sock);
+        return 1;
+    }
+    int payload_size = agreed.payload;
+
+    size_t buf_cap = PKT_HDR_LEN + (size_t)payload_size;
+    uint8_t *buf = malloc(buf_cap);
+    uint8_t *recvbuf = malloc(buf_cap);
+    if (!buf || !recvbuf) {
+        perror("malloc");
+        fclose(in);
+        close(sock);
+        return 1;
+    }
+    uint32_t seq = agreed.start_seq;
     uint64_t data_sent = 0;
     uint64_t data_retx = 0;
     uint64_t ack_rcvd = 0;
@@ -102,14 +121,33 @@ int main(int argc, char **argv) {
     //   - keep a send window and buffer unacked packets
     //   - start/restart timers and retransmit on timeout
     //   - process ACKs to slide the window and compute RTT/RTO
+    // Payloads are prefetched by a reader thread while packets go out.
+    reader_t *rd = reader_start_fd(fileno(in), (size_t)payload_size, 64);
+    if (!rd) {
+        perror("reader");
+        fclose(in);
+        close(sock);
+        return 1;
+    }
     while (1) {
-        size_t nread = fread(buf + PKT_HDR_LEN, 1, MAX_PAYLOAD, in);
+        ssize_t nread = reader_next(rd, buf + PKT_HDR_LEN, (size_t)payload_size, NULL);
+        if (nread == READER_AGAIN) {
+            reader_wait(rd, 50);
+            continue;
+        }
+        if (nread < 0) {
+            fprintf(stderr, "read failed\n");
+            reader_stop(rd);
+            fclose(in);
+            close(sock);
+            return 1;
+        }
         if (nread == 0) {
             break;
         }
 
         // Build a DATA packet: header + payload.
-        size_t pktlen = pkt_build_data(buf, sizeof(buf), seq, buf + PKT_HDR_LEN, (uint16_t)nread);
+        size_t pktlen = pkt_build_data(buf, buf_cap, seq, buf + PKT_HDR_LEN, (uint16_t)nread);
         if (pktlen == 0) {
             fprintf(stderr, "packet build failed\n");
             fclose(in);
@@ -128,7 +166,7 @@ int main(int argc, char **argv) {
 
         // Example ACK receive path (non-blocking). We only count ACKs here.
         // TODO(student): use ACKs to slide the window and retransmit on timeout.
-        ssize_t rn = netif_recv(sock, recvbuf, sizeof(recvbuf), 0);
+        ssize_t rn = netif_recv(sock, recvbuf, buf_cap, 0);
         if (rn > 0) {
             pkt_hdr_t hdr;
             if (pkt_parse(recvbuf, (size_t)rn, &hdr, NULL, NULL) == 0) {
@@ -139,15 +177,17 @@ int main(int argc, char **argv) {
         }
 
         if (start_ms == 0) {
-            start_ms = now_ms();
+            start_ms = clock_now_ms();
         }
         data_sent += 1;
         seq += 1;
     }
 
+    reader_stop(rd);
+
     // Basic FIN send (no retransmission).
     // Build and send FIN to mark end of file.
-    size_t fin_len = pkt_build_fin(buf, sizeof(buf), seq);
+    size_t fin_len = pkt_build_fin(buf, buf_cap, seq);
     if (fin_len > 0) {
         netif_send(sock, buf, fin_len);
     }
@@ -155,12 +195,12 @@ int main(int argc, char **argv) {
     // Basic wait for FINACK (no retries).
     uint64_t wait_ms = 0;
     while (wait_ms < (uint64_t)rto_ms) {
-        ssize_t n = netif_recv(sock, recvbuf, sizeof(recvbuf), 50);
+        ssize_t n = netif_recv(sock, recvbuf, buf_cap, 50);
         if (n > 0) {
             pkt_hdr_t hdr;
             if (pkt_parse(recvbuf, (size_t)n, &hdr, NULL, NULL) == 0) {
                 if (hdr.type == PKT_TYPE_FINACK) {
-                    end_ms = now_ms();
+                    end_ms = clock_now_ms();
                     break;
                 }
                 if (hdr.type == PKT_TYPE_ACK) {
@@ -172,14 +212,14 @@ int main(int argc, char **argv) {
     }
 
     if (!end_ms) {
-        end_ms = now_ms();
+        end_ms = clock_now_ms();
     }
 
     double elapsed_ms = (start_ms && end_ms && end_ms > start_ms) ? (double)(end_ms - start_ms) : 1.0;
     double goodput_kbps = (file_size * 8.0) / (elapsed_ms);
 
     printf("FILE_BYTES=%llu\n", (unsigned long long)file_size);
-    printf("CHUNK_BYTES=%d\n", MAX_PAYLOAD);
+    printf("CHUNK_BYTES=%d\n", payload_size);
     printf("WIN=%d\n", win);
     printf("DATA_SENT_PKTS=%llu\n", (unsigned long long)data_sent);
     printf("DATA_RETX_PKTS=%llu\n", (unsigned long long)data_retx);
@@ -187,6 +227,8 @@ int main(int argc, char **argv) {
     printf("ELAPSED_MS=%.0f\n", elapsed_ms);
     printf("GOODPUT_KBPS=%.2f\n", goodput_kbps);
 
+    free(buf);
+    free(recvbuf);
     fclose(in);
     close(sock);
     return 0;
@@ -1,6 +1,15 @@
 #define _POSIX_C_SOURCE 200809L
+#include "clock.h"
+#include "cpu.h"
+#include "lz.h"
 #include "netif.h"
 #include "protocol.h"
+#include "reader.h"
+#include "session.h"
+#include "sha256.h"
+#include "dctcp.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,29 +17,41 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <time.h>
 //#include <linux/time.h>
 
 static void usage(const char *prog) {
     fprintf(stderr,
-            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT --in FILE --win N --timeout MS\n",
+            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT --in FILE --win N --timeout MS [--mmap] [--mss BYTES] [--gso] [--compress]\n       [--busy_poll US] [--cpu N] [--session ID]\n",
             prog);
 }
 
-static uint64_t now_ms(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)(ts.tv_nsec / 1000000ULL);
-}
-
 typedef struct{
-    uint8_t bytes[PKT_HDR_LEN+MAX_PAYLOAD];
+    uint8_t *bytes;
     size_t pktlen;
+    size_t plain_len;         // payload bytes before --compress
     uint32_t seq;
 
     int is_used;
 } gbn_slot_t;
 
+// --mmap: payload bytes of seq inside the file mapping.
+static size_t mapped_len(uint64_t file_size, size_t chunk, uint32_t seq) {
+    uint64_t off = (uint64_t)seq * chunk;
+    if (off >= file_size) {
+        return 0;
+    }
+    return (file_size - off < chunk) ? (size_t)(file_size - off) : chunk;
+}
+
+// --mmap: queue a stored header plus its payload straight from the mapping.
+static int queue_mapped(netif_batch_t *batch, const uint8_t *hdr, const uint8_t *map,
+                        uint64_t file_size, size_t chunk, uint32_t seq) {
+    return netif_batch_add(batch, hdr, PKT_HDR_LEN, map + (uint64_t)seq * chunk,
+                           mapped_len(file_size, chunk, seq));
+}
+
 int main(int argc, char **argv) {
     int listen_port = -1;
     const char *peer_ip = NULL;
@@ -38,6 +59,13 @@ int main(int argc, char **argv) {
     const char *in_path = NULL;
     int win = -1;
     int rto_ms = -1;
+    int use_mmap = 0;
+    int mss = DEFAULT_PAYLOAD;
+    int use_gso = 0;
+    int compress = 0;
+    int busy_poll_us = 0;
+    int cpu = -1;
+    uint32_t session = 0;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
@@ -52,16 +80,35 @@ int main(int argc, char **argv) {
             win = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
             rto_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            use_mmap = 1;
+        } else if (strcmp(argv[i], "--mss") == 0 && i + 1 < argc) {
+            mss = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gso") == 0) {
+            use_gso = 1;
+        } else if (strcmp(argv[i], "--compress") == 0) {
+            compress = 1;
+        } else if (strcmp(argv[i], "--session") == 0 && i + 1 < argc) {
+            session = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--busy_poll") == 0 && i + 1 < argc) {
+            busy_poll_us = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            cpu = atoi(argv[++i]);
         } else {
             usage(argv[0]);
             return 1;
         }
     }
 #pragma region exception
-    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || !in_path || win <= 0 || rto_ms <= 0) {
+    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || !in_path || win <= 0 || win > UINT16_MAX || rto_ms <= 0 ||
+        mss <= 0 || mss > MAX_PAYLOAD || busy_poll_us < 0) {
         usage(argv[0]);
         return 1;
     }
+    if (compress && use_mmap) {
+        fprintf(stderr, "--compress needs payloads in the window, not with --mmap\n");
+        return 1;
+    }
 
     FILE *in = fopen(in_path, "rb");
     if (!in) {
@@ -77,6 +124,19 @@ int main(int argc, char **argv) {
     }
     uint64_t file_size = (uint64_t)st.st_size;
 
+    // With --mmap the window keeps only headers; payloads stay in the page cache.
+    const uint8_t *map = NULL;
+    if (use_mmap && file_size > 0) {
+        void *m = mmap(NULL, (size_t)file_size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+        if (m == MAP_FAILED) {
+            perror("mmap");
+            fclose(in);
+            return 1;
+        }
+        posix_madvise(m, (size_t)file_size, POSIX_MADV_SEQUENTIAL);
+        map = m;
+    }
+
     // Create a UDP socket through the netif wrapper (emulator-aware).
     int sock = netif_socket();
     if (sock < 0) {
@@ -96,13 +156,61 @@ int main(int argc, char **argv) {
         close(sock);
         return 1;
     }
+    TRACE_START(listen_port);
+    stats_page_t *stats = stats_open(listen_port, STATS_SENDER, "gbn");
+    // Agree on payload size and window with the receiver before sending
+    // data; it must ACK cumulatively. A receiver run with --resume may
+    // already hold the start of the file.
+    pkt_syn_t offer = {(uint16_t)mss, (uint16_t)win, PKT_ACK_CUMULATIVE,
+                       (uint8_t)(PKT_FEAT_RESUME | (compress ? PKT_FEAT_COMPRESS : 0)),
+                       0, 0, session ? session : session_new_id()};
+    pkt_syn_t agreed;
+    if (session_connect(sock, &offer, rto_ms, &agreed) != 0 ||
+        session_check(&offer, &agreed, 0) != 0) {
+        fprintf(stderr, "handshake failed\n");
+        fclose(in);
+        close(sock);
+        return 1;
+    }
+    win = agreed.window;
+    uint64_t resumed = (uint64_t)(agreed.resume_seq - agreed.start_seq) * agreed.payload;
+    if (resumed > file_size) {
+        fprintf(stderr, "receiver holds more than the input file\n");
+        fclose(in);
+        close(sock);
+        return 1;
+    }
 #pragma endregion
 
-    uint8_t buf[PKT_HDR_LEN + MAX_PAYLOAD];
-    uint8_t recvbuf[PKT_HDR_LEN + MAX_PAYLOAD];
+    size_t chunk = (size_t)agreed.payload;
+    // SHA-256 of the file, sent in the FIN; a resumed transfer hashes the
+    // part the receiver already holds first. A FIN carries at most one
+    // payload, so tiny payloads go without.
+    sha256_t digest;
+    sha256_init(&digest);
+    int digest_on = chunk >= SHA256_LEN && sha256_fd(&digest, fileno(in), resumed) == 0;
+    size_t buf_cap = PKT_HDR_LEN + chunk;
+    uint8_t *buf = malloc(buf_cap);
+    uint8_t *recvbuf = malloc(buf_cap);
+    // --compress, if the receiver takes it: each payload is compressed on
+    // its own, through lz_tmp, when that saves enough.
+    lz_probe_t lz;
+    lz_probe_init(&lz);
+    uint8_t *lz_tmp = NULL;
+    if (compress && (agreed.features & PKT_FEAT_COMPRESS)) {
+        lz_tmp = malloc(LZ_BOUND(chunk));
+    } else if (compress) {
+        fprintf(stderr, "receiver does not support compression, sending without it\n");
+    }
+    if (!buf || !recvbuf || (compress && (agreed.features & PKT_FEAT_COMPRESS) && !lz_tmp)) {
+        perror("malloc");
+        fclose(in);
+        close(sock);
+        return 1;
+    }
 
-    uint32_t base=0;
-    uint32_t next_seq = 0;
+    uint32_t base = agreed.resume_seq;
+    uint32_t next_seq = base;
 
     uint64_t data_sent = 0;
     uint64_t data_retx = 0;
@@ -118,17 +226,81 @@ int main(int argc, char **argv) {
     //   - keep a send window and buffer unacked packets
     //   - start/restart timers and retransmit on timeout
     //   - process ACKs to slide the window and compute RTT/RTO
-    gbn_slot_t* window = calloc((size_t)win, sizeof(gbn_slot_t));
-    if(!window){
+    gbn_slot_t* window = NULL;
+    uint8_t* hdrs = NULL;
+    uint8_t* slot_pool = NULL;
+    if (use_mmap) {
+        hdrs = calloc((size_t)win, PKT_HDR_LEN);
+    } else {
+        window = calloc((size_t)win, sizeof(gbn_slot_t));
+        slot_pool = malloc((size_t)win * buf_cap);
+        if (window && !slot_pool) {
+            free(window);
+            window = NULL;
+        }
+    }
+    if(!window && !hdrs){
         perror("window calloc");
         fclose(in);
         close(sock);
         return 1;
     }
+    for (int i = 0; window && i < win; i++) {
+        window[i].bytes = slot_pool + (size_t)i * buf_cap;
+    }
+    // First-send times for latency samples. Seqs below clean_from went out
+    // again on a timeout, so their ACKs are ambiguous.
+    uint64_t *sent_ns = calloc((size_t)win, sizeof(uint64_t));
+    uint32_t clean_from = 0;
+    // Send->ACK latency of each packet sent once, up to the cumulative ACK
+    // that covers it.
+    stats_lat_t lat;
+    memset(&lat, 0, sizeof(lat));
+
+    // New packets and window retransmissions leave in batches: one
+    // UDP_SEGMENT send per run with --gso, one sendmmsg otherwise.
+    if (use_gso && netif_enable_gso(sock) != 0) {
+        fprintf(stderr, "UDP GSO unavailable, using sendmmsg\n");
+    }
+    // --busy_poll US: ACK waits spin before they sleep.
+    if (busy_poll_us > 0 && netif_enable_busy_poll(sock, busy_poll_us) != 0) {
+        fprintf(stderr, "SO_BUSY_POLL unavailable, spinning in user space only\n");
+    }
+    netif_batch_t batch;
+    netif_batch_init(&batch, sock);
+
+    // Without --mmap, a reader thread prefetches payloads so that disk
+    // stalls never hold up ACK processing or the retransmission timer.
+    reader_t *rd = NULL;
+    if (!use_mmap) {
+        lseek(fileno(in), (off_t)resumed, SEEK_SET);
+        rd = reader_start_fd(fileno(in), chunk, 2 * (size_t)win);
+        if (!rd) {
+            perror("reader");
+            goto fail;
+        }
+    }
+    // --cpu N: pin the event loop, after the reader thread has started so
+    // that it stays free to run elsewhere.
+    if (cpu >= 0 && cpu_pin(cpu) != 0) {
+        fprintf(stderr, "cannot pin to CPU %d\n", cpu);
+    }
+
+    // CE echoes from the receiver shrink the usable window below --win.
+    dctcp_t cc;
+    dctcp_init(&cc, win);
 
     uint64_t timer_start_ms = 0;
     int timer_running =0;
     int eof_reached =0;
+    int reader_behind = 0;
+
+    // Receive window: next_seq stays below the edge the receiver last
+    // advertised (PKT_FLAG_RWND); with the window closed and nothing in
+    // flight, the last ACKed packet is resent every rto_ms as a probe.
+    uint64_t rwnd_edge = UINT64_MAX;
+    uint64_t next_probe_ms = 0;
+    uint64_t rwnd_probes = 0;
 
     while (1) { //!eof_reached || base <next_seq
         
@@ -137,144 +309,271 @@ int main(int argc, char **argv) {
         }
 
         // waiting for window queing
-        while (!eof_reached && next_seq < base + (uint32_t)win){
-            size_t nread = fread(buf + PKT_HDR_LEN, 1, MAX_PAYLOAD, in);
-            if (nread == 0){
-                eof_reached=1;
-                break;
-            } 
-            
-            // Build a DATA packet: header + payload.
-            size_t pktlen = pkt_build_data(buf, sizeof(buf), next_seq, buf + PKT_HDR_LEN, (uint16_t)nread);
-            if (pktlen == 0) {
-                fprintf(stderr, "packet build failed\n");
-                free(window);
-                fclose(in);
-                close(sock);
-                return 1;
-            }
+        reader_behind = 0;
+        while (!eof_reached && next_seq < base + (uint32_t)dctcp_window(&cc) && next_seq < rwnd_edge){
+            if (use_mmap) {
+                size_t plen = mapped_len(file_size, chunk, next_seq);
+                if (plen == 0) {
+                    eof_reached = 1;
+                    break;
+                }
 
-            gbn_slot_t* slot = &window[next_seq % win];
-            memcpy(slot->bytes,buf,pktlen);
-            slot->pktlen=pktlen;
-            slot->seq=next_seq;
-            slot->is_used=1;
-            
-            // Example data send call (goes through emulator).
-            // TODO(student): in your reliable sender, send from a window buffer.
-            if (netif_send(sock, buf, pktlen) < 0) {
-                perror("sendto");
-                free(window);
-                fclose(in);
-                close(sock);
-                return 1;
-            }            
+                uint8_t* hdr = hdrs + (size_t)(next_seq % win) * PKT_HDR_LEN;
+                if (pkt_build_data_hdr(hdr, PKT_HDR_LEN, next_seq, 0,
+                                       map + (uint64_t)next_seq * chunk, (uint16_t)plen) == 0) {
+                    fprintf(stderr, "packet build failed\n");
+                    goto fail;
+                }
+                if (queue_mapped(&batch, hdr, map, file_size, chunk, next_seq) < 0) {
+                    perror("sendmsg");
+                    goto fail;
+                }
+                if (digest_on) {
+                    sha256_update(&digest, map + (uint64_t)next_seq * chunk, plen);
+                }
+                TRACE(TRACE_DATA_SEND, next_seq, base, dctcp_window(&cc), rto_ms, plen, 0);
+            } else {
+                gbn_slot_t* slot = &window[next_seq % win];
+                ssize_t nread = reader_next(rd, slot->bytes + PKT_HDR_LEN, chunk, NULL);
+                if (nread == READER_AGAIN) {
+                    reader_behind = 1;
+                    break;
+                }
+                if (nread < 0) {
+                    fprintf(stderr, "read failed\n");
+                    goto fail;
+                }
+                if (nread == 0){
+                    eof_reached=1;
+                    break;
+                }
+
+                if (digest_on) {
+                    sha256_update(&digest, slot->bytes + PKT_HDR_LEN, (size_t)nread);
+                }
+                slot->plain_len = (size_t)nread;
+                uint8_t flags = 0;
+                if (lz_tmp) {
+                    bool packed;
+                    nread = (ssize_t)lz_probe_pack(&lz, slot->bytes + PKT_HDR_LEN, (size_t)nread, lz_tmp, &packed);
+                    flags = packed ? PKT_FLAG_LZ : 0;
+                }
+
+                // Build a DATA packet in place: header + payload.
+                size_t pktlen = pkt_build_data_flags(slot->bytes, buf_cap, next_seq, flags,
+                                                     slot->bytes + PKT_HDR_LEN, (uint16_t)nread);
+                if (pktlen == 0) {
+                    fprintf(stderr, "packet build failed\n");
+                    goto fail;
+                }
+
+                slot->pktlen=pktlen;
+                slot->seq=next_seq;
+                slot->is_used=1;
+
+                if (netif_batch_add(&batch, slot->bytes, pktlen, NULL, 0) < 0) {
+                    perror("sendto");
+                    goto fail;
+                }
+                TRACE(TRACE_DATA_SEND, next_seq, base, dctcp_window(&cc), rto_ms, nread, flags);
+            }
 
             if (start_ms == 0) {
-                start_ms = now_ms();
+                start_ms = clock_now_ms();
             }
             data_sent += 1;
+            if (sent_ns) {
+                sent_ns[next_seq % win] = clock_now_ns();
+            }
             
             if(base==next_seq){
-                timer_start_ms=now_ms();
+                timer_start_ms=clock_now_ms();
                 timer_running=1;
             }
 
             next_seq += 1;
 
         }
+        if (netif_batch_flush(&batch) < 0) {
+            perror("sendto");
+            goto fail;
+        }
         
+        // Nothing in flight: wait for the reader instead of the socket.
+        if (reader_behind && base == next_seq) {
+            reader_wait(rd, 50);
+            continue;
+        }
+
         // Example ACK receive path (non-blocking). We only count ACKs here.
         // TODO(student): use ACKs to slide the window and retransmit on timeout.
-        ssize_t rn = netif_recv(sock, recvbuf, sizeof(recvbuf), 50);
+        // Wake for the retransmission timer rather than up to 50 ms past it.
+        int wait_ms = reader_behind ? 1 : 50;
+        if (timer_running && !reader_behind) {
+            uint64_t elapsed = clock_now_ms() - timer_start_ms;
+            uint64_t left = elapsed < (uint64_t)rto_ms ? (uint64_t)rto_ms - elapsed : 0;
+            wait_ms = left < (uint64_t)wait_ms ? (int)left : wait_ms;
+        }
+        ssize_t rn = netif_recv(sock, recvbuf, buf_cap, wait_ms);
         if (rn > 0) {
             pkt_hdr_t hdr;
             if (pkt_parse(recvbuf, (size_t)rn, &hdr, NULL, NULL) == 0) {
                 if (hdr.type == PKT_TYPE_ACK) {
                     uint32_t ack = hdr.ack;
+                    bool ce = (hdr.flags & PKT_FLAG_CE) != 0;
+                    // Keep the largest edge seen; ACKs can arrive reordered.
+                    if ((hdr.flags & PKT_FLAG_RWND) &&
+                        (rwnd_edge == UINT64_MAX || hdr.seq > rwnd_edge)) {
+                        rwnd_edge = hdr.seq;
+                    }
 
                     if(base<ack && ack <=next_seq){
+                        dctcp_on_ack(&cc, ack - base, ce);
                         ack_rcvd++;
                         uint32_t prev_base=base;
                         base=ack;
 
-                        for (uint32_t s = prev_base;s<base;s++){
+                        for (uint32_t s = prev_base;s<base && window;s++){
                             window[s%win].is_used=0;
                         }
+                        if (sent_ns) {
+                            uint64_t now_ns = clock_now_ns();
+                            for (uint32_t s = prev_base > clean_from ? prev_base : clean_from; s < base; s++) {
+                                stats_lat_add(&lat, now_ns - sent_ns[s % win]);
+                            }
+                        }
+                        if (stats) {
+                            stats_begin(stats);
+                            if (sent_ns && ack - 1 >= clean_from) {
+                                stats_rtt_sample(stats, clock_now_ns() - sent_ns[(ack - 1) % win]);
+                            }
+                            for (uint32_t s = prev_base; s < base; s++) {
+                                stats->bytes_delivered += use_mmap ? mapped_len(file_size, chunk, s)
+                                                                : window[s % win].plain_len;
+                            }
+                            stats_end(stats);
+                        }
 
                         if(base==next_seq){
                             timer_running=0;
                         }
                         else{
-                            timer_start_ms=now_ms();
+                            timer_start_ms=clock_now_ms();
                             timer_running=1;
                         }
                     }
-                //printf("[SENDER] ACK=%u base=%u next_seq=%u\n", ack, base, next_seq);
-                //fflush(stdout);        
+                    else {
+                        dctcp_on_ack(&cc, 1, ce);
+                    }
+                    TRACE(TRACE_ACK_RECV, base, ack, dctcp_window(&cc), rto_ms, 0, hdr.flags);
                 }
             }
             
         }
 
-        //printf("[SENDER] TIMEOUT base=%u next_seq=%u\n", base, next_seq);
-        //fflush(stdout);
-        if (timer_running && (now_ms()-timer_start_ms >= (uint64_t)rto_ms)){
+        if (!eof_reached && base == next_seq && next_seq >= rwnd_edge && next_seq > 0 &&
+            clock_now_ms() >= next_probe_ms) {
+            uint32_t s = next_seq - 1;
+            int rc;
+            if (use_mmap) {
+                rc = queue_mapped(&batch, hdrs + (size_t)(s % win) * PKT_HDR_LEN, map, file_size, chunk, s);
+            } else {
+                rc = netif_batch_add(&batch, window[s % win].bytes, window[s % win].pktlen, NULL, 0);
+            }
+            if (rc < 0 || netif_batch_flush(&batch) < 0) {
+                perror("send probe");
+                goto fail;
+            }
+            rwnd_probes++;
+            next_probe_ms = clock_now_ms() + (uint64_t)rto_ms;
+        }
+
+        if (timer_running && (clock_now_ms()-timer_start_ms >= (uint64_t)rto_ms)){
+            TRACE(TRACE_TIMEOUT, base, next_seq, dctcp_window(&cc), rto_ms, 0, 0);
+            clean_from = next_seq;
             for (uint32_t s = base; s < next_seq; s++){
+                if (use_mmap) {
+                    if (queue_mapped(&batch, hdrs + (size_t)(s % win) * PKT_HDR_LEN, map, file_size, chunk, s) < 0) {
+                        perror("send Time out");
+                        goto fail;
+                    }
+                    data_retx=data_retx+1;
+                    TRACE(TRACE_DATA_RETX, s, base, dctcp_window(&cc), rto_ms, mapped_len(file_size, chunk, s), 0);
+                    continue;
+                }
+
                 gbn_slot_t* slot = &window[s % win];
 
                 if(slot->is_used && slot->seq==s){
-                    if(netif_send(sock,slot->bytes,slot->pktlen)<0){
+                    if(netif_batch_add(&batch,slot->bytes,slot->pktlen,NULL,0)<0){
                         perror("send Time out");
-                        free(window);
-                        fclose(in);
-                        close(sock);
-                        return 1;
+                        goto fail;
                     }
                     data_retx=data_retx+1;
+                    TRACE(TRACE_DATA_RETX, s, base, dctcp_window(&cc), rto_ms, slot->pktlen - PKT_HDR_LEN, 0);
                 }
             }
-            timer_start_ms=now_ms();
+            if (netif_batch_flush(&batch) < 0) {
+                perror("send Time out");
+                goto fail;
+            }
+            timer_start_ms=clock_now_ms();
         }
 
-        
+        if (stats) {
+            stats_begin(stats);
+            stats->update_ns = clock_now_ns();
+            stats->base = base;
+            stats->next_seq = next_seq;
+            stats->inflight = next_seq - base;
+            stats->cwnd = (uint64_t)dctcp_window(&cc);
+            stats->rto_ms = (uint64_t)rto_ms;
+            stats->pkts_sent = data_sent;
+            stats->pkts_retx = data_retx;
+            stats->pkts_recv = ack_rcvd;
+            stats_end(stats);
+        }
     }
+    free(sent_ns);
+    sent_ns = NULL;
+
+    reader_stop(rd);
+    rd = NULL;
 
     // Fin Ack sending - let's make hash_ok all as 1
+    uint8_t file_digest[SHA256_LEN];
+    sha256_final(&digest, file_digest);
+    uint8_t finack_flags = 0;
     int fin_acked = 0;
-    uint64_t fin_start_ms = now_ms();
+    uint64_t fin_start_ms = clock_now_ms();
     uint64_t last_fin_send_ms = 0;
 
-    while (!fin_acked && (now_ms() - fin_start_ms < 3000)) {
-        uint64_t now = now_ms();
+    while (!fin_acked && (clock_now_ms() - fin_start_ms < 3000)) {
+        uint64_t now = clock_now_ms();
 
         if (last_fin_send_ms == 0 || (now - last_fin_send_ms >= (uint64_t)rto_ms)) {
-            size_t fin_len = pkt_build_fin(buf, sizeof(buf), next_seq);
+            size_t fin_len = digest_on ? pkt_build_fin_digest(buf, buf_cap, next_seq, file_digest)
+                                       : pkt_build_fin(buf, buf_cap, next_seq);
 
             if (fin_len == 0) {
-                free(window);
-                fclose(in);
-                close(sock);
-                return 1;
+                goto fail;
             }
 
             if (netif_send(sock, buf, fin_len) < 0) {
-                free(window);
-                fclose(in);
-                close(sock);
-                return 1;
+                goto fail;
             }
 
             last_fin_send_ms = now;
         }
 
-        ssize_t n = netif_recv(sock, recvbuf, sizeof(recvbuf), 50);
+        ssize_t n = netif_recv(sock, recvbuf, buf_cap, 50);
         if (n > 0) {
             pkt_hdr_t hdr;
             if (pkt_parse(recvbuf, (size_t)n, &hdr, NULL, NULL) == 0) {
                 if (hdr.type == PKT_TYPE_FINACK) {
                     fin_acked = 1;
-                    end_ms = now_ms();
+                    finack_flags = hdr.flags;
+                    end_ms = clock_now_ms();
                     break;
                 }
 
@@ -286,29 +585,77 @@ int main(int argc, char **argv) {
     }
 
     if (!fin_acked) {
-        free(window);
-        fclose(in);
-        close(sock);
-        return 1;
+        goto fail;
     }
 
     if (!end_ms) {
-        end_ms = now_ms();
+        end_ms = clock_now_ms();
     }
+    stats_close(stats);
 
     double elapsed_ms = (start_ms && end_ms && end_ms > start_ms) ? (double)(end_ms - start_ms) : 1.0;
-    double goodput_kbps = (file_size * 8.0) / (elapsed_ms);
+    double goodput_kbps = ((file_size - resumed) * 8.0) / (elapsed_ms);
 
     printf("FILE_BYTES=%llu\n", (unsigned long long)file_size);
-    printf("CHUNK_BYTES=%d\n", MAX_PAYLOAD);
+    if (resumed) {
+        printf("RESUMED_BYTES=%llu\n", (unsigned long long)resumed);
+    }
+    printf("CHUNK_BYTES=%d\n", agreed.payload);
     printf("WIN=%d\n", win);
     printf("DATA_SENT_PKTS=%llu\n", (unsigned long long)data_sent);
     printf("DATA_RETX_PKTS=%llu\n", (unsigned long long)data_retx);
     printf("ACK_RCVD_PKTS=%llu\n", (unsigned long long)ack_rcvd);
+    if (cc.marks) {
+        printf("ECN_MARKS=%llu\n", (unsigned long long)cc.marks);
+        printf("CWND_MIN=%d\n", (int)cc.min_cwnd);
+    }
+    if (rwnd_probes) {
+        printf("RWND_PROBES=%llu\n", (unsigned long long)rwnd_probes);
+    }
+    stats_lat_report(&lat, stdout);
+    printf("CPU_MS=%llu\n", (unsigned long long)cpu_time_ms());
+    if (lz_tmp) {
+        // Ratio of payload bytes read to payload bytes sent.
+        printf("COMPRESS_PKTS=%llu\n", (unsigned long long)lz.packed);
+        printf("COMPRESS_RATIO=%.2f\n", lz.wire_bytes ? (double)lz.raw_bytes / (double)lz.wire_bytes : 1.0);
+    }
+    int digest_bad = digest_on && (finack_flags & PKT_FLAG_DIGEST_BAD);
+    if (digest_on) {
+        // unchecked: the receiver does not compare digests.
+        printf("DIGEST=%s\n", !(finack_flags & PKT_FLAG_DIGEST) ? "unchecked"
+                              : digest_bad ? "mismatch" : "ok");
+    }
     printf("ELAPSED_MS=%.0f\n", elapsed_ms);
     printf("GOODPUT_KBPS=%.2f\n", goodput_kbps);
 
+    if (map) {
+        munmap((void *)map, (size_t)file_size);
+    }
+    free(window);
+    free(slot_pool);
+    free(hdrs);
+    free(buf);
+    free(lz_tmp);
+    free(recvbuf);
+    fclose(in);
+    close(sock);
+    return digest_bad ? 1 : 0;
+
+fail:
+    // Every error once the reader may be running: stop it before its fd
+    // is closed.
+    reader_stop(rd);
+    if (map) {
+        munmap((void *)map, (size_t)file_size);
+    }
+    free(sent_ns);
+    free(window);
+    free(slot_pool);
+    free(hdrs);
+    free(buf);
+    free(lz_tmp);
+    free(recvbuf);
     fclose(in);
     close(sock);
-    return 0;
+    return 1;
 }
@@ -1,43 +1,306 @@
 #define _POSIX_C_SOURCE 200809L
+#include "clock.h"
+#include "cpu.h"
+#include "fec.h"
+#include "lz.h"
 #include "netif.h"
 #include "protocol.h"
+#include "reader.h"
+#include "session.h"
+#include "sha256.h"
+#include "dctcp.h"
+#include "mpath.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <stdbool.h>
 
 static void usage(const char *prog) {
     fprintf(stderr,
-            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT --in FILE --win N --timeout MS\n",
+            "Usage: %s --listen PORT --peer_ip IP --peer_port PORT --in FILE --win N --timeout MS [--mmap] [--mss BYTES] [--gso] [--fec N] [--zero_rtt] [--paths N] [--compress]\n       [--busy_poll US] [--cpu N] [--session ID]\n"
+            "       stream mode: --in FILE (repeated) | --in_list FILE, [--streams N]\n",
             prog);
 }
 
-static uint64_t now_ms(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)(ts.tv_nsec / 1000000ULL);
-}
-
 typedef struct {
-    uint8_t packet[PKT_HDR_LEN + MAX_PAYLOAD];
+    uint8_t *packet;          // header, followed by the payload unless mapped
+    const uint8_t *payload;   // --mmap: payload inside the file mapping
     uint64_t packet_len;
+    uint64_t plain_len;       // payload bytes before --compress
     uint32_t seq;
     uint64_t timeeout;
+    uint64_t sent_ns;         // last send
+    int path;                 // path of the last send
     bool ack;
+    bool retx;
+    uint8_t flags;
 } Packet;
 
+// Fill p with DATA packet seq, from the mapping if map is set (first is
+// the seq of the file's first byte), otherwise with the next chunk the
+// reader thread has ready. Returns the payload
+// length, 0 at end of input, -1 on error, READER_AGAIN if the reader is
+// behind.
+static ssize_t load_packet(Packet *p, uint32_t seq, uint32_t first, size_t chunk, reader_t *rd,
+                           const uint8_t *map, uint64_t file_size) {
+    ssize_t nread;
+    if (map) {
+        uint64_t off = (uint64_t)(seq - first) * chunk;
+        if (off >= file_size) {
+            return 0;
+        }
+        nread = (file_size - off < chunk) ? (ssize_t)(file_size - off) : (ssize_t)chunk;
+        p->payload = map + off;
+        if (pkt_build_data_hdr(p->packet, PKT_HDR_LEN, seq, 0, p->payload, (uint16_t)nread) == 0) {
+            return -1;
+        }
+        p->flags = 0;
+    } else {
+        uint8_t flags = 0;
+        nread = reader_next(rd, p->packet + PKT_HDR_LEN, chunk, &flags);
+        if (nread <= 0) {
+            return nread;
+        }
+        p->payload = NULL;
+        if (pkt_build_data_flags(p->packet, PKT_HDR_LEN + chunk, seq, flags,
+                                 p->packet + PKT_HDR_LEN, (uint16_t)nread) == 0) {
+            return -1;
+        }
+        p->flags = flags;
+    }
+    p->seq = seq;
+    p->packet_len = PKT_HDR_LEN + (size_t)nread;
+    p->plain_len = (uint64_t)nread;
+    return nread;
+}
+
+// --compress: shrink the payload of p in place if the probe finds it
+// worth it, and rebuild the header with PKT_FLAG_LZ. Returns 0, or -1 if
+// the packet cannot be built.
+static int compress_packet(Packet *p, lz_probe_t *lz, uint8_t *tmp) {
+    bool packed;
+    size_t n = (size_t)p->plain_len;
+    size_t len = lz_probe_pack(lz, p->packet + PKT_HDR_LEN, n, tmp, &packed);
+    if (!packed) {
+        return 0;
+    }
+    uint8_t flags = p->flags | PKT_FLAG_LZ;
+    if (pkt_build_data_flags(p->packet, PKT_HDR_LEN + n, p->seq, flags, p->packet + PKT_HDR_LEN,
+                             (uint16_t)len) == 0) {
+        return -1;
+    }
+    p->flags = flags;
+    p->packet_len = PKT_HDR_LEN + len;
+    return 0;
+}
+
+static void close_input(FILE *in) {
+    if (in) {
+        fclose(in);
+    }
+}
+
+typedef struct {
+    uint32_t id;
+    FILE *f;
+    const char *path;
+    uint64_t size;
+    uint64_t offset;
+    bool opened;              // OPEN packet (name + size) already sent
+} Stream;
+
+// Stream mode: many files share one session. Up to max_active files are
+// open at a time and served round-robin, one packet each, so every active
+// stream gets an equal share of the send window.
+typedef struct {
+    const char **paths;
+    size_t npaths;
+    size_t cap;
+    size_t next_path;
+    Stream *active;
+    int max_active;
+    int nactive;
+    int rr;
+    int failed;
+    uint64_t bytes_total;
+} StreamSched;
+
+static int sched_add_path(StreamSched *ss, const char *path) {
+    if (ss->npaths == ss->cap) {
+        size_t cap = ss->cap ? ss->cap * 2 : 16;
+        const char **paths = realloc(ss->paths, cap * sizeof(*paths));
+        if (!paths) {
+            return -1;
+        }
+        ss->paths = paths;
+        ss->cap = cap;
+    }
+    ss->paths[ss->npaths++] = path;
+    return 0;
+}
+
+// One path per line; blank lines are skipped.
+static int sched_read_list(StreamSched *ss, const char *list_path) {
+    FILE *f = fopen(list_path, "r");
+    if (!f) {
+        perror(list_path);
+        return -1;
+    }
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &line_cap, f)) > 0) {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+            line[--n] = '\0';
+        }
+        if (n == 0) {
+            continue;
+        }
+        char *path = strdup(line);
+        if (!path || sched_add_path(ss, path) != 0) {
+            free(path);
+            free(line);
+            fclose(f);
+            return -1;
+        }
+    }
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+static void sched_admit(StreamSched *ss) {
+    while (ss->nactive < ss->max_active && ss->next_path < ss->npaths) {
+        size_t idx = ss->next_path++;
+        FILE *f = fopen(ss->paths[idx], "rb");
+        struct stat st;
+        if (!f || fstat(fileno(f), &st) != 0) {
+            perror(ss->paths[idx]);
+            close_input(f);
+            ss->failed++;
+            continue;
+        }
+        posix_fadvise(fileno(f), 0, 0, POSIX_FADV_SEQUENTIAL);
+        Stream *s = &ss->active[ss->nactive++];
+        s->id = (uint32_t)idx;
+        s->f = f;
+        s->path = ss->paths[idx];
+        s->size = (uint64_t)st.st_size;
+        s->offset = 0;
+        s->opened = false;
+        ss->bytes_total += s->size;
+    }
+}
+
+// Reader thread: produce the next payload of the next stream in
+// round-robin order, an OPEN packet (name + size) first, then the stream's
+// data chunks. Returns the payload length, 0 once every stream is done.
+static ssize_t stream_fill(void *ctx, uint8_t *body, size_t chunk, uint8_t *flags) {
+    StreamSched *ss = ctx;
+    sched_admit(ss);
+    if (ss->nactive == 0) {
+        return 0;
+    }
+    if (ss->rr >= ss->nactive) {
+        ss->rr = 0;
+    }
+
+    Stream *s = &ss->active[ss->rr];
+    uint8_t *data = body + PKT_STREAM_HDR_LEN;
+    size_t room = chunk - PKT_STREAM_HDR_LEN;
+    *flags = PKT_FLAG_STREAM;
+    pkt_stream_hdr_t sh;
+    sh.stream_id = s->id;
+
+    size_t n;
+    bool eof = false;
+    if (!s->opened) {
+        const char *name = strrchr(s->path, '/');
+        name = name ? name + 1 : s->path;
+        n = strlen(name);
+        if (n > room) {
+            n = room;
+        }
+        memcpy(data, name, n);
+        sh.offset = s->size;
+        *flags |= PKT_FLAG_STREAM_OPEN;
+        s->opened = true;
+    } else {
+        n = fread(data, 1, room, s->f);
+        sh.offset = s->offset;
+        s->offset += n;
+        eof = (n == 0);
+    }
+    pkt_put_stream_hdr(body, &sh);
+
+    // Retire a finished stream; the next file takes its place in the rotation.
+    if (s->offset >= s->size || eof) {
+        fclose(s->f);
+        ss->active[ss->rr] = ss->active[--ss->nactive];
+    } else {
+        ss->rr++;
+    }
+    return (ssize_t)(PKT_STREAM_HDR_LEN + n);
+}
+
+// Send the parity packets of the current FEC block and start the next one.
+// Parity buffers are reused by the next block, so the batch is flushed here.
+static int queue_parity(netif_batch_t *batch, fec_enc_t *fec, uint64_t *parity_sent) {
+    for (int i = 0; i < fec_enc_parity_count(fec); i++) {
+        const uint8_t *pkt;
+        size_t len = fec_enc_build(fec, i, &pkt);
+        if (len > 0) {
+            if (netif_batch_add(batch, pkt, len, NULL, 0) < 0) {
+                return -1;
+            }
+            (*parity_sent)++;
+        }
+    }
+    int rc = netif_batch_flush(batch);
+    fec_enc_next(fec);
+    return rc;
+}
+
+// Queue p on the send batch; mapped payloads go out without a copy.
+static int queue_packet(netif_batch_t *batch, const Packet *p) {
+    if (p->payload) {
+        return netif_batch_add(batch, p->packet, PKT_HDR_LEN, p->payload,
+                               (size_t)p->packet_len - PKT_HDR_LEN);
+    }
+    return netif_batch_add(batch, p->packet, (size_t)p->packet_len, NULL, 0);
+}
+
 int main(int argc, char **argv) {
     int listen_port = -1;
     const char *peer_ip = NULL;
     int peer_port = -1;
     const char *in_path = NULL;
+    const char *in_list = NULL;
     int win = -1;
     int rto_ms = -1;
+    bool use_mmap = false;
+    int mss = DEFAULT_PAYLOAD;
+    bool use_gso = false;
+    int fec_n = 0;
+    bool zero_rtt = false;
+    int npaths = 1;
+    bool report_paths = false;    // --paths given, even 1: print PATH<i>_*
+    bool compress = false;
+    int busy_poll_us = 0;
+    int cpu = -1;
+    uint32_t session = 0;
+    StreamSched streams;
+    memset(&streams, 0, sizeof(streams));
+    streams.max_active = 8;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
@@ -48,10 +311,39 @@ int main(int argc, char **argv) {
             peer_port = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--in") == 0 && i + 1 < argc) {
             in_path = argv[++i];
+            if (sched_add_path(&streams, in_path) != 0) {
+                perror("malloc");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--in_list") == 0 && i + 1 < argc) {
+            in_list = argv[++i];
+        } else if (strcmp(argv[i], "--streams") == 0 && i + 1 < argc) {
+            streams.max_active = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--win") == 0 && i + 1 < argc) {
             win = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
             rto_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            use_mmap = true;
+        } else if (strcmp(argv[i], "--mss") == 0 && i + 1 < argc) {
+            mss = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gso") == 0) {
+            use_gso = true;
+        } else if (strcmp(argv[i], "--fec") == 0 && i + 1 < argc) {
+            fec_n = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--zero_rtt") == 0) {
+            zero_rtt = true;
+        } else if (strcmp(argv[i], "--paths") == 0 && i + 1 < argc) {
+            npaths = atoi(argv[++i]);
+            report_paths = true;
+        } else if (strcmp(argv[i], "--compress") == 0) {
+            compress = true;
+        } else if (strcmp(argv[i], "--session") == 0 && i + 1 < argc) {
+            session = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--busy_poll") == 0 && i + 1 < argc) {
+            busy_poll_us = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            cpu = atoi(argv[++i]);
         } else {
             usage(argv[0]);
             return 1;
@@ -60,48 +352,160 @@ int main(int argc, char **argv) {
 
     #define WINDOW_N (uint32_t)win
 
-    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || !in_path || win <= 0 || rto_ms <= 0) {
+    if (listen_port <= 0 || !peer_ip || peer_port <= 0 || (!in_path && !in_list) || win <= 0 ||
+        win > UINT16_MAX ||
+        rto_ms <= 0 || mss <= 0 || mss > MAX_PAYLOAD || streams.max_active <= 0 ||
+        (fec_n != 0 && (fec_n < 2 || fec_n > FEC_MAX_N)) || npaths < 1 || npaths > MPATH_MAX ||
+        busy_poll_us < 0) {
         usage(argv[0]);
         return 1;
     }
 
-    FILE *in = fopen(in_path, "rb");
-    if (!in) {
-        perror("fopen");
+    if (in_list && sched_read_list(&streams, in_list) != 0) {
         return 1;
     }
-
-    struct stat st;
-    if (fstat(fileno(in), &st) != 0) {
-        perror("fstat");
-        fclose(in);
+    // More than one input turns on stream mode: each file becomes a stream.
+    bool stream_mode = in_list || streams.npaths > 1;
+    if (stream_mode && use_mmap) {
+        fprintf(stderr, "--mmap applies to single-file transfers only\n");
+        return 1;
+    }
+    if (stream_mode && zero_rtt) {
+        fprintf(stderr, "--zero_rtt applies to single-file transfers only\n");
         return 1;
     }
-    uint64_t file_size = (uint64_t)st.st_size;
+    if (compress && use_mmap) {
+        fprintf(stderr, "--compress needs payloads in the window, not with --mmap\n");
+        return 1;
+    }
+
+    FILE *in = NULL;
+    uint64_t file_size = 0;
+    if (stream_mode) {
+        streams.active = calloc((size_t)streams.max_active, sizeof(Stream));
+        if (!streams.active) {
+            perror("calloc");
+            return 1;
+        }
+    } else {
+        in = fopen(in_path, "rb");
+        if (!in) {
+            perror("fopen");
+            return 1;
+        }
+
+        struct stat st;
+        if (fstat(fileno(in), &st) != 0) {
+            perror("fstat");
+            close_input(in);
+            return 1;
+        }
+        file_size = (uint64_t)st.st_size;
+    }
+
+    // With --mmap the window keeps only headers; payloads stay in the page cache.
+    const uint8_t *map = NULL;
+    if (use_mmap && file_size > 0) {
+        void *m = mmap(NULL, (size_t)file_size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+        if (m == MAP_FAILED) {
+            perror("mmap");
+            close_input(in);
+            return 1;
+        }
+        posix_madvise(m, (size_t)file_size, POSIX_MADV_SEQUENTIAL);
+        map = m;
+    }
 
     // Create a UDP socket through the netif wrapper (emulator-aware).
     int sock = netif_socket();
     if (sock < 0) {
-        fclose(in);
+        close_input(in);
         return 1;
     }
 
     // Bind local port for this sender.
     if (netif_bind(sock, listen_port) != 0) {
-        fclose(in);
+        close_input(in);
         close(sock);
         return 1;
     }
     // Tell emulator which peer port to forward to.
     if (netif_connect(sock, peer_ip, peer_port) != 0) {
-        fclose(in);
+        close_input(in);
+        close(sock);
+        return 1;
+    }
+    TRACE_START(listen_port);
+    stats_page_t *stats = stats_open(listen_port, STATS_SENDER, "sr");
+
+    // Agree on payload size, window, selective ACKs and features with the
+    // receiver. With --zero_rtt the first window goes out right behind the
+    // SYN, built with the offered parameters; the answer is read after it.
+    // Otherwise a single file can resume where a receiver run with
+    // --resume left off.
+    uint8_t features = (stream_mode ? PKT_FEAT_STREAM : 0) | (fec_n ? PKT_FEAT_FEC : 0) |
+                       (!stream_mode && !zero_rtt ? PKT_FEAT_RESUME : 0) |
+                       (compress ? PKT_FEAT_COMPRESS : 0);
+    pkt_syn_t offer = {(uint16_t)mss, (uint16_t)win, PKT_ACK_SELECTIVE,
+                       (uint8_t)(features | (zero_rtt ? PKT_FEAT_ZERO_RTT : 0)),
+                       0, 0, session ? session : session_new_id()};
+    pkt_syn_t agreed = offer;
+    if (zero_rtt) {
+        if (session_send_syn(sock, &offer) != 0) {
+            perror("sendto");
+            close_input(in);
+            close(sock);
+            return 1;
+        }
+        pkt_set_payload_limit(offer.payload);
+    } else if (session_connect(sock, &offer, rto_ms, &agreed) != 0 ||
+               session_check(&offer, &agreed, stream_mode ? PKT_FEAT_STREAM : 0) != 0) {
+        fprintf(stderr, "handshake failed\n");
+        close_input(in);
+        close(sock);
+        return 1;
+    }
+    if (fec_n && !(agreed.features & PKT_FEAT_FEC)) {
+        fprintf(stderr, "receiver does not support FEC, sending without it\n");
+        fec_n = 0;
+    }
+    if (compress && !(agreed.features & PKT_FEAT_COMPRESS)) {
+        fprintf(stderr, "receiver does not support compression, sending without it\n");
+        compress = false;
+    }
+    win = agreed.window;
+    int payload_size = agreed.payload;
+    uint64_t resumed = (uint64_t)(agreed.resume_seq - agreed.start_seq) * agreed.payload;
+    if (resumed > file_size) {
+        fprintf(stderr, "receiver holds more than the input file\n");
+        close_input(in);
+        close(sock);
+        return 1;
+    }
+    if (stream_mode && payload_size <= (int)PKT_STREAM_HDR_LEN) {
+        fprintf(stderr, "payload size %d too small for stream mode\n", payload_size);
+        close_input(in);
         close(sock);
         return 1;
     }
 
-    uint8_t buf[PKT_HDR_LEN + MAX_PAYLOAD];
-    uint8_t recvbuf[PKT_HDR_LEN + MAX_PAYLOAD];
-    uint32_t seq = 0;
+    size_t chunk = (size_t)payload_size;
+    size_t buf_cap = PKT_HDR_LEN + chunk;
+    uint8_t *buf = malloc(buf_cap);
+    uint8_t *recvbuf = malloc(buf_cap);
+    // --compress: each payload is compressed on its own, through lz_tmp,
+    // when that saves enough; the whole payload counts, stream header too.
+    lz_probe_t lz;
+    lz_probe_init(&lz);
+    uint8_t *lz_tmp = compress ? malloc(LZ_BOUND(chunk)) : NULL;
+    if (!buf || !recvbuf || (compress && !lz_tmp)) {
+        perror("malloc");
+        close_input(in);
+        close(sock);
+        return 1;
+    }
+    uint32_t first_seq = agreed.start_seq;
+    uint32_t seq = agreed.resume_seq;
     uint64_t data_sent = 0;
     uint64_t data_retx = 0;
     uint64_t ack_rcvd = 0;
@@ -114,62 +518,311 @@ int main(int argc, char **argv) {
     //   - start/restart timers and retransmit on timeout
     //   - process ACKs to slide the window and compute RTT/RTO
 
-    Packet window[WINDOW_N];
-    int64_t window_start_idx = 0;
-    size_t nread = 1;
-    bool all_acked = false;
-    start_ms = now_ms();
-    
-    while(seq < WINDOW_N && nread != 0){
-
-
-        printf("Sending seq %u\n", seq);
-
-        nread = fread(window[seq].packet + PKT_HDR_LEN, 1, MAX_PAYLOAD, in);
-        if (nread == 0) {
+    // Slot metadata and packet bytes live on the heap: a large --win would
+    // overflow the stack, and --mmap slots only need room for a header.
+    size_t slot_bytes = use_mmap ? PKT_HDR_LEN : buf_cap;
+    Packet *window = calloc(WINDOW_N, sizeof(Packet));
+    uint8_t *slot_pool = malloc((size_t)WINDOW_N * slot_bytes);
+    if (!window || !slot_pool) {
+        perror("window alloc");
+        close_input(in);
+        close(sock);
+        return 1;
+    }
+    for (uint32_t i = 0; i < WINDOW_N; i++) {
+        window[i].packet = slot_pool + (size_t)i * slot_bytes;
+    }
+    // --paths N: DATA goes out on the path where it should arrive first.
+    // The handshake, probes and FIN stay on path 0.
+    mpath_t mp;
+    if (mpath_open(&mp, npaths, sock, listen_port, peer_ip, peer_port, rto_ms) != 0) {
+        fprintf(stderr, "cannot open %d paths\n", npaths);
+        close_input(in);
+        close(sock);
+        return 1;
+    }
+    // Packets queued in one loop pass leave together: one UDP_SEGMENT send
+    // per equal-sized run with --gso, one sendmmsg otherwise.
+    for (int i = 0; i < mp.n; i++) {
+        if (use_gso && netif_enable_gso(mp.path[i].sock) != 0) {
+            fprintf(stderr, "UDP GSO unavailable, using sendmmsg\n");
             break;
         }
+    }
+    // --busy_poll US: ACK waits spin before they sleep.
+    for (int i = 0; busy_poll_us > 0 && i < mp.n; i++) {
+        if (netif_enable_busy_poll(mp.path[i].sock, busy_poll_us) != 0 && i == 0) {
+            fprintf(stderr, "SO_BUSY_POLL unavailable, spinning in user space only\n");
+        }
+    }
 
-        // Build a DATA packet: header + payload.
-        window[seq].seq = seq;
-        size_t pktlen = pkt_build_data(window[seq].packet, sizeof(window[seq].packet), seq, window[seq].packet + PKT_HDR_LEN, (uint16_t)nread);
-        if (pktlen == 0) {
-            fprintf(stderr, "packet build failed\n");
-            fclose(in);
+    // Without --mmap, payloads come from a reader thread so that disk
+    // stalls never hold up ACK processing or the retransmission timers.
+    reader_t *rd = NULL;
+    if (!map) {
+        size_t depth = 2 * (size_t)WINDOW_N;
+        if (!stream_mode) {
+            lseek(fileno(in), (off_t)resumed, SEEK_SET);
+        }
+        rd = stream_mode ? reader_start(stream_fill, &streams, chunk, depth)
+                         : reader_start_fd(fileno(in), chunk, depth);
+        if (!rd) {
+            perror("reader");
+            close_input(in);
             close(sock);
             return 1;
         }
-        window[seq].packet_len = pktlen;
-        if (netif_send(sock, window[seq].packet, window[seq].packet_len) < 0) {
+    }
+    // --cpu N: pin the event loop, after the reader thread has started so
+    // that it stays free to run elsewhere.
+    if (cpu >= 0 && cpu_pin(cpu) != 0) {
+        fprintf(stderr, "cannot pin to CPU %d\n", cpu);
+    }
+
+    // SHA-256 of a single file, sent in the FIN; a resumed transfer hashes
+    // the part the receiver already holds first. A FIN carries at most one
+    // payload, so tiny payloads go without. Stream mode has no digest.
+    sha256_t digest;
+    sha256_init(&digest);
+    bool digest_on = !stream_mode && chunk >= SHA256_LEN &&
+                     sha256_fd(&digest, fileno(in), resumed) == 0;
+
+    // --fec N: after every N new DATA packets, send XOR parity so the
+    // receiver can rebuild losses without waiting a timeout.
+    fec_enc_t fec;
+    uint64_t parity_sent = 0;
+    if (fec_n && fec_enc_init(&fec, fec_n, chunk) != 0) {
+        fprintf(stderr, "FEC unavailable with %zu-byte payloads\n", chunk);
+        fec_n = 0;
+    }
+
+    // CE echoes from the receiver shrink the usable window below --win.
+    dctcp_t cc;
+    dctcp_init(&cc, win);
+
+    // Receive window: new seqs must stay below the edge the receiver last
+    // advertised (PKT_FLAG_RWND). While it holds everything up, the newest
+    // ACKed packet goes out again every rto_ms to draw a fresh ACK.
+    int64_t rwnd_edge = INT64_MAX;
+    uint64_t next_probe_ms = 0;
+    uint64_t rwnd_probes = 0;
+
+    // Between passes the loop sleeps in the ACK receive until an ACK comes
+    // or the earliest retransmission or probe timer is due; only a reader
+    // that is behind keeps it polling.
+    uint64_t next_timer_ms = UINT64_MAX;
+    bool reader_behind = false;
+    // Send->ACK latency of packets sent once.
+    stats_lat_t lat;
+    memset(&lat, 0, sizeof(lat));
+
+    int64_t window_start_idx = seq;
+    bool eof = false;
+    bool all_acked = false;
+    start_ms = clock_now_ms();
+    if (zero_rtt && rd) {
+        // Let the first window be ready when the loop sends it.
+        reader_wait(rd, rto_ms);
+    }
+
+    while (!eof || !all_acked) {
+
+        // Fill every free slot; slots are indexed by seq % WINDOW_N. If the
+        // reader is behind, the free slots wait for the next pass.
+        reader_behind = false;
+        while (!eof && seq < window_start_idx + dctcp_window(&cc) && seq < rwnd_edge) {
+            int path = mpath_pick(&mp);
+            if (mpath_full(&mp, path)) {
+                break;
+            }
+            Packet *p = &window[seq % WINDOW_N];
+            ssize_t nread = load_packet(p, seq, first_seq, chunk, rd, map, file_size);
+            if (nread == READER_AGAIN) {
+                reader_behind = true;
+                break;
+            }
+            if (nread < 0) {
+                fprintf(stderr, "read failed\n");
+                reader_stop(rd);
+                close_input(in);
+                close(sock);
+                return 1;
+            }
+            if (nread == 0) {
+                eof = true;
+                // Protect the tail of the file too.
+                if (fec_n && fec.count > 0 &&
+                    queue_parity(&mp.path[mpath_pick(&mp)].batch, &fec, &parity_sent) < 0) {
+                    perror("sendto");
+                    reader_stop(rd);
+                    close_input(in);
+                    close(sock);
+                    return 1;
+                }
+                break;
+            }
+            if (digest_on) {
+                sha256_update(&digest, p->payload ? p->payload : p->packet + PKT_HDR_LEN, (size_t)nread);
+            }
+            if (compress && compress_packet(p, &lz, lz_tmp) != 0) {
+                fprintf(stderr, "packet build failed\n");
+                reader_stop(rd);
+                close_input(in);
+                close(sock);
+                return 1;
+            }
+            p->path = path;
+            if (queue_packet(&mp.path[p->path].batch, p) < 0) {
+                perror("sendto");
+                reader_stop(rd);
+                close_input(in);
+                close(sock);
+                return 1;
+            }
+            mpath_on_send(&mp, p->path);
+            TRACE(TRACE_DATA_SEND, seq, 0, dctcp_window(&cc), rto_ms, p->packet_len - PKT_HDR_LEN,
+                  p->flags);
+            p->timeeout = clock_now_ms() + mpath_rto_ms(&mp, p->path);
+            if (p->timeeout < next_timer_ms) {
+                next_timer_ms = p->timeeout;
+            }
+            p->sent_ns = clock_now_ns();
+            p->ack = false;
+            p->retx = false;
+            if (fec_n) {
+                const uint8_t *data = p->payload ? p->payload : p->packet + PKT_HDR_LEN;
+                if (fec_enc_add(&fec, seq, data, (uint16_t)(p->packet_len - PKT_HDR_LEN), p->flags) &&
+                    queue_parity(&mp.path[mpath_pick(&mp)].batch, &fec, &parity_sent) < 0) {
+                    perror("sendto");
+                    reader_stop(rd);
+                    close_input(in);
+                    close(sock);
+                    return 1;
+                }
+            }
+            seq++;
+            data_sent += 1;
+        }
+        if (mpath_flush(&mp) < 0) {
             perror("sendto");
-            fclose(in);
+            reader_stop(rd);
+            close_input(in);
             close(sock);
             return 1;
         }
-        window[seq].timeeout = now_ms() + rto_ms;
-        window[seq].ack = false;
-        seq++;
-        data_sent += 1;
-    }
 
-    while (nread!=0 || !all_acked) {
+        if (zero_rtt) {
+            // The first window is out: now wait for the SYNACK.
+            zero_rtt = false;
+            if (session_connect(sock, &offer, rto_ms, &agreed) != 0 ||
+                session_check(&offer, &agreed, 0) != 0) {
+                fprintf(stderr, "handshake failed\n");
+                reader_stop(rd);
+                close_input(in);
+                close(sock);
+                return 1;
+            }
+            if (!(agreed.features & PKT_FEAT_ZERO_RTT)) {
+                // Refused: the receiver dropped the early window and expects
+                // the file again from agreed.start_seq with its parameters.
+                // Slots and buffers were sized for the offer, which bounds
+                // the answer, so only the contents are reset.
+                fprintf(stderr, "0-RTT refused, resending with the agreed parameters\n");
+                win = agreed.window;
+                dctcp_init(&cc, win);
+                chunk = agreed.payload;
+                payload_size = agreed.payload;
+                for (uint32_t i = 0; i < WINDOW_N; i++) {
+                    window[i].packet_len = 0;
+                    window[i].ack = false;
+                }
+                for (int i = 0; i < mp.n; i++) {
+                    mp.path[i].inflight = 0;
+                }
+                if (rd) {
+                    reader_stop(rd);
+                    rd = reader_start_fd(fileno(in), chunk, 2 * (size_t)WINDOW_N);
+                    if (!rd) {
+                        perror("reader");
+                        close_input(in);
+                        close(sock);
+                        return 1;
+                    }
+                }
+                if (fec_n) {
+                    fec_enc_free(&fec);
+                    if (!(agreed.features & PKT_FEAT_FEC) || fec_enc_init(&fec, fec_n, chunk) != 0) {
+                        fec_n = 0;
+                    }
+                }
+                sha256_init(&digest);
+                digest_on = chunk >= SHA256_LEN;
+                if (compress && !(agreed.features & PKT_FEAT_COMPRESS)) {
+                    compress = false;
+                }
+                lz_probe_init(&lz);
+                first_seq = agreed.start_seq;
+                seq = first_seq;
+                window_start_idx = first_seq;
+                rwnd_edge = INT64_MAX;
+                eof = false;
+                continue;
+            }
+        }
 
         // Example ACK receive path (non-blocking). We only count ACKs here.
         // TODO(student): use ACKs to slide the window and retransmit on timeout.
-        ssize_t rn = netif_recv(sock, recvbuf, sizeof(recvbuf), 0);
+        int rpath;
+        uint64_t now_ms = clock_now_ms();
+        int wait_ms = 0;
+        if (reader_behind) {
+            wait_ms = 1;
+        } else if (next_timer_ms >= now_ms) {
+            // A timer fires once the clock has passed it.
+            uint64_t due = next_timer_ms - now_ms + 1;
+            wait_ms = due < (uint64_t)rto_ms ? (int)due : rto_ms;
+        }
+        ssize_t rn = mpath_recv(&mp, recvbuf, buf_cap, wait_ms, &rpath);
         if (rn > 0) {
-            printf("Received ACK!\n");
             pkt_hdr_t hdr;
             if (pkt_parse(recvbuf, (size_t)rn, &hdr, NULL, NULL) == 0) {
                 if (hdr.type == PKT_TYPE_ACK) {
                     ack_rcvd++;
+                    // The edge never moves back; a reordered ACK may carry
+                    // an older one.
+                    if ((hdr.flags & PKT_FLAG_RWND) &&
+                        (rwnd_edge == INT64_MAX || (int64_t)hdr.seq > rwnd_edge)) {
+                        rwnd_edge = hdr.seq;
+                    }
                     uint32_t ack_seq = hdr.ack;
-                    for (uint32_t j = 0; j < WINDOW_N; j++) {
-                        if (window[j].seq == ack_seq) {
-                            window[j].ack=true;
-                            printf("Received ACK for seq %u\n", ack_seq);
-                            break;
+                    // Slots are indexed by seq % WINDOW_N, so no scan is needed.
+                    Packet *p = &window[ack_seq % WINDOW_N];
+                    if (p->seq == ack_seq && p->packet_len > 0) {
+                        // One loss sample per packet: lost if it timed out
+                        // or the receiver had to rebuild it from parity.
+                        if (fec_n && !p->ack) {
+                            fec_enc_sample(&fec, p->retx || (hdr.flags & PKT_FLAG_FEC));
                         }
+                        if (!p->ack) {
+                            dctcp_on_ack(&cc, 1, hdr.flags & PKT_FLAG_CE);
+                            // Karn: no RTT sample from a resent packet. One
+                            // path keeps the --timeout RTO regardless.
+                            uint64_t now_ns = clock_now_ns();
+                            mpath_on_ack(&mp, p->path, p->retx ? 0 : now_ns - p->sent_ns, now_ns);
+                            if (!p->retx) {
+                                stats_lat_add(&lat, clock_now_ns() - p->sent_ns);
+                            }
+                            if (stats) {
+                                stats_begin(stats);
+                                if (!p->retx) {
+                                    stats_rtt_sample(stats, clock_now_ns() - p->sent_ns);
+                                }
+                                stats->bytes_delivered += p->plain_len;
+                                stats_end(stats);
+                            }
+                        }
+                        p->ack=true;
+                        TRACE(TRACE_ACK_RECV, ack_seq, ack_seq, dctcp_window(&cc), rto_ms, 0, hdr.flags);
                     }
                 }
             }
@@ -177,9 +830,11 @@ int main(int argc, char **argv) {
 
 
         int64_t j = window_start_idx;
+        next_timer_ms = UINT64_MAX;
         bool cumul_ack = true;
         all_acked = true;
         int64_t cumul_ack_idx = -1;
+        uint64_t inflight = 0;
         while(j < window_start_idx + WINDOW_N && j < seq ){
             int64_t window_idx = j % WINDOW_N;
             if(window[window_idx].ack){
@@ -189,61 +844,84 @@ int main(int argc, char **argv) {
             }else {
                     all_acked = false;
                     cumul_ack = false;
-                    if(window[window_idx].timeeout < now_ms()){
-                        printf("Retransmitting because of timeout seq %u\n", window[window_idx].seq);
-                        if (netif_send(sock, window[window_idx].packet, window[window_idx].packet_len) < 0) {
+                    inflight++;
+                    if(window[window_idx].timeeout < clock_now_ms()){
+                        TRACE(TRACE_DATA_RETX, window[window_idx].seq, 0, dctcp_window(&cc), rto_ms,
+                              window[window_idx].packet_len - PKT_HDR_LEN, window[window_idx].flags);
+                        // The resend may take another path than the lost copy.
+                        Packet *rp = &window[window_idx];
+                        mpath_on_loss(&mp, rp->path);
+                        rp->path = mpath_pick(&mp);
+                        if (queue_packet(&mp.path[rp->path].batch, rp) < 0) {
                             perror("sendto");
-                            fclose(in);
+                            reader_stop(rd);
+                            close_input(in);
                             close(sock);
                             return 1;
                         }
+                        mpath_on_send(&mp, rp->path);
                         data_retx++;
-                        window[window_idx].timeeout = now_ms() + rto_ms;
+                        rp->retx = true;
+                        rp->timeeout = clock_now_ms() + mpath_rto_ms(&mp, rp->path);
                 }
+                    if (window[window_idx].timeeout < next_timer_ms) {
+                        next_timer_ms = window[window_idx].timeeout;
+                    }
             }
             j++;
         }
 
         if(cumul_ack_idx != -1){
-            int64_t k = window_start_idx;
             window_start_idx = cumul_ack_idx + 1;
-            printf("Repopulating from %ld to %ld", k, window_start_idx);
-            while(k <= cumul_ack_idx){
-                int64_t window_idx = k % WINDOW_N;
-                nread = fread(window[window_idx].packet + PKT_HDR_LEN, 1, MAX_PAYLOAD, in);
-                if (nread == 0) {
-                    break;
-                }
-                // Build a DATA packet: header + payload.
-                window[window_idx].seq = seq;
-                size_t pktlen = pkt_build_data(window[window_idx].packet, sizeof(window[window_idx].packet), seq, window[window_idx].packet + PKT_HDR_LEN, (uint16_t)nread);
-                if (pktlen == 0) {
-                    fprintf(stderr, "packet build failed\n");
-                    fclose(in);
-                    close(sock);
-                    return 1;
-                }
-                window[window_idx].packet_len = pktlen;
-                if (netif_send(sock, window[window_idx].packet, window[window_idx].packet_len) < 0) {
-                    perror("sendto");
-                    fclose(in);
-                    close(sock);
-                    return 1;
-                }
-                printf("Sending new seq %u\n", seq);
-                window[window_idx].timeeout = now_ms() + rto_ms;
-                window[window_idx].ack = false;
-                seq++;
-                data_sent += 1;
-                k++;
+        }
+        // Zero window with nothing in flight: probe.
+        bool rwnd_closed = !eof && seq >= rwnd_edge && window_start_idx == seq && seq > first_seq;
+        if (rwnd_closed && clock_now_ms() >= next_probe_ms) {
+            Packet *p = &window[(seq - 1) % WINDOW_N];
+            if (p->seq == seq - 1 && p->packet_len > 0 && queue_packet(&mp.path[0].batch, p) < 0) {
+                perror("sendto");
+                reader_stop(rd);
+                close_input(in);
+                close(sock);
+                return 1;
             }
+            rwnd_probes++;
+            next_probe_ms = clock_now_ms() + rto_ms;
+        }
+        if (rwnd_closed && next_probe_ms < next_timer_ms) {
+            next_timer_ms = next_probe_ms;
+        }
+        if (mpath_flush(&mp) < 0) {
+            perror("sendto");
+            reader_stop(rd);
+            close_input(in);
+            close(sock);
+            return 1;
+        }
+        if (stats) {
+            stats_begin(stats);
+            stats->update_ns = clock_now_ns();
+            stats->base = (uint64_t)window_start_idx;
+            stats->next_seq = seq;
+            stats->inflight = inflight;
+            stats->cwnd = (uint64_t)dctcp_window(&cc);
+            stats->rto_ms = (uint64_t)rto_ms;
+            stats->pkts_sent = data_sent;
+            stats->pkts_retx = data_retx;
+            stats->pkts_recv = ack_rcvd;
+            stats_end(stats);
         }
-        
     }
+    // Joins the reader thread; stream counters are final from here on.
+    reader_stop(rd);
 
     // Basic FIN send (no retransmission).
     // Build and send FIN to mark end of file.
-    size_t fin_len = pkt_build_fin(buf, sizeof(buf), seq);
+    uint8_t file_digest[SHA256_LEN];
+    sha256_final(&digest, file_digest);
+    uint8_t finack_flags = 0;
+    size_t fin_len = digest_on ? pkt_build_fin_digest(buf, buf_cap, seq, file_digest)
+                               : pkt_build_fin(buf, buf_cap, seq);
     if (fin_len > 0) {
         netif_send(sock, buf, fin_len);
     }
@@ -254,12 +932,13 @@ int main(int argc, char **argv) {
         // Basic wait for FINACK (no retries).
         uint64_t wait_ms = 0;
         while (wait_ms < (uint64_t)rto_ms) {
-            ssize_t n = netif_recv(sock, recvbuf, sizeof(recvbuf), 50);
+            ssize_t n = netif_recv(sock, recvbuf, buf_cap, 50);
             if (n > 0) {
                 pkt_hdr_t hdr;
                 if (pkt_parse(recvbuf, (size_t)n, &hdr, NULL, NULL) == 0) {
                     if (hdr.type == PKT_TYPE_FINACK) {
-                        end_ms = now_ms();
+                        finack_flags = hdr.flags;
+                        end_ms = clock_now_ms();
                         finacked = true;
                         break;
                     }
@@ -276,22 +955,69 @@ int main(int argc, char **argv) {
     }
 
     if (!end_ms) {
-        end_ms = now_ms();
+        end_ms = clock_now_ms();
+    }
+    stats_close(stats);
+
+    if (stream_mode) {
+        file_size = streams.bytes_total;
     }
 
     double elapsed_ms = (start_ms && end_ms && end_ms > start_ms) ? (double)(end_ms - start_ms) : 1.0;
-    double goodput_kbps = (file_size * 8.0) / (elapsed_ms);
+    double goodput_kbps = ((file_size - resumed) * 8.0) / (elapsed_ms);
     
     printf("FILE_BYTES=%llu\n", (unsigned long long)file_size);
-    printf("CHUNK_BYTES=%d\n", MAX_PAYLOAD);
+    if (resumed) {
+        printf("RESUMED_BYTES=%llu\n", (unsigned long long)resumed);
+    }
+    printf("CHUNK_BYTES=%d\n", payload_size);
     printf("WIN=%d\n", win);
+    if (stream_mode) {
+        printf("STREAMS=%zu\n", streams.npaths);
+    }
     printf("DATA_SENT_PKTS=%llu\n", (unsigned long long)data_sent);
     printf("DATA_RETX_PKTS=%llu\n", (unsigned long long)data_retx);
+    if (fec_n) {
+        printf("FEC_PARITY_PKTS=%llu\n", (unsigned long long)parity_sent);
+        fec_enc_free(&fec);
+    }
     printf("ACK_RCVD_PKTS=%llu\n", (unsigned long long)ack_rcvd);
+    if (cc.marks) {
+        printf("ECN_MARKS=%llu\n", (unsigned long long)cc.marks);
+        printf("CWND_MIN=%d\n", (int)cc.min_cwnd);
+    }
+    if (rwnd_probes) {
+        printf("RWND_PROBES=%llu\n", (unsigned long long)rwnd_probes);
+    }
+    if (compress) {
+        // Ratio of payload bytes read to payload bytes sent.
+        printf("COMPRESS_PKTS=%llu\n", (unsigned long long)lz.packed);
+        printf("COMPRESS_RATIO=%.2f\n", lz.wire_bytes ? (double)lz.raw_bytes / (double)lz.wire_bytes : 1.0);
+    }
+    if (report_paths) {
+        mpath_report(&mp, stdout);
+    }
+    stats_lat_report(&lat, stdout);
+    printf("CPU_MS=%llu\n", (unsigned long long)cpu_time_ms());
+    bool digest_bad = digest_on && (finack_flags & PKT_FLAG_DIGEST_BAD);
+    if (digest_on) {
+        // unchecked: the receiver does not compare digests.
+        printf("DIGEST=%s\n", !(finack_flags & PKT_FLAG_DIGEST) ? "unchecked"
+                              : digest_bad ? "mismatch" : "ok");
+    }
     printf("ELAPSED_MS=%.0f\n", elapsed_ms);
     printf("GOODPUT_KBPS=%.2f\n", goodput_kbps);
 
-    fclose(in);
+    if (map) {
+        munmap((void *)map, (size_t)file_size);
+    }
+    mpath_close(&mp);
+    free(window);
+    free(slot_pool);
+    free(buf);
+    free(lz_tmp);
+    free(recvbuf);
+    close_input(in);
     close(sock);
-    return 0;
+    return streams.failed || digest_bad ? 1 : 0;
 }
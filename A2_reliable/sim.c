@@ -0,0 +1,910 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "clock.h"
+#include "linkmodel.h"
+#include "netif.h"
+#include "reader.h"
+
+// Discrete-event simulation of transfers in virtual time. The sender and
+// receiver mains of the real binaries (compiled again with -Dmain=...) run
+// as two threads of one process, but only one of them runs at a time. A
+// thread that waits in netif_recv hands over to the next event: a packet
+// reaching its host, or a host's receive timeout. The link follows the
+// emulator's loss/delay/reorder/rate rules and its Gilbert-Elliott and
+// jitter models. Nothing reads the wall clock, so a seed replays the same
+// run to the packet, and an idle RTO costs no real time.
+//
+// Each scenario runs in a forked child, so a crash or a hang loses only
+// that scenario, and --jobs runs several at once. Results come out as one
+// KEY=VALUE line per scenario, in input order.
+
+int sender_gbn_main(int argc, char **argv);
+int receiver_gbn_main(int argc, char **argv);
+int sender_sr_main(int argc, char **argv);
+int receiver_sr_main(int argc, char **argv);
+int sender_basic_main(int argc, char **argv);
+int receiver_basic_main(int argc, char **argv);
+
+typedef struct {
+    const char *name;
+    int (*sender)(int, char **);
+    int (*receiver)(int, char **);
+} sim_mode_t;
+
+static const sim_mode_t modes[] = {
+    {"gbn", sender_gbn_main, receiver_gbn_main},
+    {"sr", sender_sr_main, receiver_sr_main},
+    {"basic", sender_basic_main, receiver_basic_main},
+};
+
+#define SIM_NMODES (sizeof(modes) / sizeof(modes[0]))
+#define SIM_MAX_ARGS 64
+#define SIM_MAX_LINE 4096
+#define SIM_SENDER_PORT 10000
+#define SIM_RECEIVER_PORT 10001
+// The writer ring of the receivers is 16 MB; below that it never fills,
+// so disk speed cannot change a run.
+#define SIM_MAX_SIZE_KB 8192
+// Virtual time starts here rather than at 0, which the binaries take to
+// mean "not set", as CLOCK_MONOTONIC never reads 0 either.
+#define SIM_EPOCH_NS 1000000000ULL
+// Real seconds a scenario may take before its child is killed; only a
+// host that spins without ever waiting can get there.
+#define SIM_WALL_LIMIT_S 60
+// Exit status of a host that never finished, as from timeout(1).
+#define SIM_RC_TIMEOUT 124
+
+typedef struct {
+    int mode;
+    double loss;
+    double delay_ms;
+    double reorder;
+    double rate_kbps;
+    bool gilbert;
+    lm_gilbert_t ge;
+    lm_jitter_t jitter;
+    int win;
+    int timeout_ms;
+    long size_kb;
+    long seed;
+    int poll_us;                  // virtual time one empty non-blocking poll takes
+    double limit_s;               // virtual time before unfinished hosts count as hung
+    char sender_args[SIM_MAX_LINE];
+    char receiver_args[SIM_MAX_LINE];
+} sim_cfg_t;
+
+typedef struct sim_pkt {
+    struct sim_pkt *next;
+    uint64_t at_ns;
+    uint64_t order;               // breaks ties between equal at_ns
+    int dst;
+    uint32_t len;
+    uint8_t data[];
+} sim_pkt_t;
+
+typedef struct {
+    int (*main_fn)(int, char **);
+    int argc;
+    char *argv[SIM_MAX_ARGS];
+
+    int fd;                       // /dev/null descriptor standing in for the socket
+    int port;
+    int peer_port;
+    sim_pkt_t *inbox_head;
+    sim_pkt_t *inbox_tail;
+    bool waiting;
+    uint64_t wake_ns;
+    bool done;
+    int rc;
+    pthread_cond_t turn;
+    pthread_t thread;
+
+    // Link state of the direction this host sends on.
+    uint64_t next_free_ns;
+    bool ge_bad;
+} sim_host_t;
+
+enum { SIM_RUNNING, SIM_DONE, SIM_HUNG };
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    const sim_cfg_t *cfg;
+    uint64_t now_ns;
+    uint64_t limit_ns;
+    uint64_t order;
+    uint64_t events;
+    int running;
+    int state;
+    sim_host_t hosts[2];
+    sim_pkt_t **heap;
+    size_t heap_len;
+    size_t heap_cap;
+    lm_rng_t rng;
+} sim_t;
+
+static sim_t sim;
+static _Thread_local int self = -1;
+
+static bool pkt_before(const sim_pkt_t *a, const sim_pkt_t *b) {
+    return a->at_ns < b->at_ns || (a->at_ns == b->at_ns && a->order < b->order);
+}
+
+static int heap_push(sim_pkt_t *p) {
+    if (sim.heap_len == sim.heap_cap) {
+        size_t cap = sim.heap_cap ? 2 * sim.heap_cap : 1024;
+        sim_pkt_t **heap = realloc(sim.heap, cap * sizeof(*heap));
+        if (!heap) {
+            return -1;
+        }
+        sim.heap = heap;
+        sim.heap_cap = cap;
+    }
+    size_t i = sim.heap_len++;
+    while (i > 0 && pkt_before(p, sim.heap[(i - 1) / 2])) {
+        sim.heap[i] = sim.heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    sim.heap[i] = p;
+    return 0;
+}
+
+static sim_pkt_t *heap_pop(void) {
+    sim_pkt_t *top = sim.heap[0];
+    sim_pkt_t *last = sim.heap[--sim.heap_len];
+    size_t i = 0;
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= sim.heap_len) {
+            break;
+        }
+        if (c + 1 < sim.heap_len && pkt_before(sim.heap[c + 1], sim.heap[c])) {
+            c++;
+        }
+        if (!pkt_before(sim.heap[c], last)) {
+            break;
+        }
+        sim.heap[i] = sim.heap[c];
+        i = c;
+    }
+    if (sim.heap_len > 0) {
+        sim.heap[i] = last;
+    }
+    return top;
+}
+
+static void give_turn(int h) {
+    sim.running = h;
+    if (h != self) {
+        pthread_cond_signal(&sim.hosts[h].turn);
+    }
+}
+
+// With the lock held and the caller waiting or done: advance virtual time
+// to the next event and hand the turn to the host it wakes.
+static void sim_next(void) {
+    for (;;) {
+        int hw = -1;
+        for (int i = 0; i < 2; i++) {
+            sim_host_t *h = &sim.hosts[i];
+            if (h->waiting && (hw < 0 || h->wake_ns < sim.hosts[hw].wake_ns)) {
+                hw = i;
+            }
+        }
+        sim_pkt_t *top = sim.heap_len > 0 ? sim.heap[0] : NULL;
+        uint64_t wake = hw >= 0 ? sim.hosts[hw].wake_ns : UINT64_MAX;
+        uint64_t next = top && top->at_ns < wake ? top->at_ns : wake;
+
+        if (next == UINT64_MAX || next > sim.limit_ns) {
+            sim.running = -1;
+            sim.state = sim.hosts[0].done && sim.hosts[1].done ? SIM_DONE : SIM_HUNG;
+            pthread_cond_signal(&sim.finished);
+            return;
+        }
+        if (next > sim.now_ns) {
+            sim.now_ns = next;
+        }
+        sim.events++;
+
+        // A packet due at the same time as a timeout is delivered first.
+        if (top && top->at_ns <= wake) {
+            heap_pop();
+            sim_host_t *d = &sim.hosts[top->dst];
+            if (d->done) {
+                free(top);
+                continue;
+            }
+            top->next = NULL;
+            if (d->inbox_tail) {
+                d->inbox_tail->next = top;
+            } else {
+                d->inbox_head = top;
+            }
+            d->inbox_tail = top;
+            if (d->waiting) {
+                d->waiting = false;
+                give_turn(top->dst);
+                return;
+            }
+            continue;
+        }
+        sim.hosts[hw].waiting = false;
+        give_turn(hw);
+        return;
+    }
+}
+
+static uint64_t sim_now(void *ctx) {
+    (void)ctx;
+    return sim.now_ns;
+}
+
+static int sim_socket(void *ctx) {
+    (void)ctx;
+    int fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    sim.hosts[self].fd = fd;
+    return fd;
+}
+
+static int sim_bind(void *ctx, int sock, int local_port) {
+    (void)ctx;
+    (void)sock;
+    sim.hosts[self].port = local_port;
+    return 0;
+}
+
+static int sim_connect(void *ctx, int sock, int peer_port) {
+    (void)ctx;
+    (void)sock;
+    sim.hosts[self].peer_port = peer_port;
+    return 0;
+}
+
+// The emulator's rules for one datagram from the calling host.
+static ssize_t sim_send(void *ctx, int sock, const struct iovec *iov, int iovcnt) {
+    (void)ctx;
+    (void)sock;
+    const sim_cfg_t *cfg = sim.cfg;
+    sim_host_t *h = &sim.hosts[self];
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+
+    int dst = -1;
+    for (int i = 0; i < 2; i++) {
+        if (sim.hosts[i].port == h->peer_port) {
+            dst = i;
+        }
+    }
+    bool drop = cfg->gilbert ? lm_gilbert_drop(&cfg->ge, &h->ge_bad, &sim.rng)
+                             : lm_rng_uniform(&sim.rng) < cfg->loss;
+    if (dst < 0 || drop) {
+        return (ssize_t)len;
+    }
+
+    double delay_ms = cfg->delay_ms;
+    if (lm_rng_uniform(&sim.rng) < cfg->reorder) {
+        delay_ms += 2 * cfg->delay_ms;
+    }
+    if (cfg->jitter.kind != LM_JITTER_NONE) {
+        delay_ms += lm_jitter_sample(&cfg->jitter, &sim.rng);
+    }
+    if (delay_ms < 0) {
+        delay_ms = 0;
+    }
+    // The delay, reorder bonus included, starts once the packet is
+    // serialised, as in emulator.py.
+    uint64_t at = sim.now_ns;
+    if (cfg->rate_kbps > 0) {
+        uint64_t start = h->next_free_ns > sim.now_ns ? h->next_free_ns : sim.now_ns;
+        h->next_free_ns = start + (uint64_t)((double)len * 8.0 * 1e6 / cfg->rate_kbps);
+        at = h->next_free_ns;
+    }
+    at += (uint64_t)(delay_ms * 1e6);
+
+    sim_pkt_t *p = malloc(sizeof(*p) + len);
+    if (!p) {
+        errno = ENOMEM;
+        return -1;
+    }
+    p->at_ns = at;
+    p->order = sim.order++;
+    p->dst = dst;
+    p->len = (uint32_t)len;
+    size_t off = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(p->data + off, iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+    }
+    if (heap_push(p) != 0) {
+        free(p);
+        errno = ENOMEM;
+        return -1;
+    }
+    return (ssize_t)len;
+}
+
+static ssize_t sim_recv(void *ctx, int sock, void *buf, size_t maxlen, int timeout_ms) {
+    (void)ctx;
+    (void)sock;
+    sim_host_t *h = &sim.hosts[self];
+    if (!h->inbox_head) {
+        // A busy poll still lets virtual time move on, by poll_us.
+        uint64_t wait_ns = timeout_ms > 0 ? (uint64_t)timeout_ms * 1000000ULL
+                                          : (uint64_t)sim.cfg->poll_us * 1000ULL;
+        pthread_mutex_lock(&sim.lock);
+        h->waiting = true;
+        h->wake_ns = timeout_ms < 0 ? UINT64_MAX : sim.now_ns + wait_ns;
+        sim_next();
+        while (sim.running != self) {
+            pthread_cond_wait(&h->turn, &sim.lock);
+        }
+        pthread_mutex_unlock(&sim.lock);
+        if (!h->inbox_head) {
+            return 0;
+        }
+    }
+    sim_pkt_t *p = h->inbox_head;
+    h->inbox_head = p->next;
+    if (!h->inbox_head) {
+        h->inbox_tail = NULL;
+    }
+    size_t n = p->len < maxlen ? p->len : maxlen;
+    memcpy(buf, p->data, n);
+    free(p);
+    return (ssize_t)n;
+}
+
+static void *host_main(void *arg) {
+    self = (int)(intptr_t)arg;
+    sim_host_t *h = &sim.hosts[self];
+    pthread_mutex_lock(&sim.lock);
+    while (sim.running != self) {
+        pthread_cond_wait(&h->turn, &sim.lock);
+    }
+    pthread_mutex_unlock(&sim.lock);
+
+    int rc = h->main_fn(h->argc, h->argv);
+
+    pthread_mutex_lock(&sim.lock);
+    h->done = true;
+    h->rc = rc;
+    sim_next();
+    pthread_mutex_unlock(&sim.lock);
+    return NULL;
+}
+
+static void build_argv(sim_host_t *h, const char *prog, char **fixed, char *extra) {
+    h->argc = 0;
+    h->argv[h->argc++] = (char *)prog;
+    for (; *fixed; fixed++) {
+        h->argv[h->argc++] = *fixed;
+    }
+    for (char *tok = strtok(extra, " \t"); tok && h->argc < SIM_MAX_ARGS - 1;
+         tok = strtok(NULL, " \t")) {
+        h->argv[h->argc++] = tok;
+    }
+    h->argv[h->argc] = NULL;
+}
+
+static int write_input(const char *path, size_t size, lm_rng_t *rng) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return -1;
+    }
+    uint8_t block[4096];
+    while (size > 0) {
+        size_t n = size < sizeof(block) ? size : sizeof(block);
+        for (size_t i = 0; i < n; i += 8) {
+            uint64_t r = lm_rng_next(rng);
+            memcpy(block + i, &r, n - i < 8 ? n - i : 8);
+        }
+        fwrite(block, 1, n, f);
+        size -= n;
+    }
+    return fclose(f);
+}
+
+static int same_file(const char *a, const char *b) {
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    int same = fa && fb;
+    uint8_t ba[65536];
+    uint8_t bb[65536];
+    while (same) {
+        size_t na = fread(ba, 1, sizeof(ba), fa);
+        size_t nb = fread(bb, 1, sizeof(bb), fb);
+        if (na != nb || memcmp(ba, bb, na) != 0) {
+            same = 0;
+        } else if (na == 0) {
+            break;
+        }
+    }
+    if (fa) {
+        fclose(fa);
+    }
+    if (fb) {
+        fclose(fb);
+    }
+    return same;
+}
+
+// Child side: run one scenario in dir and write its result line to out.
+static void run_child(const sim_cfg_t *cfg, const char *dir, int out) {
+    char in_path[512];
+    char out_path[512];
+    char log_path[512];
+    snprintf(in_path, sizeof(in_path), "%s/in.bin", dir);
+    snprintf(out_path, sizeof(out_path), "%s/out.bin", dir);
+    snprintf(log_path, sizeof(log_path), "%s/stdout.txt", dir);
+
+    alarm(SIM_WALL_LIMIT_S);
+    memset(&sim, 0, sizeof(sim));
+    sim.cfg = cfg;
+    sim.now_ns = SIM_EPOCH_NS;
+    sim.limit_ns = SIM_EPOCH_NS + (uint64_t)(cfg->limit_s * 1e9);
+    lm_rng_seed(&sim.rng, (uint64_t)cfg->seed);
+    lm_rng_t data_rng;
+    lm_rng_seed(&data_rng, (uint64_t)cfg->seed ^ 0x5eedULL);
+    if (write_input(in_path, (size_t)cfg->size_kb * 1024, &data_rng) != 0) {
+        perror(in_path);
+        _exit(1);
+    }
+
+    // Both hosts print into one log; the sender's statistics are the
+    // KEY=VALUE lines in it.
+    int log_fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (log_fd < 0 || null_fd < 0) {
+        _exit(1);
+    }
+    fflush(stdout);
+    dup2(log_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    close(log_fd);
+    close(null_fd);
+
+    char win[16];
+    char rto[16];
+    char sport[16];
+    char rport[16];
+    snprintf(win, sizeof(win), "%d", cfg->win);
+    snprintf(rto, sizeof(rto), "%d", cfg->timeout_ms);
+    snprintf(sport, sizeof(sport), "%d", SIM_SENDER_PORT);
+    snprintf(rport, sizeof(rport), "%d", SIM_RECEIVER_PORT);
+    char *recv_fixed[] = {"--listen", rport, "--peer_ip", "127.0.0.1", "--peer_port", sport,
+                          "--out", out_path, NULL};
+    char *send_fixed[] = {"--listen", sport, "--peer_ip", "127.0.0.1", "--peer_port", rport,
+                          "--in", in_path, "--win", win, "--timeout", rto, NULL};
+    char sargs[SIM_MAX_LINE];
+    char rargs[SIM_MAX_LINE];
+    snprintf(sargs, sizeof(sargs), "%s", cfg->sender_args);
+    snprintf(rargs, sizeof(rargs), "%s", cfg->receiver_args);
+
+    const sim_mode_t *m = &modes[cfg->mode];
+    // Host 0 is the receiver: like the scripts, it is up before the sender.
+    build_argv(&sim.hosts[0], "receiver", recv_fixed, rargs);
+    build_argv(&sim.hosts[1], "sender", send_fixed, sargs);
+    sim.hosts[0].main_fn = m->receiver;
+    sim.hosts[1].main_fn = m->sender;
+
+    clock_ops_t clk = {sim_now, NULL};
+    netif_ops_t net = {sim_socket, sim_bind, sim_connect, sim_send, sim_recv, NULL};
+    clock_set_ops(&clk);
+    netif_set_ops(&net);
+    reader_set_blocking(1);
+
+    pthread_mutex_init(&sim.lock, NULL);
+    pthread_cond_init(&sim.finished, NULL);
+    pthread_mutex_lock(&sim.lock);
+    for (int i = 0; i < 2; i++) {
+        sim_host_t *h = &sim.hosts[i];
+        pthread_cond_init(&h->turn, NULL);
+        h->fd = -1;
+        h->waiting = true;
+        h->wake_ns = 0;
+        sim.running = -1;
+        if (pthread_create(&h->thread, NULL, host_main, (void *)(intptr_t)i) != 0) {
+            _exit(1);
+        }
+    }
+    sim_next();
+    while (sim.state == SIM_RUNNING) {
+        pthread_cond_wait(&sim.finished, &sim.lock);
+    }
+    // A hung host stays blocked in its thread; _exit below ends it.
+    int state = sim.state;
+    uint64_t now_ns = sim.now_ns - SIM_EPOCH_NS;
+    uint64_t events = sim.events;
+    int rc[2];
+    for (int i = 0; i < 2; i++) {
+        rc[i] = sim.hosts[i].done ? sim.hosts[i].rc : SIM_RC_TIMEOUT;
+    }
+    pthread_mutex_unlock(&sim.lock);
+    if (state == SIM_DONE) {
+        for (int i = 0; i < 2; i++) {
+            pthread_join(sim.hosts[i].thread, NULL);
+        }
+    }
+    fflush(stdout);
+
+    char line[SIM_MAX_LINE];
+    int len = snprintf(line, sizeof(line), "HASH_OK=%d SENDER_RC=%d RECEIVER_RC=%d SIM_MS=%.3f EVENTS=%llu",
+                       rc[0] == 0 && same_file(in_path, out_path), rc[1], rc[0],
+                       (double)now_ns / 1e6, (unsigned long long)events);
+    FILE *log = fopen(log_path, "r");
+    char buf[256];
+    while (log && fgets(buf, sizeof(buf), log)) {
+        size_t key = strspn(buf, "ABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789");
+        if (key == 0 || buf[key] != '=') {
+            continue;
+        }
+        // CPU time is the simulator's, both hosts' at once, and the one
+        // value a seed does not replay; it stays in stdout.txt only.
+        if ((key == 6 && strncmp(buf, "CPU_MS", 6) == 0) ||
+            (key == 15 && strncmp(buf, "RECEIVER_CPU_MS", 15) == 0)) {
+            continue;
+        }
+        buf[strcspn(buf, "\r\n")] = '\0';
+        len += snprintf(line + len, sizeof(line) - (size_t)len, " %s", buf);
+        if (len >= (int)sizeof(line) - 1) {
+            len = (int)sizeof(line) - 2;
+            break;
+        }
+    }
+    if (log) {
+        fclose(log);
+    }
+    line[len++] = '\n';
+    if (write(out, line, (size_t)len) != len) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--mode gbn|sr|basic] [--loss P] [--delay_ms MS] [--reorder P] [--rate_kbps KBPS]\n"
+            "          [--ge_p P --ge_r R [--ge_loss_bad P]] [--jitter normal|pareto --jitter_ms MS [--jitter_alpha A]]\n"
+            "          [--win N] [--timeout MS] [--size_kb N] [--seed N] [--poll_us US] [--limit_s S]\n"
+            "          [--sender_args \"ARGS\"] [--receiver_args \"ARGS\"]\n"
+            "          [--runs N] [--batch FILE|-] [--jobs N] [--keep DIR]\n",
+            prog);
+}
+
+// Scenario options; returns -1 on anything else.
+static int parse_opt(sim_cfg_t *cfg, int argc, char **argv, int *i) {
+    const char *opt = argv[*i];
+    if (*i + 1 >= argc) {
+        return -1;
+    }
+    const char *val = argv[++*i];
+    if (strcmp(opt, "--mode") == 0) {
+        for (size_t m = 0; m < SIM_NMODES; m++) {
+            if (strcmp(val, modes[m].name) == 0) {
+                cfg->mode = (int)m;
+                return 0;
+            }
+        }
+        return -1;
+    } else if (strcmp(opt, "--loss") == 0) {
+        cfg->loss = atof(val);
+    } else if (strcmp(opt, "--delay_ms") == 0) {
+        cfg->delay_ms = atof(val);
+    } else if (strcmp(opt, "--reorder") == 0) {
+        cfg->reorder = atof(val);
+    } else if (strcmp(opt, "--rate_kbps") == 0) {
+        cfg->rate_kbps = atof(val);
+    } else if (strcmp(opt, "--ge_p") == 0) {
+        cfg->ge.p = atof(val);
+        cfg->gilbert = true;
+    } else if (strcmp(opt, "--ge_r") == 0) {
+        cfg->ge.r = atof(val);
+    } else if (strcmp(opt, "--ge_loss_bad") == 0) {
+        cfg->ge.loss_bad = atof(val);
+    } else if (strcmp(opt, "--jitter") == 0) {
+        return lm_jitter_parse(val, &cfg->jitter.kind);
+    } else if (strcmp(opt, "--jitter_ms") == 0) {
+        cfg->jitter.ms = atof(val);
+    } else if (strcmp(opt, "--jitter_alpha") == 0) {
+        cfg->jitter.alpha = atof(val);
+    } else if (strcmp(opt, "--win") == 0) {
+        cfg->win = atoi(val);
+    } else if (strcmp(opt, "--timeout") == 0) {
+        cfg->timeout_ms = atoi(val);
+    } else if (strcmp(opt, "--size_kb") == 0) {
+        cfg->size_kb = atol(val);
+    } else if (strcmp(opt, "--seed") == 0) {
+        cfg->seed = atol(val);
+    } else if (strcmp(opt, "--poll_us") == 0) {
+        cfg->poll_us = atoi(val);
+    } else if (strcmp(opt, "--limit_s") == 0) {
+        cfg->limit_s = atof(val);
+    } else if (strcmp(opt, "--sender_args") == 0) {
+        snprintf(cfg->sender_args, sizeof(cfg->sender_args), "%s", val);
+    } else if (strcmp(opt, "--receiver_args") == 0) {
+        snprintf(cfg->receiver_args, sizeof(cfg->receiver_args), "%s", val);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static bool cfg_valid(const sim_cfg_t *cfg) {
+    return cfg->loss >= 0 && cfg->loss <= 1 && cfg->delay_ms >= 0 && cfg->reorder >= 0 &&
+           cfg->rate_kbps >= 0 && cfg->win > 0 && cfg->timeout_ms > 0 && cfg->size_kb >= 0 &&
+           cfg->size_kb <= SIM_MAX_SIZE_KB && cfg->poll_us > 0 && cfg->limit_s > 0 &&
+           cfg->jitter.ms >= 0 && cfg->jitter.alpha > 1.0 &&
+           (!cfg->gilbert || (cfg->ge.p > 0 && cfg->ge.r > 0));
+}
+
+// Split a batch line into words; "..." groups words (for --sender_args).
+static int split_line(char *line, char **argv, int max) {
+    int argc = 1;
+    char *p = line;
+    while (*p && argc < max - 1) {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+            p++;
+        }
+        if (!*p || *p == '#') {
+            break;
+        }
+        char end = ' ';
+        if (*p == '"') {
+            end = '"';
+            p++;
+        }
+        argv[argc++] = p;
+        while (*p && *p != end && (end == '"' || (*p != '\t' && *p != '\n' && *p != '\r'))) {
+            p++;
+        }
+        if (*p) {
+            *p++ = '\0';
+        }
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+typedef struct {
+    sim_cfg_t cfg;
+    pid_t pid;
+    int pipe_rd;
+    char dir[512];
+    char *result;
+} sim_run_t;
+
+static void rm_run_dir(const char *dir) {
+    const char *files[] = {"in.bin", "out.bin", "stdout.txt"};
+    char path[600];
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+static int start_run(sim_run_t *r, const char *base, size_t idx) {
+    snprintf(r->dir, sizeof(r->dir), "%s/run_%zu", base, idx);
+    if (mkdir(r->dir, 0755) != 0 && errno != EEXIST) {
+        perror(r->dir);
+        return -1;
+    }
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        run_child(&r->cfg, r->dir, fds[1]);
+    }
+    close(fds[1]);
+    r->pid = pid;
+    r->pipe_rd = fds[0];
+    return 0;
+}
+
+static void finish_run(sim_run_t *r, size_t idx, int status, bool keep) {
+    const sim_cfg_t *c = &r->cfg;
+    char head[SIM_MAX_LINE];
+    int n = snprintf(head, sizeof(head),
+                     "RUN=%zu MODE=%s SEED=%ld LOSS=%g DELAY_MS=%g REORDER=%g RATE_KBPS=%g "
+                     "TIMEOUT_MS=%d SIZE_KB=%ld",
+                     idx, modes[c->mode].name, c->seed, c->loss, c->delay_ms, c->reorder,
+                     c->rate_kbps, c->timeout_ms, c->size_kb);
+    char body[SIM_MAX_LINE];
+    ssize_t got = read(r->pipe_rd, body, sizeof(body) - 1);
+    close(r->pipe_rd);
+    if (got > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        body[got] = '\0';
+        body[strcspn(body, "\n")] = '\0';
+    } else {
+        // The child died before it could report: count both hosts as failed.
+        snprintf(body, sizeof(body), "HASH_OK=0 SENDER_RC=%d RECEIVER_RC=%d CHILD_STATUS=%d",
+                 SIM_RC_TIMEOUT, SIM_RC_TIMEOUT,
+                 WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status));
+    }
+    size_t len = (size_t)n + strlen(body) + 2;
+    r->result = malloc(len);
+    if (r->result) {
+        snprintf(r->result, len, "%s %s", head, body);
+    }
+    if (!keep) {
+        rm_run_dir(r->dir);
+    }
+}
+
+int main(int argc, char **argv) {
+    // Parallel runs reuse the same ports, so their stats pages would clash.
+    unsetenv("RDT_STATS");
+    sim_cfg_t base;
+    memset(&base, 0, sizeof(base));
+    base.win = 20;
+    base.timeout_ms = 500;
+    base.size_kb = 300;
+    base.seed = 1;
+    base.poll_us = 1000;
+    base.limit_s = 600;
+    base.ge.loss_bad = 1.0;
+    base.jitter.alpha = 1.5;
+    long runs = 1;
+    int jobs = 1;
+    const char *batch = NULL;
+    const char *keep = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch = argv[++i];
+        } else if (strcmp(argv[i], "--keep") == 0 && i + 1 < argc) {
+            keep = argv[++i];
+        } else if (parse_opt(&base, argc, argv, &i) != 0) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (runs <= 0 || jobs <= 0 || !cfg_valid(&base)) {
+        usage(argv[0]);
+        return 1;
+    }
+    base.ge.loss_good = base.loss;
+
+    // Scenarios: --runs seeds from --seed on, or one per batch line on top
+    // of the command-line options.
+    sim_run_t *list = NULL;
+    size_t n = 0;
+    size_t cap = 0;
+    FILE *bf = NULL;
+    if (batch) {
+        bf = strcmp(batch, "-") == 0 ? stdin : fopen(batch, "r");
+        if (!bf) {
+            perror(batch);
+            return 1;
+        }
+    }
+    char line[SIM_MAX_LINE];
+    for (long k = 0; bf ? fgets(line, sizeof(line), bf) != NULL : k < runs; k++) {
+        sim_cfg_t cfg = base;
+        if (bf) {
+            char *words[SIM_MAX_ARGS];
+            int wc = split_line(line, words, SIM_MAX_ARGS);
+            if (wc == 1) {
+                continue;
+            }
+            for (int i = 1; i < wc; i++) {
+                if (parse_opt(&cfg, wc, words, &i) != 0) {
+                    fprintf(stderr, "batch line %ld: bad option %s\n", k + 1, words[i]);
+                    return 1;
+                }
+            }
+            if (!cfg_valid(&cfg)) {
+                fprintf(stderr, "batch line %ld: bad scenario\n", k + 1);
+                return 1;
+            }
+            cfg.ge.loss_good = cfg.loss;
+        } else {
+            cfg.seed = base.seed + k;
+        }
+        if (n == cap) {
+            cap = cap ? 2 * cap : 64;
+            sim_run_t *l = realloc(list, cap * sizeof(*l));
+            if (!l) {
+                return 1;
+            }
+            list = l;
+        }
+        memset(&list[n], 0, sizeof(list[n]));
+        list[n++].cfg = cfg;
+    }
+    if (bf && bf != stdin) {
+        fclose(bf);
+    }
+
+    char tmpl[] = "/tmp/rdt_sim.XXXXXX";
+    const char *dir = keep;
+    if (keep) {
+        mkdir(keep, 0755);
+    } else if (!(dir = mkdtemp(tmpl))) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    struct timespec t0;
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    size_t next = 0;
+    size_t printed = 0;
+    int active = 0;
+    int failed = 0;
+    while (printed < n) {
+        while (active < jobs && next < n) {
+            if (start_run(&list[next], dir, next) != 0) {
+                return 1;
+            }
+            next++;
+            active++;
+        }
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) {
+            perror("wait");
+            return 1;
+        }
+        for (size_t i = printed; i < next; i++) {
+            if (list[i].pid == pid) {
+                finish_run(&list[i], i, status, keep != NULL);
+                list[i].pid = 0;
+                active--;
+                break;
+            }
+        }
+        // Results leave in input order.
+        while (printed < next && list[printed].pid == 0) {
+            const char *res = list[printed].result;
+            printf("%s\n", res ? res : "");
+            if (!res || !strstr(res, " HASH_OK=1 ")) {
+                failed++;
+            }
+            free(list[printed].result);
+            printed++;
+        }
+        fflush(stdout);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (!keep) {
+        rmdir(dir);
+    }
+    double wall = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "%zu runs, %d without a correct output file, %.2f s\n", n, failed, wall);
+    free(list);
+    return 0;
+}